@@ -0,0 +1,50 @@
+# Matja e shpejtesise se hash-it: ndertohen shume celesa te gjate,
+# futen ne nje fjalor dhe kerkohen perseri. Cdo varg i ri bashkohet
+# dhe hash-ohet nga e para, keshtu qe koha varet nga gjatesia e tij.
+
+shpall rrokjet = ["ba", "ce", "di", "fo", "gu", "ha", "je", "ka",
+                  "lo", "mu", "ne", "pi", "ra", "se", "te", "vu"];
+shpall n = rrokjet.gjatesia();
+
+# Nje parashtese e gjate, qe celesat te ndryshojne vetem ne fund.
+shpall parashtesa = "celes-shume-i-gjate-per-matjen-e-hash-it-te-vargjeve-";
+per (shpall i = 0; i < 3; i = i + 1) parashtesa = parashtesa + parashtesa;
+
+funksion celesi(a, b, c) {
+  kthe parashtesa + rrokjet[a] + rrokjet[b] + rrokjet[c];
+}
+
+# Futja: 4096 celesa te rinj.
+shpall fillimi = koha();
+shpall fjalori = {};
+shpall numri = 0;
+per (shpall a = 0; a < n; a = a + 1) {
+  per (shpall b = 0; b < n; b = b + 1) {
+    per (shpall c = 0; c < n; c = c + 1) {
+      fjalori[celesi(a, b, c)] = numri;
+      numri = numri + 1;
+    }
+  }
+}
+shpall kohaFutjes = koha() - fillimi;
+
+# Kerkimi: cdo celes ndertohet perseri, keshtu qe hash-ohet perseri.
+fillimi = koha();
+shpall shuma = 0;
+per (shpall here = 0; here < 10; here = here + 1) {
+  per (shpall a = 0; a < n; a = a + 1) {
+    per (shpall b = 0; b < n; b = b + 1) {
+      per (shpall c = 0; c < n; c = c + 1) {
+        shuma = shuma + fjalori[celesi(a, b, c)];
+      }
+    }
+  }
+}
+shpall kohaKerkimit = koha() - fillimi;
+
+printo fjalori.gjatesia(); # 4096
+printo shuma; # 83865600
+printo "Futja (sekonda):";
+printo kohaFutjes;
+printo "Kerkimi (sekonda):";
+printo kohaKerkimit;
@@ -0,0 +1,38 @@
+# Nje parathenie: perkufizime qe skriptet e tjera i perdorin.
+# Ruhet si fotografi e kujteses dhe ngarkohet pa u ekzekutuar perseri:
+#   clox --snapshot examples/parathenie.al parathenie.snap
+#   clox --prelude parathenie.snap skripti.al
+
+funksion numerues() {
+  shpall n = 0;
+  funksion rrit() {
+    n = n + 1;
+    kthe n;
+  }
+  kthe rrit;
+}
+
+tip Pike {
+  init(x, y) {
+    this.x = x;
+    this.y = y;
+  }
+
+  largesia() {
+    kthe this.x * this.x + this.y * this.y;
+  }
+}
+
+shpall tjetri = numerues();
+shpall origjina = Pike(0, 0);
+shpall pika = Pike(3, 4);
+shpall matja = pika.largesia;
+shpall ngjyrat = ["e kuqe", "jeshile", 7, vertet, Pike(1, 1)];
+shpall numrat = [1, 2, 3];
+shpall mosha = {"Ana": 30, 4: "kater", "nje varg i gjate si celes": ngjyrat};
+shpall pershendetja = "Pershendetje" + ", " + "bote nga parathenia";
+shpall fjalet = pershendetja.ndaj(" ");
+shpall argumentet_e_vjeter = argumentet;
+tjetri();
+
+printo "Parathenia u ngarkua.";
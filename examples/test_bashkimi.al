@@ -0,0 +1,41 @@
+# Bashkimi i vargjeve ne nje cikel
+
+shpall raporti = "";
+per (shpall i = 0; i < 10000; i = i + 1) {
+  raporti = raporti + "rresht;";
+}
+printo "Gjatesia e raportit:";
+printo raporti.gjatesia(); # Duhet te jete 70000
+
+shpall a = "Pershendetje, " + "bote e madhe " + "dhe e bukur!";
+shpall b = "Pershendetje, bote e madhe dhe e bukur!";
+printo a;
+printo a == b; # vertet
+printo a == b + "?"; # gabuar
+
+shpall pjese = "abc" + "def";
+printo pjese == "abcdef"; # vertet
+
+# Vargjet e krijuara gjate ekzekutimit krahasohen sipas permbajtjes
+shpall emri = "Ar" + "ta";
+printo emri == "Arta"; # vertet
+printo emri + "n" == "Artan"; # vertet
+printo emri == "Arte"; # gabuar
+
+# Vargjet e shkurtra (deri ne 6 bajte) ruhen brenda vleres
+shpall x = "ab";
+shpall y = x + "cd";
+printo y; # abcd
+printo y == "abcd"; # vertet
+printo (y + "ef") == "abcdef"; # vertet
+printo (y + "efg").gjatesia(); # 7
+printo "".gjatesia(); # 0
+printo "" + x == x; # vertet
+
+# Numrat bashkohen me vargjet dhe shfaqen me aq shifra sa duhen
+shpall numri = 7;
+printo "Fibonacci per " + numri + " eshte: " + 13;
+printo "Rezultati: " + (0.1 + 0.2);
+printo 1 / 3;
+printo 1500000;
+printo 0.000001;
@@ -0,0 +1,18 @@
+# Dalja shkon permes nje buferi dhe zbrazet ne fund te programit.
+printo "fillimi";
+printo 1.5;
+printo [1, "dy", vertet, gabuar];
+printo "numri " + 42;
+
+# Shume rreshta mbushin buferin disa here.
+shpall shuma = 0;
+per (shpall i = 0; i < 20000; i = i + 1) {
+  shuma = shuma + i;
+  nese (i > 19995) printo i;
+}
+printo shuma;
+
+# zbraz() i nxjerr menjehere ato qe jane shtypur deri tani.
+printo "para zbrazjes";
+zbraz();
+printo "pas zbrazjes";
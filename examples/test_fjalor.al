@@ -0,0 +1,65 @@
+# Fjalori (map): celesat mund te jene numra, vargje ose objekte
+
+shpall mosha = {"Ana": 30, "Besi": 25};
+printo mosha["Ana"]; # 30
+mosha["Dritan"] = 41;
+printo mosha.gjatesia(); # 3
+printo mosha.permban("Besi"); # vertet
+printo mosha.permban("Zana"); # gabuar
+printo mosha["Zana"]; # nil
+
+printo mosha.fshi("Besi"); # vertet
+printo mosha.fshi("Besi"); # gabuar
+printo mosha.gjatesia(); # 2
+
+# Numerimi i fjaleve pa kerkim linear ne liste
+shpall fjalet = ["molle", "dardha", "molle", "qershi", "molle", "dardha"];
+shpall numri = {};
+per (shpall i = 0; i < fjalet.gjatesia(); i = i + 1) {
+  shpall f = fjalet[i];
+  nese (!numri.permban(f)) numri[f] = 0;
+  numri[f] = numri[f] + 1;
+}
+printo numri["molle"]; # 3
+printo numri["dardha"]; # 2
+printo numri["qershi"]; # 1
+printo numri.celesat().gjatesia(); # 3
+
+# Celesat numerike dhe vargjet e krijuara gjate ekzekutimit
+shpall katrore = {};
+per (shpall i = 0; i < 100; i = i + 1) {
+  katrore[i] = i * i;
+}
+printo katrore[12]; # 144
+printo katrore.gjatesia(); # 100
+printo katrore[0] == katrore[-0]; # vertet
+
+shpall emri = "Dritan";
+shpall celesi = "Dri" + "tan";
+printo mosha[celesi]; # 41
+shpall gjate = "nje varg shume i gjate qe nuk futet ne vlere" + "!";
+mosha[gjate] = 1;
+printo mosha["nje varg shume i gjate qe nuk futet ne vlere!"]; # 1
+
+funksion f() {}
+shpall sipas = {f: "funksion", vertet: "po"};
+printo sipas[f]; # funksion
+printo sipas[vertet]; # po
+printo {"a": 1};
+
+# Vargjet e shkurtra jane nje celes i vetem, si ato te shkruara ne kod,
+# si ato te bashkuara, si ai bosh qe kthen lexo().
+shpall perzier = {};
+per (shpall i = 0; i < 200; i = i + 1) perzier[i] = i;
+perzier["abc"] = 1;
+perzier["a" + "bc"] = 2;
+perzier[lexo(1)] = 3;
+printo perzier["ab" + "c"]; # 2
+printo perzier[""]; # 3
+printo perzier.permban(""); # vertet
+perzier[""] = 4;
+printo perzier.gjatesia(); # 202
+printo perzier.fshi("a" + ""); # gabuar
+printo perzier.fshi("abc"); # vertet
+printo perzier.permban("a" + "bc"); # gabuar
+printo perzier.gjatesia(); # 201
@@ -10,4 +10,17 @@ shpall shuma = 0;
 per (shpall n = 1; n <= 10; n = n + 1) {
   shuma = shuma + n;
 }
-printo shuma; # Duhet te jete 55
\ No newline at end of file
+printo shuma; # Duhet te jete 55
+printo "Kalimi neper elementet e nje liste:";
+shpall frutat = ["molle", "dardhe", "qershi"];
+per (shpall fruti ne frutat) {
+  printo fruti;
+}
+
+# Cdo kalim ka variablin e vet, keshtu qe funksionet e mbajne vleren e tyre
+shpall funksionet = [];
+per (shpall n ne [1, 2, 3]) {
+  funksion katrori() { kthe n * n; }
+  funksionet.shto(katrori);
+}
+per (shpall f ne funksionet) printo f(); # 1, 4, 9
@@ -0,0 +1,75 @@
+# Nje korutine ka stivin e vet. jep() e ndal dhe i kthen vleren atij qe
+# e vazhdoi; vazhdo() e nis ose e vazhdon aty ku u ndal.
+
+# Gjenerator: numrat e Fibonacci-t, nje nga nje.
+funksion fibonacci() {
+  shpall a = 0;
+  shpall b = 1;
+  derisa (vertet) {
+    jep(a);
+    shpall c = a + b;
+    a = b;
+    b = c;
+  }
+}
+
+shpall gjeneratori = korutine(fibonacci);
+shpall numrat = [];
+per (shpall i = 0; i < 10; i = i + 1) numrat.shto(gjeneratori.vazhdo());
+printo numrat; # [0, 1, 1, 2, 3, 5, 8, 13, 21, 34]
+
+# Vlerat kalojne ne te dy drejtimet: argumenti i vazhdo() behet vlera
+# qe kthen jep().
+funksion shumuesi(fillimi) {
+  shpall shuma = fillimi;
+  derisa (vertet) {
+    shpall x = jep(shuma);
+    nese (x == 0) kthe "fund";
+    shuma = shuma + x;
+  }
+}
+
+shpall s = korutine(shumuesi);
+printo s.vazhdo(100); # 100
+printo s.vazhdo(5); # 105
+printo s.vazhdo(10); # 115
+printo s.vazhdo(0); # fund
+printo s.perfundoi(); # true
+
+# Korutinat mund te vazhdojne njera-tjetren: nje rrjedhe me dy hapa.
+funksion burimi() {
+  per (shpall i = 1; i <= 3; i = i + 1) jep(i);
+}
+
+funksion dyfishuesi(burim) {
+  derisa (vertet) {
+    shpall x = burim.vazhdo();
+    nese (burim.perfundoi()) kthe "mbaroi";
+    jep(x * 2);
+  }
+}
+
+shpall rrjedha = korutine(dyfishuesi);
+printo rrjedha.vazhdo(korutine(burimi)); # 2
+printo rrjedha.vazhdo(); # 4
+printo rrjedha.vazhdo(); # 6
+printo rrjedha.vazhdo(); # mbaroi
+
+# Closure-t mbi variablat lokale te nje korutine i shohin ato edhe kur
+# korutina eshte ndalur.
+funksion numeruesi() {
+  shpall n = 0;
+  funksion rrit() {
+    n = n + 1;
+    kthe n;
+  }
+  jep(rrit);
+  jep(n);
+}
+
+shpall k = korutine(numeruesi);
+shpall rrit = k.vazhdo();
+rrit();
+rrit();
+printo k.vazhdo(); # 2
+printo rrit(); # 3
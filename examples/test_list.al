@@ -12,4 +12,18 @@ derisa (i < 3) {
 }
 
 printo "Lista e plote eshte:";
-printo miqte;
\ No newline at end of file
+printo miqte;
+# Nje liste me vetem numra qe me pas merr edhe vargje
+shpall numrat = [1, 2, 3];
+numrat[1] = "dy" + " (tekst i gjate qe nuk futet ne vlere)";
+shpall tjeter = [];
+per (shpall i = 0; i < 100; i = i + 1) { tjeter = [i, i + 1]; }
+printo numrat;
+printo tjeter;
+# Nje liste me vetem konstante krijohet si kopje e re sa here qe ekzekutohet
+funksion tabela() { kthe [1, -2, "tre", vertet]; }
+shpall t1 = tabela();
+shpall t2 = tabela();
+t1[0] = 100;
+printo t1;
+printo t2;
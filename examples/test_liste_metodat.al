@@ -0,0 +1,64 @@
+# Metodat e listave: shto, hiq, fut, fshi, rezervo, pjese, rendit
+
+shpall l = [];
+l.rezervo(10);
+per (shpall i = 0; i < 5; i = i + 1) l.shto(i * 10);
+printo l; # [0, 10, 20, 30, 40]
+printo l.hiq(); # 40
+l.fut(0, "fillim");
+l.fut(2, "mes");
+printo l; # [fillim, 0, mes, 10, 20, 30]
+printo l.fshi(2); # mes
+printo l.gjatesia(); # 5
+
+# Pjeset ndajne elementet me origjinalin derisa njera ndryshon
+shpall madhe = [];
+per (shpall i = 0; i < 100; i = i + 1) madhe.shto(i);
+shpall p = madhe.pjese(10, 60);
+printo p.gjatesia(); # 50
+printo p[0]; # 10
+p[0] = "ndryshuar";
+printo madhe[10]; # 10
+madhe[11] = "edhe kjo";
+printo p[1]; # 11
+printo madhe.pjese(95); # [95, 96, 97, 98, 99]
+printo madhe.pjese(3, 1); # []
+
+# Renditja
+shpall n = [5, 3, 9, 1, 7, 2];
+n.rendit();
+printo n; # [1, 2, 3, 5, 7, 9]
+shpall fjale = ["dardha", "molle", "ananas", "arre", "a", "molle"];
+fjale.rendit();
+printo fjale; # [a, ananas, arre, dardha, molle, molle]
+
+funksion zbrites(a, b) { kthe a > b; }
+shpall z = [4, 8, 1, 6];
+z.rendit(zbrites);
+printo z; # [8, 6, 4, 1]
+
+funksion sipasGjatesise(a, b) { kthe a.gjatesia() - b.gjatesia(); }
+fjale.rendit(sipasGjatesise);
+printo fjale[0]; # a
+printo fjale[5]; # dardha
+
+# Nje liste e madhe, e renditur dhe e kontrolluar
+shpall r = [];
+per (shpall i = 0; i < 20000; i = i + 1) {
+  # Gjysma ne rritje, gjysma ne zbritje, te nderthurura
+  nese (i < 10000) r.shto(i * 3);
+  nese (i >= 10000) r.shto(60000 - i * 2);
+}
+r.rendit();
+shpall renditur = vertet;
+per (shpall i = 1; i < r.gjatesia(); i = i + 1) {
+  nese (r[i - 1] > r[i]) renditur = gabuar;
+}
+printo renditur; # vertet
+
+# Nje liste qe ka pasur nje varg, por tani ka vetem numra, renditet si
+# liste numrash.
+shpall perzier = ["a", 3, 2];
+perzier[0] = 1;
+perzier.rendit();
+printo perzier; # [1, 2, 3]
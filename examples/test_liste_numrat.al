@@ -0,0 +1,32 @@
+# Metodat numerike te listave
+shpall l = [];
+l.mbush(0, 100);
+per (shpall i = 0; i < 100; i = i + 1) {
+  l[i] = i + 1;
+}
+printo l.shuma();
+printo l.min();
+printo l.maks();
+printo l.indeksi(42);
+printo l.indeksi(1000);
+
+shpall v = [1, 2, 3];
+shpall w = [4, 5, 6];
+printo v.prodhimi(w);
+v.mbledh(w);
+printo v;
+v.shkallezo(0.5);
+printo v;
+
+shpall z = [];
+z.mbush(7, 5);
+printo z;
+z.mbush("a");
+printo z;
+printo z.indeksi("a");
+printo [].min();
+
+# Nje liste qe ka pasur nje varg mbetet numerike pasi vargu hiqet
+shpall p = [3, "x"];
+p.hiq();
+printo p.shuma();
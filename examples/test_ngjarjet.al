@@ -0,0 +1,64 @@
+# Cikli i ngjarjeve. Nje detyre eshte korutine qe e nis vete cikli.
+# fli(), prit() dhe prano() ndalin vetem detyren qe i therret; nderkohe
+# cikli ekzekuton detyrat e tjera qe jane gati.
+shpall NL = "
+";
+
+# Kohematesit zgjojne sipas radhes ne te cilen mbarojne.
+shpall rendi = [];
+funksion vone(n) {
+  fli(n / 100);
+  rendi.shto(n);
+}
+detyre(vone, 3);
+detyre(vone, 1);
+detyre(vone, 2);
+prisDetyrat();
+printo rendi; # [1, 2, 3]
+
+# Nje server dhe dy kliente ne te njejtin proces, mbi nje soket Unix.
+shpall SOKETA = "/tmp/dotal_test_ngjarjet.sock";
+shpall serveri = degjo(SOKETA);
+
+funksion sherbe(lidhja) {
+  shpall r = lidhja.prit();
+  derisa (r) {
+    lidhja.shkruaj("jehone: ", r, NL);
+    lidhja.zbraz();
+    r = lidhja.prit();
+  }
+  lidhja.mbyll();
+}
+
+funksion pranoLidhjet() {
+  per (shpall i = 0; i < 2; i = i + 1) detyre(sherbe, serveri.prano());
+  serveri.mbyll();
+}
+
+funksion klienti(emri) {
+  shpall lidhja = lidhu(SOKETA);
+  per (shpall i = 1; i <= 3; i = i + 1) {
+    lidhja.shkruaj(emri, " ", i, NL);
+    lidhja.zbraz();
+    printo emri + " mori " + lidhja.prit();
+  }
+  lidhja.mbyll();
+}
+
+detyre(pranoLidhjet);
+detyre(klienti, "A");
+detyre(klienti, "B");
+prisDetyrat();
+printo "te gjitha detyrat mbaruan";
+
+# Edhe skripti kryesor mund te prese; detyrat punojne nderkohe.
+shpall hapat = [];
+funksion numero() {
+  per (shpall i = 1; i <= 3; i = i + 1) {
+    hapat.shto(i);
+    fli(0.01);
+  }
+}
+detyre(numero);
+fli(0.1);
+printo hapat; # [1, 2, 3]
@@ -0,0 +1,43 @@
+# Puna mbi lista te medha ndahet ne disa thread-e, secili me VM-ne e vet.
+# Funksioni dhe globalet qe ai perdor kopjohen te cdo punetor.
+
+funksion katror(x) {
+  kthe x * x;
+}
+
+funksion mblidh(a, b) {
+  kthe a + b;
+}
+
+shpall numrat = [];
+per (shpall i = 1; i <= 10; i = i + 1) numrat.shto(i);
+
+printo numrat.hartoParalel(katror); # [1, 4, 9, ..., 100]
+printo numrat.palosParalel(mblidh, 0); # 55
+
+# Funksionet ndihmese dhe konstantet globale shkojne bashke me funksionin.
+shpall FAKTORI = 10;
+funksion shkallezo(x) {
+  kthe katror(x) * FAKTORI;
+}
+printo numrat.hartoParalel(shkallezo);
+
+funksion fib(n) {
+  nese (n < 2) kthe n;
+  kthe fib(n - 1) + fib(n - 2);
+}
+printo [15, 16, 17, 18].hartoParalel(fib); # [610, 987, 1597, 2584]
+
+funksion etiketo(emri) {
+  kthe [emri, emri.gjatesia()];
+}
+printo ["Ana", "Besi", "Dritan"].hartoParalel(etiketo);
+printo [].palosParalel(mblidh, 7); # 7
+
+# Vargjet e bashkuara kthehen nga punetoret si kopje.
+funksion bashko(a, b) {
+  kthe a + b;
+}
+shpall fjalet = [];
+per (shpall i = 0; i < 64; i = i + 1) fjalet.shto("nje varg jo i shkurter, ");
+printo fjalet.palosParalel(bashko, "").gjatesia(); # 1536
@@ -0,0 +1,49 @@
+# Shkrimi dhe leximi i skedareve.
+shpall NL = "
+";
+shpall shtegu = "/tmp/dotal_test_skedar.txt";
+
+shpall f = hap(shtegu, "w");
+printo f;
+f.shkruaj("rreshti i pare", NL);
+per (shpall i = 1; i <= 3; i = i + 1) {
+  f.shkruaj("numri ", i, NL);
+}
+f.mbyll();
+
+# "a" shton ne fund te skedarit.
+f = hap(shtegu, "a");
+f.shkruaj("fundi");
+f.mbyll();
+
+# Rreshtat lexohen nje nga nje; rreshti() kthen nil ne fund.
+shpall g = hap(shtegu);
+shpall r = g.rreshti();
+derisa (r) {
+  printo "> " + r;
+  r = g.rreshti();
+}
+g.mbyll();
+
+# lexo() kthen gjithe skedarin si nje varg.
+g = hap(shtegu);
+shpall teksti = g.lexo();
+printo teksti.gjatesia();
+printo teksti.ndaj(NL).gjatesia();
+g.mbyll();
+
+printo hap("/tmp/nuk/ekziston/skedar.txt");
+
+# Nje skedar i madh lexohet pa e kopjuar. Teksti i lexuar mbetet i
+# vlefshem edhe kur i njejti skedar rishkruhet me "w".
+shtegu = "/tmp/dotal_test_skedar_madh.txt";
+f = hap(shtegu, "w");
+per (shpall i = 0; i < 5000; i = i + 1) f.shkruaj("rreshti numer ", i, NL);
+f.mbyll();
+teksti = hap(shtegu).lexo();
+f = hap(shtegu, "w");
+f.shkruaj("x");
+f.mbyll();
+printo teksti.pjese(100, 140);
+printo teksti.gjatesia();
+printo hap(shtegu).lexo();
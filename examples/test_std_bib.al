@@ -8,4 +8,11 @@ shpall koha_perfundimtare = koha();
 
 shpall koha_e_pergjigjes = koha_perfundimtare - koha_fillestare;
 printo "U deshen kaq sekonda per t'u pergjigjur:";
-printo koha_e_pergjigjes;
\ No newline at end of file
+printo koha_e_pergjigjes;
+
+# Kur hyrja mbaron, rreshti() kthen nil dhe lexoTeGjitha() nje varg bosh.
+printo rreshti();
+printo lexoTeGjitha().gjatesia();
+
+# Argumentet qe vijne pas shtegut te skriptit ne rreshtin e komandes.
+printo argumentet();
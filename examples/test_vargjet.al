@@ -0,0 +1,29 @@
+# Metodat e vargjeve: pjese, indeksi, permban, fillonMe, mbaronMe, ndaj,
+# pastro, zevendeso
+
+shpall rreshti = "  2024-01-05 GABIM lidhja me serverin deshtoi  ";
+shpall pastruar = rreshti.pastro();
+printo "[" + pastruar + "]";
+printo pastruar.pjese(11, 16);
+printo pastruar.pjese(17);
+printo pastruar.indeksi("server");
+printo pastruar.indeksi("e", 20);
+printo pastruar.indeksi("mungon");
+printo pastruar.permban("GABIM");
+printo pastruar.fillonMe("2024");
+printo pastruar.mbaronMe("deshtoi");
+
+shpall fushat = "emri,mosha,,qyteti".ndaj(",");
+printo fushat;
+printo fushat.gjatesia();
+per (shpall fusha ne "Ana;30;Tirane".ndaj(";")) printo fusha;
+
+printo "nje mace, nje qen, nje mace".zevendeso("mace", "pule");
+printo "aaa".zevendeso("a", "bb");
+
+# Gjatesia dhe indekset numerojne shkronjat, jo bajtet
+shpall pershendetje = "Përshëndetje, çdo ditë!";
+printo pershendetje.gjatesia(); # 23
+printo pershendetje[1]; # ë
+printo pershendetje.pjese(14, 17); # çdo
+printo pershendetje.indeksi("ditë"); # 18
@@ -102,6 +102,10 @@ typedef enum {
    OP_BUILD_LIST,
     OP_GET_INDEX,
     OP_SET_INDEX,
+  OP_BUILD_MAP,
+  OP_CONSTANT_LIST,
+  OP_LIST_ITERATOR,
+  OP_FOR_EACH,
 //< Methods and Initializers method-op
 } OpCode;
 //< op-enum
@@ -27,6 +27,19 @@
 #define UINT8_COUNT (UINT8_MAX + 1)
 //< Local Variables uint8-count
 
+// The interpreter's state is per thread instead of being passed around
+// as a handle. Each thread can run a VM of its own, but only one: a
+// thread can't keep several VMs and switch between them. So the server
+// forks a child for each request and parallel calls start a fresh VM on
+// each worker, rather than reusing a pool of VMs that are reset.
+#if defined(_MSC_VER)
+#define THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__)
+#define THREAD_LOCAL __thread
+#else
+#define THREAD_LOCAL _Thread_local
+#endif
+
 #endif
 //> omit
 #undef DEBUG_PRINT_CODE
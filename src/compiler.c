@@ -10,6 +10,7 @@
 #include "common.h"
 #include "compiler.h"
 //> Garbage Collection compiler-include-memory
+#include "list.h"
 #include "memory.h"
 //< Garbage Collection compiler-include-memory
 #include "scanner.h"
@@ -124,13 +125,13 @@ typedef struct ClassCompiler {
 } ClassCompiler;
 //< Methods and Initializers class-compiler-struct
 
-Parser parser;
+THREAD_LOCAL Parser parser;
 //< Compiling Expressions parser
 //> Local Variables current-compiler
-Compiler* current = NULL;
+THREAD_LOCAL Compiler* current = NULL;
 //< Local Variables current-compiler
 //> Methods and Initializers current-class
-ClassCompiler* currentClass = NULL;
+THREAD_LOCAL ClassCompiler* currentClass = NULL;
 //< Methods and Initializers current-class
 //> Compiling Expressions compiling-chunk
 /* Compiling Expressions compiling-chunk < Calls and Functions current-chunk
@@ -142,6 +143,7 @@ static Chunk* currentChunk() {
 */
 //> Calls and Functions current-chunk
 static void list_(bool canAssign);
+static void map_(bool canAssign);
 static void subscript_(bool canAssign);
 static Chunk* currentChunk() {
   return &current->function->chunk;
@@ -680,7 +682,18 @@ static void number() {
 //> Global Variables number
 static void number(bool canAssign) {
 //< Global Variables number
-  double value = strtod(parser.previous.start, NULL);
+  // The source isn't NUL-terminated, so strtod() reads from a copy.
+  char buffer[64];
+  int length = parser.previous.length;
+  char* text = buffer;
+  if (length >= (int)sizeof(buffer)) {
+    text = (char*)malloc(length + 1);
+    if (text == NULL) exit(1);
+  }
+  memcpy(text, parser.previous.start, length);
+  text[length] = '\0';
+  double value = strtod(text, NULL);
+  if (text != buffer) free(text);
 /* Compiling Expressions number < Types of Values const-number-val
   emitConstant(value);
 */
@@ -708,8 +721,14 @@ static void string() {
 //> Global Variables string
 static void string(bool canAssign) {
 //< Global Variables string
-  emitConstant(OBJ_VAL(copyString(parser.previous.start + 1,
-                                  parser.previous.length - 2)));
+  const char* chars = parser.previous.start + 1;
+  int length = parser.previous.length - 2;
+  if (fitsShortString(chars, length)) {
+    emitConstant(makeShortString(chars, length));
+    return;
+  }
+
+  emitConstant(OBJ_VAL(copyString(chars, length)));
 }
 //< Strings parse-string
 /* Global Variables read-named-variable < Global Variables named-variable-signature
@@ -868,7 +887,7 @@ ParseRule rules[] = {
   [TOKEN_LEFT_PAREN]    = {grouping, call,   PREC_CALL},
 //< Calls and Functions infix-left-paren
   [TOKEN_RIGHT_PAREN]   = {NULL,     NULL,   PREC_NONE},
-  [TOKEN_LEFT_BRACE]    = {NULL,     NULL,   PREC_NONE}, // [big]
+  [TOKEN_LEFT_BRACE]    = {map_,     NULL,   PREC_NONE}, // [big]
   [TOKEN_RIGHT_BRACE]   = {NULL,     NULL,   PREC_NONE},
   [TOKEN_COMMA]         = {NULL,     NULL,   PREC_NONE},
 /* Compiling Expressions rules < Classes and Instances table-dot
@@ -876,6 +895,7 @@ ParseRule rules[] = {
 */
 //> Classes and Instances table-dot
   [TOKEN_RIGHT_BRACKET] = {NULL,     NULL,   PREC_NONE},
+  [TOKEN_COLON]         = {NULL,     NULL,   PREC_NONE},
   [TOKEN_LEFT_BRACKET]  = {list_,    subscript_, PREC_CALL},
   [TOKEN_DOT]           = {NULL,     dot,    PREC_CALL},
 //< Classes and Instances table-dot
@@ -1085,10 +1105,73 @@ static void function(FunctionType type) {
 }
 //< Calls and Functions compile-function
 //> Methods and Initializers method
+// Reads the value pushed by the code in [start, end) if that code is a
+// lone constant: a literal, or a negated number literal.
+static bool constantItem(int start, int end, Value* value) {
+  Chunk* chunk = currentChunk();
+  uint8_t* code = &chunk->code[start];
+
+  switch (end - start) {
+    case 1:
+      switch (code[0]) {
+        case OP_NIL: *value = NIL_VAL; return true;
+        case OP_TRUE: *value = BOOL_VAL(true); return true;
+        case OP_FALSE: *value = BOOL_VAL(false); return true;
+        default: return false;
+      }
+
+    case 2:
+      if (code[0] != OP_CONSTANT) return false;
+      *value = chunk->constants.values[code[1]];
+      return true;
+
+    case 3: {
+      if (code[0] != OP_CONSTANT || code[2] != OP_NEGATE) return false;
+      Value number = chunk->constants.values[code[1]];
+      if (!IS_NUMBER(number)) return false;
+      *value = NUMBER_VAL(-AS_NUMBER(number));
+      return true;
+    }
+
+    default:
+      return false;
+  }
+}
+
+// If every item of the list literal compiled to a constant, replaces the
+// items' code and constants with one prebuilt template list that
+// OP_CONSTANT_LIST copies.
+static bool constantList(int codeStart, int constantStart,
+                         int* itemStarts, int itemCount) {
+  Chunk* chunk = currentChunk();
+  Value items[UINT8_COUNT];
+  for (int i = 0; i < itemCount; i++) {
+    int end = i + 1 < itemCount ? itemStarts[i + 1] : chunk->count;
+    if (!constantItem(itemStarts[i], end, &items[i])) return false;
+  }
+
+  ObjList* list = newList();
+  push(OBJ_VAL(list));
+  reserveList(list, itemCount);
+  for (int i = 0; i < itemCount; i++) appendToList(list, items[i]);
+
+  // The items' constants were all added while compiling them, and the
+  // template now holds on to them.
+  chunk->count = codeStart;
+  chunk->constants.count = constantStart;
+  emitBytes(OP_CONSTANT_LIST, makeConstant(OBJ_VAL(list)));
+  pop();
+  return true;
+}
+
 static void list_(bool canAssign) {
+    int codeStart = currentChunk()->count;
+    int constantStart = currentChunk()->constants.count;
+    int itemStarts[UINT8_COUNT];
     uint8_t itemCount = 0;
     if (!check(TOKEN_RIGHT_BRACKET)) {
         do {
+            itemStarts[itemCount] = currentChunk()->count;
             expression();
             if (itemCount == 255) {
                 error("Can't have more than 255 items in a list literal.");
@@ -1097,9 +1180,32 @@ static void list_(bool canAssign) {
         } while (match(TOKEN_COMMA));
     }
     consume(TOKEN_RIGHT_BRACKET, "Expect ']' after list items.");
+    if (itemCount > 0 && !parser.hadError &&
+        constantList(codeStart, constantStart, itemStarts, itemCount)) {
+      return;
+    }
     emitBytes(OP_BUILD_LIST, itemCount);
 }
 
+// A '{' in expression position starts a map literal: {key: value, ...}.
+// Statements that begin with '{' are still blocks.
+static void map_(bool canAssign) {
+    int entryCount = 0;
+    if (!check(TOKEN_RIGHT_BRACE)) {
+        do {
+            expression();
+            consume(TOKEN_COLON, "Expect ':' after map key.");
+            expression();
+            if (entryCount == 255) {
+                error("Can't have more than 255 entries in a map literal.");
+            }
+            entryCount++;
+        } while (match(TOKEN_COMMA));
+    }
+    consume(TOKEN_RIGHT_BRACE, "Expect '}' after map entries.");
+    emitBytes(OP_BUILD_MAP, (uint8_t)entryCount);
+}
+
 static void subscript_(bool canAssign) {
     // Index expression
     expression();
@@ -1219,9 +1325,8 @@ static void funDeclaration() {
 }
 //< Calls and Functions fun-declaration
 //> Global Variables var-declaration
-static void varDeclaration() {
-  uint8_t global = parseVariable("Expect variable name.");
-
+// Compiles the rest of a declaration once the name has been parsed.
+static void finishVarDeclaration(uint8_t global) {
   if (match(TOKEN_EQUAL)) {
     expression();
   } else {
@@ -1232,6 +1337,11 @@ static void varDeclaration() {
 
   defineVariable(global);
 }
+
+static void varDeclaration() {
+  uint8_t global = parseVariable("Expect variable name.");
+  finishVarDeclaration(global);
+}
 //< Global Variables var-declaration
 //> Global Variables expression-statement
 static void expressionStatement() {
@@ -1241,6 +1351,46 @@ static void expressionStatement() {
 }
 //< Global Variables expression-statement
 //> Jumping Back and Forth for-statement
+// "ne" is only a keyword after the loop variable, so it stays usable as
+// a name everywhere else.
+static bool checkWord(const char* word) {
+  int length = (int)strlen(word);
+  return parser.current.type == TOKEN_IDENTIFIER &&
+         parser.current.length == length &&
+         memcmp(parser.current.start, word, length) == 0;
+}
+
+// per (shpall x ne lista). The list and the index of the next item live
+// in two hidden locals. OP_FOR_EACH pushes each item as a new local for
+// the body, so closures capture a fresh variable every time around.
+static void forEachLoop(Token name) {
+  advance(); // "ne".
+  expression();
+  consume(TOKEN_RIGHT_PAREN, "Expect ')' after loop list.");
+
+  // The leading space keeps the hidden names from clashing with real ones.
+  uint8_t listSlot = current->localCount;
+  addLocal(syntheticToken(" lista"));
+  markInitialized();
+  emitByte(OP_LIST_ITERATOR);
+  addLocal(syntheticToken(" indeksi"));
+  markInitialized();
+
+  int loopStart = currentChunk()->count;
+  emitBytes(OP_FOR_EACH, listSlot);
+  int exitJump = currentChunk()->count;
+  emitBytes(0xff, 0xff);
+
+  beginScope();
+  addLocal(name);
+  markInitialized();
+  statement();
+  endScope();
+
+  emitLoop(loopStart);
+  patchJump(exitJump);
+}
+
 static void forStatement() {
 //> for-begin-scope
   beginScope();
@@ -1253,7 +1403,14 @@ static void forStatement() {
   if (match(TOKEN_SEMICOLON)) {
     // No initializer.
   } else if (match(TOKEN_VAR)) {
-    varDeclaration();
+    consume(TOKEN_IDENTIFIER, "Expect variable name.");
+    if (checkWord("ne")) {
+      forEachLoop(parser.previous);
+      endScope();
+      return;
+    }
+    declareVariable();
+    finishVarDeclaration(0);
   } else {
     expressionStatement();
   }
@@ -1455,9 +1612,13 @@ static void statement() {
 }
 
 //> Calls and Functions compile-signature
-ObjFunction* compile(const char* source) {
+ObjFunction* compile(const char* source, int length) {
 //< Calls and Functions compile-signature
-  initScanner(source);
+  // Scripts introduce roughly one new identifier or short literal per
+  // 16 bytes of source. Sizing the intern set up front avoids growing
+  // it repeatedly in the middle of compilation.
+  internSetReserve(&vm.strings, length / 16);
+  initScanner(source, length);
 /* Scanning on Demand dump-tokens < Compiling Expressions compile-chunk
   int line = -1;
   for (;;) {
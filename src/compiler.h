@@ -16,7 +16,8 @@ void compile(const char* source);
 bool compile(const char* source, Chunk* chunk);
 */
 //> Calls and Functions compile-h
-ObjFunction* compile(const char* source);
+// The source doesn't need to be NUL-terminated.
+ObjFunction* compile(const char* source, int length);
 //< Calls and Functions compile-h
 //> Garbage Collection mark-compiler-roots-h
 void markCompilerRoots();
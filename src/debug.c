@@ -63,6 +63,13 @@ static int jumpInstruction(const char* name, int sign,
   return offset + 3;
 }
 //< Jumping Back and Forth jump-instruction
+static int forEachInstruction(const char* name, Chunk* chunk, int offset) {
+  uint8_t slot = chunk->code[offset + 1];
+  uint16_t jump = (uint16_t)(chunk->code[offset + 2] << 8);
+  jump |= chunk->code[offset + 3];
+  printf("%-16s %4d -> %d\n", name, slot, offset + 4 + jump);
+  return offset + 4;
+}
 //> disassemble-instruction
 int disassembleInstruction(Chunk* chunk, int offset) {
   printf("%04d ", offset);
@@ -219,6 +226,12 @@ int disassembleInstruction(Chunk* chunk, int offset) {
 //> Methods and Initializers disassemble-method
     case OP_METHOD:
       return constantInstruction("OP_METHOD", chunk, offset);
+    case OP_CONSTANT_LIST:
+      return constantInstruction("OP_CONSTANT_LIST", chunk, offset);
+    case OP_LIST_ITERATOR:
+      return simpleInstruction("OP_LIST_ITERATOR", offset);
+    case OP_FOR_EACH:
+      return forEachInstruction("OP_FOR_EACH", chunk, offset);
 //< Methods and Initializers disassemble-method
     default:
       printf("Unknown opcode %d\n", instruction);
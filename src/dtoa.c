@@ -0,0 +1,346 @@
+#include <math.h>
+#include <string.h>
+
+#include "dtoa.h"
+
+// Grisu2, after Florian Loitsch's "Printing Floating-Point Numbers
+// Quickly and Accurately with Integers". It works on 64-bit integers
+// scaled by a cached power of ten, and its output always reads back as
+// the same double. In rare cases it is a digit longer than the shortest
+// possible.
+
+// A floating-point value f * 2^e with a 64-bit significand.
+typedef struct {
+  uint64_t f;
+  int e;
+} DiyFp;
+
+#define SIGNIFICAND_BITS 52
+#define HIDDEN_BIT ((uint64_t)1 << SIGNIFICAND_BITS)
+#define SIGNIFICAND_MASK (HIDDEN_BIT - 1)
+#define EXPONENT_BIAS (0x3ff + SIGNIFICAND_BITS)
+
+// Normalized 10^k for k = -348, -340, ..., 340.
+static const uint64_t cachedPowerF[] = {
+  0xfa8fd5a0081c0288ull, 0xbaaee17fa23ebf76ull, 0x8b16fb203055ac76ull,
+  0xcf42894a5dce35eaull, 0x9a6bb0aa55653b2dull, 0xe61acf033d1a45dfull,
+  0xab70fe17c79ac6caull, 0xff77b1fcbebcdc4full, 0xbe5691ef416bd60cull,
+  0x8dd01fad907ffc3cull, 0xd3515c2831559a83ull, 0x9d71ac8fada6c9b5ull,
+  0xea9c227723ee8bcbull, 0xaecc49914078536dull, 0x823c12795db6ce57ull,
+  0xc21094364dfb5637ull, 0x9096ea6f3848984full, 0xd77485cb25823ac7ull,
+  0xa086cfcd97bf97f4ull, 0xef340a98172aace5ull, 0xb23867fb2a35b28eull,
+  0x84c8d4dfd2c63f3bull, 0xc5dd44271ad3cdbaull, 0x936b9fcebb25c996ull,
+  0xdbac6c247d62a584ull, 0xa3ab66580d5fdaf6ull, 0xf3e2f893dec3f126ull,
+  0xb5b5ada8aaff80b8ull, 0x87625f056c7c4a8bull, 0xc9bcff6034c13053ull,
+  0x964e858c91ba2655ull, 0xdff9772470297ebdull, 0xa6dfbd9fb8e5b88full,
+  0xf8a95fcf88747d94ull, 0xb94470938fa89bcfull, 0x8a08f0f8bf0f156bull,
+  0xcdb02555653131b6ull, 0x993fe2c6d07b7facull, 0xe45c10c42a2b3b06ull,
+  0xaa242499697392d3ull, 0xfd87b5f28300ca0eull, 0xbce5086492111aebull,
+  0x8cbccc096f5088ccull, 0xd1b71758e219652cull, 0x9c40000000000000ull,
+  0xe8d4a51000000000ull, 0xad78ebc5ac620000ull, 0x813f3978f8940984ull,
+  0xc097ce7bc90715b3ull, 0x8f7e32ce7bea5c70ull, 0xd5d238a4abe98068ull,
+  0x9f4f2726179a2245ull, 0xed63a231d4c4fb27ull, 0xb0de65388cc8ada8ull,
+  0x83c7088e1aab65dbull, 0xc45d1df942711d9aull, 0x924d692ca61be758ull,
+  0xda01ee641a708deaull, 0xa26da3999aef774aull, 0xf209787bb47d6b85ull,
+  0xb454e4a179dd1877ull, 0x865b86925b9bc5c2ull, 0xc83553c5c8965d3dull,
+  0x952ab45cfa97a0b3ull, 0xde469fbd99a05fe3ull, 0xa59bc234db398c25ull,
+  0xf6c69a72a3989f5cull, 0xb7dcbf5354e9beceull, 0x88fcf317f22241e2ull,
+  0xcc20ce9bd35c78a5ull, 0x98165af37b2153dfull, 0xe2a0b5dc971f303aull,
+  0xa8d9d1535ce3b396ull, 0xfb9b7cd9a4a7443cull, 0xbb764c4ca7a44410ull,
+  0x8bab8eefb6409c1aull, 0xd01fef10a657842cull, 0x9b10a4e5e9913129ull,
+  0xe7109bfba19c0c9dull, 0xac2820d9623bf429ull, 0x80444b5e7aa7cf85ull,
+  0xbf21e44003acdd2dull, 0x8e679c2f5e44ff8full, 0xd433179d9c8cb841ull,
+  0x9e19db92b4e31ba9ull, 0xeb96bf6ebadf77d9ull, 0xaf87023b9bf0ee6bull,
+};
+
+static const int16_t cachedPowerE[] = {
+  -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+  -954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+  -688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+  -422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+  -157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+  109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+  375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+  641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+  907, 933, 960, 986, 1013, 1039, 1066,
+};
+
+static DiyFp diyFpFromDouble(double value) {
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  int exponent = (int)((bits >> SIGNIFICAND_BITS) & 0x7ff);
+  uint64_t significand = bits & SIGNIFICAND_MASK;
+
+  DiyFp result;
+  if (exponent != 0) {
+    result.f = significand | HIDDEN_BIT;
+    result.e = exponent - EXPONENT_BIAS;
+  } else {
+    // Subnormal.
+    result.f = significand;
+    result.e = 1 - EXPONENT_BIAS;
+  }
+  return result;
+}
+
+// The upper 64 bits of the product, rounded.
+static DiyFp multiply(DiyFp a, DiyFp b) {
+  DiyFp result;
+#ifdef __SIZEOF_INT128__
+  __uint128_t product = (__uint128_t)a.f * b.f;
+  uint64_t high = (uint64_t)(product >> 64);
+  uint64_t low = (uint64_t)product;
+  if (low & ((uint64_t)1 << 63)) high++;
+  result.f = high;
+#else
+  const uint64_t mask = 0xffffffff;
+  uint64_t a1 = a.f >> 32, a0 = a.f & mask;
+  uint64_t b1 = b.f >> 32, b0 = b.f & mask;
+  uint64_t ac = a1 * b1, bc = a0 * b1, ad = a1 * b0, bd = a0 * b0;
+  uint64_t middle = (bd >> 32) + (ad & mask) + (bc & mask);
+  middle += (uint64_t)1 << 31;
+  result.f = ac + (ad >> 32) + (bc >> 32) + (middle >> 32);
+#endif
+  result.e = a.e + b.e + 64;
+  return result;
+}
+
+static DiyFp normalize(DiyFp value) {
+  while (!(value.f & ((uint64_t)1 << 63))) {
+    value.f <<= 1;
+    value.e--;
+  }
+  return value;
+}
+
+// Finds the midpoints between v and its neighbors, which bound the
+// digits that still read back as v.
+static void boundaries(DiyFp v, DiyFp* minus, DiyFp* plus) {
+  DiyFp upper = {(v.f << 1) + 1, v.e - 1};
+  upper = normalize(upper);
+
+  // The gap below a power of two is half as wide as the one above.
+  DiyFp lower;
+  if (v.f == HIDDEN_BIT) {
+    lower.f = (v.f << 2) - 1;
+    lower.e = v.e - 2;
+  } else {
+    lower.f = (v.f << 1) - 1;
+    lower.e = v.e - 1;
+  }
+  lower.f <<= lower.e - upper.e;
+  lower.e = upper.e;
+
+  *minus = lower;
+  *plus = upper;
+}
+
+// Picks a cached power c = 10^-k that brings the binary exponent e into
+// [-60, -32] after multiplying.
+static DiyFp cachedPower(int e, int* k) {
+  double dk = (-61 - e) * 0.30102999566398114 + 347;
+  int estimate = (int)dk;
+  if (dk - estimate > 0.0) estimate++;
+
+  int index = (estimate >> 3) + 1;
+  *k = -(-348 + index * 8);
+
+  DiyFp result = {cachedPowerF[index], cachedPowerE[index]};
+  return result;
+}
+
+// Nudges the last digit down while that moves closer to the exact
+// value and stays inside the rounding interval.
+static void roundWeed(char* buffer, int length, uint64_t delta,
+                      uint64_t rest, uint64_t tenKappa, uint64_t distance) {
+  while (rest < distance && delta - rest >= tenKappa &&
+         (rest + tenKappa < distance ||
+          distance - rest > rest + tenKappa - distance)) {
+    buffer[length - 1]--;
+    rest += tenKappa;
+  }
+}
+
+static const uint32_t pow10u32[] = {
+  1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000,
+  1000000000,
+};
+
+static int countDigits(uint32_t n) {
+  int digits = 1;
+  while (digits < 10 && n >= pow10u32[digits]) digits++;
+  return digits;
+}
+
+// Generates digits of the scaled upper bound until the rest falls
+// inside the interval of width delta.
+static void generateDigits(DiyFp w, DiyFp upper, uint64_t delta,
+                           char* buffer, int* length, int* k) {
+  int shift = -upper.e;
+  uint64_t one = (uint64_t)1 << shift;
+  uint64_t distance = upper.f - w.f;
+  uint32_t integral = (uint32_t)(upper.f >> shift);
+  uint64_t fraction = upper.f & (one - 1);
+
+  int kappa = countDigits(integral);
+  *length = 0;
+  while (kappa > 0) {
+    uint32_t divisor = pow10u32[kappa - 1];
+    uint32_t digit = integral / divisor;
+    integral %= divisor;
+    if (digit != 0 || *length != 0) buffer[(*length)++] = (char)('0' + digit);
+    kappa--;
+
+    uint64_t rest = ((uint64_t)integral << shift) + fraction;
+    if (rest <= delta) {
+      *k += kappa;
+      roundWeed(buffer, *length, delta, rest,
+                (uint64_t)pow10u32[kappa] << shift, distance);
+      return;
+    }
+  }
+
+  for (;;) {
+    fraction *= 10;
+    delta *= 10;
+    char digit = (char)(fraction >> shift);
+    if (digit != 0 || *length != 0) buffer[(*length)++] = (char)('0' + digit);
+    fraction &= one - 1;
+    kappa--;
+    if (fraction < delta) {
+      *k += kappa;
+      // distance is scaled along with the digits, as far as 64 bits go.
+      uint64_t scale = 0;
+      if (-kappa < 20) {
+        scale = 1;
+        for (int i = 0; i < -kappa; i++) scale *= 10;
+      }
+      roundWeed(buffer, *length, delta, fraction, one, distance * scale);
+      return;
+    }
+  }
+}
+
+// Writes the digits of a positive, finite value. The value is
+// digits * 10^k.
+static int grisu2(double value, char* digits, int* k) {
+  DiyFp v = diyFpFromDouble(value);
+  DiyFp minus;
+  DiyFp plus;
+  boundaries(v, &minus, &plus);
+
+  DiyFp power = cachedPower(plus.e, k);
+  DiyFp w = multiply(normalize(v), power);
+  DiyFp upper = multiply(plus, power);
+  DiyFp lower = multiply(minus, power);
+  // Shrink the interval by an ulp on each side to cover rounding in the
+  // multiplications.
+  upper.f--;
+  lower.f++;
+
+  int length;
+  generateDigits(w, upper, upper.f - lower.f, digits, &length, k);
+  return length;
+}
+
+static int writeExponent(int exponent, char* buffer) {
+  char* start = buffer;
+  *buffer++ = 'e';
+  if (exponent < 0) {
+    *buffer++ = '-';
+    exponent = -exponent;
+  } else {
+    *buffer++ = '+';
+  }
+
+  if (exponent >= 100) {
+    *buffer++ = (char)('0' + exponent / 100);
+    exponent %= 100;
+    *buffer++ = (char)('0' + exponent / 10);
+  } else if (exponent >= 10) {
+    *buffer++ = (char)('0' + exponent / 10);
+  }
+  *buffer++ = (char)('0' + exponent % 10);
+  return (int)(buffer - start);
+}
+
+// Lays out digits * 10^k. point is where the decimal point falls
+// relative to the first digit.
+static int layOut(const char* digits, int length, int k, char* buffer) {
+  int point = length + k;
+
+  if (length <= point && point <= 21) {
+    // An integer: the digits followed by zeros.
+    memcpy(buffer, digits, length);
+    memset(buffer + length, '0', point - length);
+    return point;
+  }
+
+  if (0 < point && point <= 21) {
+    memcpy(buffer, digits, point);
+    buffer[point] = '.';
+    memcpy(buffer + point + 1, digits + point, length - point);
+    return length + 1;
+  }
+
+  if (-6 < point && point <= 0) {
+    int zeros = -point;
+    buffer[0] = '0';
+    buffer[1] = '.';
+    memset(buffer + 2, '0', zeros);
+    memcpy(buffer + 2 + zeros, digits, length);
+    return 2 + zeros + length;
+  }
+
+  buffer[0] = digits[0];
+  int written = 1;
+  if (length > 1) {
+    buffer[1] = '.';
+    memcpy(buffer + 2, digits + 1, length - 1);
+    written = length + 1;
+  }
+  return written + writeExponent(point - 1, buffer + written);
+}
+
+// Doubles represent every integer below this exactly.
+#define MAX_EXACT_INTEGER 9007199254740992.0
+
+int formatNumber(double value, char* buffer) {
+  if (isnan(value)) {
+    memcpy(buffer, "nan", 4);
+    return 3;
+  }
+
+  char* start = buffer;
+  if (signbit(value)) {
+    *buffer++ = '-';
+    value = -value;
+  }
+
+  if (isinf(value)) {
+    memcpy(buffer, "inf", 4);
+    return (int)(buffer - start) + 3;
+  }
+
+  int length;
+  if (value < MAX_EXACT_INTEGER && value == (double)(uint64_t)value) {
+    // Integers are common and need no search for the shortest digits.
+    char digits[NUMBER_BUFFER_SIZE];
+    uint64_t integer = (uint64_t)value;
+    int count = 0;
+    do {
+      digits[sizeof(digits) - 1 - count++] = (char)('0' + integer % 10);
+      integer /= 10;
+    } while (integer != 0);
+    memcpy(buffer, digits + sizeof(digits) - count, count);
+    length = count;
+  } else {
+    char digits[NUMBER_BUFFER_SIZE];
+    int k;
+    int count = grisu2(value, digits, &k);
+    length = layOut(digits, count, k, buffer);
+  }
+
+  buffer[length] = '\0';
+  return (int)(buffer - start) + length;
+}
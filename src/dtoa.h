@@ -0,0 +1,14 @@
+#ifndef clox_dtoa_h
+#define clox_dtoa_h
+
+#include "common.h"
+
+// Enough for any formatted double plus a terminating NUL.
+#define NUMBER_BUFFER_SIZE 32
+
+// Writes the shortest digits that read back as exactly [value], laid out
+// like JavaScript numbers: plain notation for exponents from -7 to 20,
+// scientific notation outside that. Returns the length.
+int formatNumber(double value, char* buffer);
+
+#endif
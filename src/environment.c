@@ -2,6 +2,7 @@
 #include <string.h>
 #include <stdint.h>
 #include "environment.h"
+#include "hash.h"
 
 void init_environment(Environment* env) {
     env->count = 0;
@@ -18,12 +19,7 @@ void free_environment(Environment* env) {
 // The core lookup function. Finds where a key should be in the table.
 static Entry* find_entry(Entry* entries, int capacity, Token key) {
     if (capacity == 0) return NULL;
-    // Use the FNV-1a hashing algorithm to get an index
-    uint32_t hash = 2166136261u;
-    for (int i = 0; i < key.length; i++) {
-        hash ^= (uint8_t)key.start[i];
-        hash *= 16777619;
-    }
+    uint32_t hash = hashBytes(key.start, key.length);
     uint32_t index = hash % capacity;
 
     for (;;) {
@@ -0,0 +1,436 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <io.h>
+#define open _open
+#define close _close
+#else
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+#ifndef SOCK_CLOEXEC
+#define SOCK_CLOEXEC 0
+#endif
+
+#include "dtoa.h"
+#include "file.h"
+#include "loop.h"
+#include "memory.h"
+#include "vm.h"
+
+// Shorter strings are copied into the write buffer.
+#define FILE_COPY_MAX 1024
+
+#ifndef _WIN32
+// Every block mapFile() made that is still mapped, so that opening its
+// file for writing can detach it first. Truncating a file under a
+// mapping makes touching the lost pages a bus error.
+typedef struct {
+  char* chars;
+  int length;
+  dev_t device;
+  ino_t inode;
+} MappedBlock;
+
+static THREAD_LOCAL MappedBlock* mappedBlocks = NULL;
+static THREAD_LOCAL int mappedCount = 0;
+static THREAD_LOCAL int mappedCapacity = 0;
+
+static bool addMappedBlock(char* chars, int length, struct stat* info) {
+  if (mappedCount == mappedCapacity) {
+    int capacity = mappedCapacity < 8 ? 8 : mappedCapacity * 2;
+    MappedBlock* blocks = (MappedBlock*)realloc(
+        mappedBlocks, sizeof(MappedBlock) * capacity);
+    if (blocks == NULL) return false;
+    mappedBlocks = blocks;
+    mappedCapacity = capacity;
+  }
+
+  MappedBlock* block = &mappedBlocks[mappedCount++];
+  block->chars = chars;
+  block->length = length;
+  block->device = info->st_dev;
+  block->inode = info->st_ino;
+  return true;
+}
+
+static void removeMappedBlock(int index) {
+  mappedBlocks[index] = mappedBlocks[--mappedCount];
+}
+
+// Replaces the mapping with private memory holding the same bytes, at
+// the same address since slices point straight into it. The block
+// stays mapped as far as freeing it goes.
+static bool detachBlock(MappedBlock* block) {
+  char* copy = (char*)malloc(block->length);
+  if (copy == NULL) return false;
+  memcpy(copy, block->chars, block->length);
+
+  void* chars = mmap(block->chars, block->length, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+  if (chars != MAP_FAILED) {
+    memcpy(block->chars, copy, block->length);
+    mprotect(block->chars, block->length, PROT_READ);
+  }
+  free(copy);
+  return chars != MAP_FAILED;
+}
+
+// Detaches every block mapped from the file at name before it is
+// truncated. Returns false if one can't be.
+static bool detachMappedBlocks(const char* name) {
+  struct stat info;
+  if (mappedCount == 0 || stat(name, &info) != 0) return true;
+
+  for (int i = mappedCount - 1; i >= 0; i--) {
+    MappedBlock* block = &mappedBlocks[i];
+    if (block->device != info.st_dev || block->inode != info.st_ino) {
+      continue;
+    }
+    if (!detachBlock(block)) return false;
+    removeMappedBlock(i);
+  }
+  return true;
+}
+
+// Maps the whole file as the reader's only block. Returns false if the
+// file should be read normally instead.
+static bool mapFile(ObjFile* file, int fd) {
+  struct stat info;
+  if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) return false;
+  if (info.st_size < FILE_MAP_MIN || info.st_size > INT_MAX) return false;
+
+  int length = (int)info.st_size;
+  char* chars = (char*)mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (chars == MAP_FAILED) return false;
+  if (!addMappedBlock(chars, length, &info)) {
+    munmap(chars, length);
+    return false;
+  }
+  madvise(chars, length, MADV_SEQUENTIAL);
+  close(fd);
+
+  ObjString* block = takeTransientString(chars, length);
+  block->isMapped = true;
+  file->input.block = block;
+  file->input.end = length;
+  return true;
+}
+#endif
+
+// Returns the path as a C string for the caller to free, or NULL.
+static char* copyPath(Value path) {
+  char buffer[SHORT_STRING_MAX];
+  int length;
+  const char* chars = stringValueChars(path, buffer, &length);
+
+  // The characters of a slice aren't NUL-terminated.
+  char* name = (char*)malloc(length + 1);
+  if (name == NULL) return NULL;
+  memcpy(name, chars, length);
+  name[length] = '\0';
+  return name;
+}
+
+static ObjFile* addOpenFile(Value path) {
+  push(OBJ_VAL(materializeString(path)));
+  ObjFile* file = newFile(AS_STRING(vm.stackTop[-1]));
+  pop();
+  file->next = vm.openFiles;
+  vm.openFiles = file;
+  return file;
+}
+
+ObjFile* openFile(Value path, FileMode mode) {
+  char* name = copyPath(path);
+  if (name == NULL) return NULL;
+
+  int flags = O_BINARY | O_CLOEXEC;
+  if (mode == FILE_READ) {
+    flags |= O_RDONLY;
+  } else {
+    flags |= O_WRONLY | O_CREAT;
+    flags |= mode == FILE_APPEND ? O_APPEND : O_TRUNC;
+  }
+#ifndef _WIN32
+  if (mode == FILE_WRITE && !detachMappedBlocks(name)) {
+    free(name);
+    return NULL;
+  }
+#endif
+  int fd = open(name, flags, 0666);
+  free(name);
+  if (fd < 0) return NULL;
+
+  ObjFile* file = addOpenFile(path);
+  if (mode != FILE_READ) {
+    file->isReadable = false;
+    file->isWritable = true;
+    file->input.fd = fd;
+    return file;
+  }
+
+#ifndef _WIN32
+  if (mapFile(file, fd)) return file;
+#endif
+  initInput(&file->input, fd);
+  return file;
+}
+
+#ifndef _WIN32
+static bool socketAddress(Value path, struct sockaddr_un* address) {
+  char* name = copyPath(path);
+  if (name == NULL) return false;
+
+  bool fits = strlen(name) < sizeof(address->sun_path);
+  if (fits) {
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    strcpy(address->sun_path, name);
+  }
+  free(name);
+  return fits;
+}
+
+static ObjFile* addSocket(Value path, int fd, bool isListening) {
+  // A peer that goes away shows up as a failed write instead of
+  // killing the process.
+  signal(SIGPIPE, SIG_IGN);
+
+  ObjFile* file = addOpenFile(path);
+  initInput(&file->input, fd);
+  file->isReadable = !isListening;
+  file->isWritable = !isListening;
+  file->isListening = isListening;
+  return file;
+}
+#endif
+
+ObjFile* connectSocket(Value path) {
+#ifdef _WIN32
+  return NULL;
+#else
+  struct sockaddr_un address;
+  if (!socketAddress(path, &address)) return NULL;
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) return NULL;
+  if (connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+    close(fd);
+    return NULL;
+  }
+  return addSocket(path, fd, false);
+#endif
+}
+
+ObjFile* listenSocket(Value path) {
+#ifdef _WIN32
+  return NULL;
+#else
+  struct sockaddr_un address;
+  if (!socketAddress(path, &address)) return NULL;
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) return NULL;
+
+  // A socket file left behind by an earlier run is replaced.
+  unlink(address.sun_path);
+  if (bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+      listen(fd, SOMAXCONN) != 0) {
+    close(fd);
+    return NULL;
+  }
+  return addSocket(path, fd, true);
+#endif
+}
+
+ObjFile* acceptSocket(ObjFile* listener) {
+#ifdef _WIN32
+  return NULL;
+#else
+  int fd;
+  do {
+    fd = accept(listener->input.fd, NULL, NULL);
+  } while (fd < 0 && errno == EINTR);
+  if (fd < 0) return NULL;
+  return addSocket(OBJ_VAL(listener->path), fd, false);
+#endif
+}
+
+#ifdef _WIN32
+static bool writeAll(int fd, const char* chars, size_t length) {
+  while (length > 0) {
+    int written = _write(fd, chars, (unsigned int)length);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    chars += written;
+    length -= written;
+  }
+  return true;
+}
+#endif
+
+// Writes the pending pieces with as few system calls as possible.
+static bool writePieces(ObjFile* file) {
+#ifdef _WIN32
+  for (int i = 0; i < file->pieceCount; i++) {
+    if (!writeAll(file->input.fd, file->pieceChars[i],
+                  file->pieceLengths[i])) {
+      return false;
+    }
+  }
+  return true;
+#else
+  struct iovec pieces[FILE_MAX_PIECES];
+  for (int i = 0; i < file->pieceCount; i++) {
+    pieces[i].iov_base = (void*)file->pieceChars[i];
+    pieces[i].iov_len = file->pieceLengths[i];
+  }
+
+  struct iovec* next = pieces;
+  int count = file->pieceCount;
+  while (count > 0) {
+    ssize_t written = writev(file->input.fd, next, count);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+
+    // Skip what went out. A short write can stop partway into a piece.
+    while (count > 0 && (size_t)written >= next->iov_len) {
+      written -= next->iov_len;
+      next++;
+      count--;
+    }
+    if (count > 0) {
+      next->iov_base = (char*)next->iov_base + written;
+      next->iov_len -= written;
+    }
+  }
+  return true;
+#endif
+}
+
+bool flushFile(ObjFile* file) {
+  bool succeeded = writePieces(file);
+  file->bufferLength = 0;
+  file->pieceCount = 0;
+  file->lastPieceBuffered = false;
+  file->pending.count = 0;
+  return succeeded;
+}
+
+static bool copyIntoBuffer(ObjFile* file, const char* chars, int length) {
+  if (file->buffer == NULL) {
+    file->buffer = ALLOCATE(char, FILE_BUFFER_SIZE);
+  }
+  if (file->pieceCount == FILE_MAX_PIECES ||
+      file->bufferLength + length > FILE_BUFFER_SIZE) {
+    if (!flushFile(file)) return false;
+  }
+
+  char* dest = file->buffer + file->bufferLength;
+  memcpy(dest, chars, length);
+  file->bufferLength += length;
+
+  // Back-to-back copies share a piece.
+  if (file->lastPieceBuffered) {
+    file->pieceLengths[file->pieceCount - 1] += length;
+  } else {
+    file->pieceChars[file->pieceCount] = dest;
+    file->pieceLengths[file->pieceCount] = length;
+    file->pieceCount++;
+    file->lastPieceBuffered = true;
+  }
+  return true;
+}
+
+bool writeFile(ObjFile* file, Value value) {
+  if (IS_NUMBER(value)) {
+    char chars[NUMBER_BUFFER_SIZE];
+    int length = formatNumber(AS_NUMBER(value), chars);
+    return copyIntoBuffer(file, chars, length);
+  }
+
+  if (IS_SHORT_STRING(value)) {
+    char chars[SHORT_STRING_MAX];
+    int length = unpackShortString(value, chars);
+    return copyIntoBuffer(file, chars, length);
+  }
+
+  ObjString* string = AS_STRING(value);
+  flattenString(string);
+  if (string->length < FILE_COPY_MAX) {
+    return copyIntoBuffer(file, string->chars, string->length);
+  }
+
+  if (file->pieceCount == FILE_MAX_PIECES && !flushFile(file)) {
+    return false;
+  }
+  writeValueArray(&file->pending, value);
+  file->pieceChars[file->pieceCount] = string->chars;
+  file->pieceLengths[file->pieceCount] = string->length;
+  file->pieceCount++;
+  file->lastPieceBuffered = false;
+  return true;
+}
+
+bool closeFile(ObjFile* file) {
+  cancelFileWait(file);
+
+  bool succeeded = true;
+  if (file->isWritable) succeeded = flushFile(file);
+  if (file->input.fd >= 0 && close(file->input.fd) != 0) {
+    succeeded = false;
+  }
+
+  file->isOpen = false;
+  file->input.fd = -1;
+  file->input.atEof = true;
+  file->input.start = file->input.end;
+  if (file->buffer != NULL) {
+    FREE_ARRAY(char, file->buffer, FILE_BUFFER_SIZE);
+    file->buffer = NULL;
+  }
+  freeValueArray(&file->pending);
+
+  ObjFile** link = &vm.openFiles;
+  while (*link != file) link = &(*link)->next;
+  *link = file->next;
+  file->next = NULL;
+  return succeeded;
+}
+
+void closeAllFiles() {
+  while (vm.openFiles != NULL) closeFile(vm.openFiles);
+}
+
+void unmapChars(char* chars, int length) {
+#ifndef _WIN32
+  for (int i = 0; i < mappedCount; i++) {
+    if (mappedBlocks[i].chars == chars) {
+      removeMappedBlock(i);
+      break;
+    }
+  }
+  munmap(chars, length);
+#endif
+}
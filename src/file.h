@@ -0,0 +1,35 @@
+#ifndef clox_file_h
+#define clox_file_h
+
+#include "common.h"
+#include "object.h"
+#include "value.h"
+
+// Regular files at least this big are mapped instead of read.
+#define FILE_MAP_MIN (64 * 1024)
+#define FILE_BUFFER_SIZE (64 * 1024)
+
+typedef enum {
+  FILE_READ,
+  FILE_WRITE,
+  FILE_APPEND
+} FileMode;
+
+// Returns NULL if the file can't be opened. Open files are GC roots
+// until they are closed.
+ObjFile* openFile(Value path, FileMode mode);
+// Unix domain stream sockets, open for both reading and writing. These
+// also return NULL on failure.
+ObjFile* connectSocket(Value path);
+// The socket file is replaced if it already exists.
+ObjFile* listenSocket(Value path);
+// Blocks until a connection comes in, unless one is already waiting.
+ObjFile* acceptSocket(ObjFile* listener);
+// Writes a string or a number. Returns false if the write fails.
+bool writeFile(ObjFile* file, Value value);
+bool flushFile(ObjFile* file);
+bool closeFile(ObjFile* file);
+void closeAllFiles();
+void unmapChars(char* chars, int length);
+
+#endif
@@ -0,0 +1,114 @@
+#include <string.h>
+
+#include "hash.h"
+
+// A wyhash-style hash. It consumes the input eight bytes at a time with
+// unaligned loads and folds each pair of words with a single 64x64->128
+// bit multiply, instead of FNV-1a's multiply per byte. Short keys and the
+// tail of long ones are covered by overlapping loads, so there is never a
+// per-byte loop.
+
+static const uint64_t secret[4] = {
+  0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull,
+  0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull,
+};
+
+static inline void multiply(uint64_t* a, uint64_t* b) {
+#ifdef __SIZEOF_INT128__
+  __uint128_t product = (__uint128_t)*a * *b;
+  *a = (uint64_t)product;
+  *b = (uint64_t)(product >> 64);
+#else
+  uint64_t ha = *a >> 32, hb = *b >> 32;
+  uint64_t la = (uint32_t)*a, lb = (uint32_t)*b;
+  uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+  uint64_t t = rl + (rm0 << 32);
+  uint64_t carry = t < rl;
+  uint64_t lo = t + (rm1 << 32);
+  carry += lo < t;
+  uint64_t hi = rh + (rm0 >> 32) + (rm1 >> 32) + carry;
+  *a = lo;
+  *b = hi;
+#endif
+}
+
+static inline uint64_t mix(uint64_t a, uint64_t b) {
+  multiply(&a, &b);
+  return a ^ b;
+}
+
+static inline uint64_t read64(const uint8_t* p) {
+  uint64_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+static inline uint64_t read32(const uint8_t* p) {
+  uint32_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+// Reads one to three bytes as a single word.
+static inline uint64_t read3(const uint8_t* p, size_t length) {
+  return ((uint64_t)p[0] << 16) | ((uint64_t)p[length >> 1] << 8) |
+         p[length - 1];
+}
+
+uint32_t hashBytes(const char* key, int length) {
+  const uint8_t* p = (const uint8_t*)key;
+  size_t remaining = (size_t)length;
+  uint64_t seed = mix(secret[0], secret[1]);
+  uint64_t a, b;
+
+  if (remaining <= 16) {
+    if (remaining >= 4) {
+      size_t step = (remaining >> 3) << 2;
+      a = (read32(p) << 32) | read32(p + step);
+      b = (read32(p + remaining - 4) << 32) |
+          read32(p + remaining - 4 - step);
+    } else if (remaining > 0) {
+      a = read3(p, remaining);
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    if (remaining > 48) {
+      // Three independent lanes keep the multiplier busy.
+      uint64_t lane1 = seed, lane2 = seed;
+      do {
+        seed = mix(read64(p) ^ secret[1], read64(p + 8) ^ seed);
+        lane1 = mix(read64(p + 16) ^ secret[2], read64(p + 24) ^ lane1);
+        lane2 = mix(read64(p + 32) ^ secret[3], read64(p + 40) ^ lane2);
+        p += 48;
+        remaining -= 48;
+      } while (remaining > 48);
+      seed ^= lane1 ^ lane2;
+    }
+
+    while (remaining > 16) {
+      seed = mix(read64(p) ^ secret[1], read64(p + 8) ^ seed);
+      p += 16;
+      remaining -= 16;
+    }
+
+    // The last 16 bytes, overlapping what was already consumed.
+    a = read64(p + remaining - 16);
+    b = read64(p + remaining - 8);
+  }
+
+  a ^= secret[1];
+  b ^= seed;
+  multiply(&a, &b);
+  uint64_t hash = mix(a ^ secret[0] ^ (uint64_t)length, b ^ secret[1]);
+  return (uint32_t)(hash ^ (hash >> 32));
+}
+
+uint32_t hashBits(uint64_t bits) {
+  uint64_t a = bits ^ secret[0];
+  uint64_t b = secret[1];
+  multiply(&a, &b);
+  uint64_t hash = a ^ b;
+  return (uint32_t)(hash ^ (hash >> 32));
+}
@@ -0,0 +1,12 @@
+#ifndef clox_hash_h
+#define clox_hash_h
+
+#include "common.h"
+
+// The one string hash used by the intern table, Table lookups and the
+// tree-walking interpreter's environments.
+uint32_t hashBytes(const char* key, int length);
+// Scrambles a 64-bit word, such as a Value's bits, into a 32-bit hash.
+uint32_t hashBits(uint64_t bits);
+
+#endif
@@ -0,0 +1,172 @@
+#include <limits.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "input.h"
+#include "memory.h"
+#include "object.h"
+#include "output.h"
+#include "vm.h"
+
+void initInput(InputBuffer* input, int fd) {
+  input->fd = fd;
+  input->block = NULL;
+  input->start = 0;
+  input->end = 0;
+  input->atEof = fd < 0;
+}
+
+static int readFd(int fd, char* buffer, int count) {
+#ifdef _WIN32
+  return _read(fd, buffer, (unsigned int)count);
+#else
+  for (;;) {
+    ssize_t bytesRead = read(fd, buffer, (size_t)count);
+    if (bytesRead >= 0 || errno != EINTR) return (int)bytesRead;
+  }
+#endif
+}
+
+// Starts a new block holding the unread bytes of the current one. The
+// old block can't be reused since earlier lines may still point into it.
+// The input must be reachable by the GC.
+static void startBlock(InputBuffer* input) {
+  int pending = input->end - input->start;
+  int capacity = INPUT_BLOCK_SIZE;
+  if (pending > capacity / 2) capacity = pending * 2;
+
+  char* chars = ALLOCATE(char, capacity + 1);
+  chars[capacity] = '\0';
+  ObjString* block = takeTransientString(chars, capacity);
+  if (pending > 0) {
+    memcpy(chars, input->block->chars + input->start, pending);
+  }
+
+  input->block = block;
+  input->start = 0;
+  input->end = pending;
+}
+
+bool fillInput(InputBuffer* input) {
+  if (input->atEof) return false;
+
+  // Show any prompt before blocking on the user.
+  if (input->fd == 0) flushOutput();
+
+  if (input->block == NULL || input->end == input->block->length) {
+    startBlock(input);
+  }
+
+  int bytesRead = readFd(input->fd, input->block->chars + input->end,
+                         input->block->length - input->end);
+  if (bytesRead <= 0) {
+    input->atEof = true;
+    return false;
+  }
+
+  input->end += bytesRead;
+  return true;
+}
+
+bool hasInputLine(InputBuffer* input) {
+  if (input->atEof) return true;
+  if (input->block == NULL) return false;
+  return memchr(input->block->chars + input->start, '\n',
+                input->end - input->start) != NULL;
+}
+
+bool readInputLine(InputBuffer* input, Value* line) {
+  int scanned = input->start;
+
+  for (;;) {
+    if (input->block != NULL) {
+      char* chars = input->block->chars;
+      char* newline = (char*)memchr(chars + scanned, '\n',
+                                    input->end - scanned);
+      if (newline != NULL) {
+        int lineEnd = (int)(newline - chars);
+        *line = sliceBuffer(input->block, input->start, lineEnd);
+        input->start = lineEnd + 1;
+        return true;
+      }
+    }
+
+    int pending = input->end - input->start;
+    if (!fillInput(input)) {
+      if (pending == 0) return false;
+
+      // The last line has no newline.
+      *line = sliceBuffer(input->block, input->start, input->end);
+      input->start = input->end;
+      return true;
+    }
+    scanned = input->start + pending;
+  }
+}
+
+bool readAllInput(InputBuffer* input, Value* text) {
+  size_t length = input->end - input->start;
+
+  // Everything is already in the block, as with a mapped file.
+  if (input->atEof) {
+    if (length == 0) {
+      *text = copyStringValue("", 0);
+    } else {
+      *text = sliceBuffer(input->block, input->start, input->end);
+      input->start = input->end;
+    }
+    return true;
+  }
+
+  size_t capacity = length + INPUT_BLOCK_SIZE;
+#ifndef _WIN32
+  // When reading a regular file we know how much is left and can read
+  // it in one go.
+  struct stat info;
+  if (fstat(input->fd, &info) == 0 && S_ISREG(info.st_mode)) {
+    off_t offset = lseek(input->fd, 0, SEEK_CUR);
+    if (offset >= 0 && info.st_size > offset) {
+      capacity = length + (size_t)(info.st_size - offset) + 1;
+    }
+  }
+#endif
+  if (capacity > INT_MAX) return false;
+
+  char* chars = ALLOCATE(char, capacity);
+  if (length > 0) {
+    memcpy(chars, input->block->chars + input->start, length);
+  }
+  input->start = input->end;
+
+  if (input->fd == 0) flushOutput();
+  while (!input->atEof) {
+    if (length + 1 == capacity) {
+      if (capacity * 2 > INT_MAX) {
+        FREE_ARRAY(char, chars, capacity);
+        return false;
+      }
+      chars = GROW_ARRAY(char, chars, capacity, capacity * 2);
+      capacity *= 2;
+    }
+
+    int bytesRead = readFd(input->fd, chars + length,
+                           (int)(capacity - 1 - length));
+    if (bytesRead <= 0) {
+      input->atEof = true;
+    } else {
+      length += bytesRead;
+    }
+  }
+
+  chars = GROW_ARRAY(char, chars, capacity, length + 1);
+  chars[length] = '\0';
+  *text = takeStringValue(chars, (int)length);
+  return true;
+}
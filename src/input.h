@@ -0,0 +1,36 @@
+#ifndef clox_input_h
+#define clox_input_h
+
+#include "common.h"
+#include "value.h"
+
+#define INPUT_BLOCK_SIZE (64 * 1024)
+
+// Stdin and files are read in large blocks. Each block is a string object and the
+// lines handed out are slices of it, so reading a line usually copies
+// nothing. A line that runs past the end of a block is carried over to
+// the start of the next one.
+typedef struct {
+  // -1 once there is nothing more to read.
+  int fd;
+  ObjString* block;
+  // The unread bytes are block->chars[start..end).
+  int start;
+  int end;
+  bool atEof;
+} InputBuffer;
+
+void initInput(InputBuffer* input, int fd);
+// Reads more input onto the end of the unread bytes, with a single
+// read(). Returns false at the end of the input.
+bool fillInput(InputBuffer* input);
+// Whether readInputLine() can return without reading any more.
+bool hasInputLine(InputBuffer* input);
+// Reads the next line without its newline. Returns false at the end of
+// the input.
+bool readInputLine(InputBuffer* input, Value* line);
+// Reads everything left into one string. Returns false if it does not
+// fit in a string.
+bool readAllInput(InputBuffer* input, Value* text);
+
+#endif
@@ -0,0 +1,111 @@
+#include <string.h>
+
+#include "intern.h"
+#include "memory.h"
+
+#define INTERN_MAX_LOAD 0.75
+#define INTERN_MIN_CAPACITY 64
+
+// A tombstone has no string but a nonzero length, so probes keep going
+// past it. Every empty entry is zeroed.
+#define TOMBSTONE_LENGTH -1
+
+void initInternSet(InternSet* set) {
+  set->count = 0;
+  set->capacity = 0;
+  set->entries = NULL;
+}
+
+void freeInternSet(InternSet* set) {
+  FREE_ARRAY(InternEntry, set->entries, set->capacity);
+  initInternSet(set);
+}
+
+static void adjustCapacity(InternSet* set, int capacity) {
+  InternEntry* entries = ALLOCATE(InternEntry, capacity);
+  memset(entries, 0, sizeof(InternEntry) * capacity);
+
+  // Rehashing drops the tombstones.
+  set->count = 0;
+  for (int i = 0; i < set->capacity; i++) {
+    InternEntry* entry = &set->entries[i];
+    if (entry->string == NULL) continue;
+
+    uint32_t index = entry->hash & (capacity - 1);
+    while (entries[index].string != NULL) {
+      index = (index + 1) & (capacity - 1);
+    }
+    entries[index] = *entry;
+    set->count++;
+  }
+
+  FREE_ARRAY(InternEntry, set->entries, set->capacity);
+  set->entries = entries;
+  set->capacity = capacity;
+}
+
+// Grows the set so [count] more strings fit without a resize. The
+// compiler calls this before compiling a script, which saves the
+// rehashing that would otherwise happen while identifiers pile in.
+void internSetReserve(InternSet* set, int count) {
+  int needed = set->count + count;
+  if (needed <= set->capacity * INTERN_MAX_LOAD) return;
+
+  int capacity = set->capacity < INTERN_MIN_CAPACITY
+      ? INTERN_MIN_CAPACITY : set->capacity;
+  while (needed > capacity * INTERN_MAX_LOAD) capacity *= 2;
+  adjustCapacity(set, capacity);
+}
+
+ObjString* internSetFind(InternSet* set, const char* chars, int length,
+                         uint32_t hash) {
+  if (set->count == 0) return NULL;
+
+  uint32_t index = hash & (set->capacity - 1);
+  for (;;) {
+    InternEntry* entry = &set->entries[index];
+    if (entry->hash == hash && entry->length == length &&
+        entry->string != NULL &&
+        memcmp(entry->string->chars, chars, length) == 0) {
+      return entry->string;
+    }
+    if (entry->string == NULL && entry->length == 0) return NULL;
+
+    index = (index + 1) & (set->capacity - 1);
+  }
+}
+
+// [string] must have its hash and must not already be in the set.
+void internSetAdd(InternSet* set, ObjString* string) {
+  if (set->count + 1 > set->capacity * INTERN_MAX_LOAD) {
+    internSetReserve(set, 1);
+  }
+
+  uint32_t index = string->hash & (set->capacity - 1);
+  for (;;) {
+    InternEntry* entry = &set->entries[index];
+    if (entry->string == NULL) {
+      // Reusing a tombstone doesn't change the count.
+      if (entry->length == 0) set->count++;
+      entry->string = string;
+      entry->hash = string->hash;
+      entry->length = string->length;
+      return;
+    }
+
+    index = (index + 1) & (set->capacity - 1);
+  }
+}
+
+// The set holds its strings weakly. This runs after marking and before
+// the sweep frees the unreachable strings.
+void internSetRemoveWhite(InternSet* set) {
+  for (int i = 0; i < set->capacity; i++) {
+    InternEntry* entry = &set->entries[i];
+    if (entry->string != NULL && !entry->string->obj.isMarked) {
+      entry->string = NULL;
+      entry->hash = 0;
+      entry->length = TOMBSTONE_LENGTH;
+    }
+  }
+}
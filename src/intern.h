@@ -0,0 +1,31 @@
+#ifndef clox_intern_h
+#define clox_intern_h
+
+#include "common.h"
+#include "object.h"
+
+// The set of canonical strings behind vm.strings. Each entry keeps the
+// string's hash and length beside the pointer, so probing only touches
+// the entry array and the characters of real candidates.
+typedef struct {
+  ObjString* string;
+  uint32_t hash;
+  int length;
+} InternEntry;
+
+typedef struct {
+  // Live entries plus tombstones.
+  int count;
+  int capacity;
+  InternEntry* entries;
+} InternSet;
+
+void initInternSet(InternSet* set);
+void freeInternSet(InternSet* set);
+void internSetReserve(InternSet* set, int count);
+ObjString* internSetFind(InternSet* set, const char* chars, int length,
+                         uint32_t hash);
+void internSetAdd(InternSet* set, ObjString* string);
+void internSetRemoveWhite(InternSet* set);
+
+#endif
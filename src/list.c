@@ -0,0 +1,545 @@
+#include <string.h>
+
+#include "list.h"
+#include "memory.h"
+#include "simd.h"
+#include "vm.h"
+
+// Slices shorter than this are copied. Sharing only pays for itself
+// when it saves copying a good number of items.
+#define SLICE_SHARE_MIN 32
+
+void insertInList(ObjList* list, int index, Value value) {
+  // Grow by appending, then shift the tail up over the new slot.
+  appendToList(list, value);
+  Value* values = list->items.values;
+  memmove(&values[index + 1], &values[index],
+          sizeof(Value) * (list->items.count - 1 - index));
+  values[index] = value;
+}
+
+Value removeFromList(ObjList* list, int index) {
+  Value value = list->items.values[index];
+  int last = list->items.count - 1;
+
+  // Dropping the last item doesn't touch the array, so a slice can keep
+  // sharing.
+  if (index != last) {
+    makeListWritable(list);
+    Value* values = list->items.values;
+    memmove(&values[index], &values[index + 1],
+            sizeof(Value) * (last - index));
+  }
+
+  list->items.count--;
+  return value;
+}
+
+void reserveList(ObjList* list, int capacity) {
+  makeListWritable(list);
+  if (capacity <= list->items.capacity) return;
+
+  list->items.values = GROW_ARRAY(Value, list->items.values,
+                                  list->items.capacity, capacity);
+  list->items.capacity = capacity;
+}
+
+static ObjList* copyItems(ObjList* list, int start, int end) {
+  int count = end - start;
+  ObjList* copy = newList();
+  push(OBJ_VAL(copy));
+  if (count > 0) {
+    reserveList(copy, count);
+    memcpy(copy->items.values, &list->items.values[start],
+           sizeof(Value) * count);
+    copy->items.count = count;
+  }
+  copy->isNumeric = list->isNumeric;
+  pop();
+  return copy;
+}
+
+ObjList* copyList(ObjList* list) {
+  return copyItems(list, 0, list->items.count);
+}
+
+ObjList* sliceList(ObjList* list, int start, int end) {
+  if (end - start < SLICE_SHARE_MIN) return copyItems(list, start, end);
+
+  if (list->base == NULL) {
+    // Hand the items over to a hidden base list so the original can
+    // share them with the slice on the same terms.
+    ObjList* base = newList();
+    base->items = list->items;
+    base->isNumeric = list->isNumeric;
+    list->base = base;
+    list->items.capacity = 0;
+  }
+
+  ObjList* slice = newList();
+  slice->base = list->base;
+  slice->items.values = &list->items.values[start];
+  slice->items.count = end - start;
+  slice->items.capacity = 0;
+  slice->isNumeric = list->isNumeric;
+  return slice;
+}
+
+// Sorting ------------------------------------------------------------------
+
+typedef enum {
+  SORT_NUMBERS,
+  SORT_STRINGS,
+  SORT_COMPARATOR,
+} SortKind;
+
+typedef struct {
+  SortKind kind;
+  Value comparator;
+  // Set once the comparator fails. Every later comparison is false so
+  // the sort winds down quickly.
+  bool failed;
+} Sorter;
+
+// Orders two strings by their bytes, like memcmp(). Neither may be a
+// rope.
+static int compareStrings(Value a, Value b) {
+  char aShort[SHORT_STRING_MAX];
+  char bShort[SHORT_STRING_MAX];
+  const char* aChars;
+  const char* bChars;
+  int aLength;
+  int bLength;
+
+  if (IS_SHORT_STRING(a)) {
+    aLength = unpackShortString(a, aShort);
+    aChars = aShort;
+  } else {
+    aLength = AS_STRING(a)->length;
+    aChars = AS_STRING(a)->chars;
+  }
+  if (IS_SHORT_STRING(b)) {
+    bLength = unpackShortString(b, bShort);
+    bChars = bShort;
+  } else {
+    bLength = AS_STRING(b)->length;
+    bChars = AS_STRING(b)->chars;
+  }
+
+  int order = memcmp(aChars, bChars, aLength < bLength ? aLength : bLength);
+  if (order != 0) return order;
+  return aLength - bLength;
+}
+
+// The comparator answers whether [a] goes before [b], either with a
+// truthy value or with a negative number.
+static bool callComparator(Sorter* sorter, Value a, Value b) {
+  if (sorter->failed) return false;
+
+  push(sorter->comparator);
+  push(a);
+  push(b);
+  if (!callFromNative(sorter->comparator, 2)) {
+    sorter->failed = true;
+    return false;
+  }
+
+  Value result = pop();
+  if (IS_NUMBER(result)) return AS_NUMBER(result) < 0;
+  return !IS_NIL(result) && !(IS_BOOL(result) && !AS_BOOL(result));
+}
+
+static inline bool lessThan(Sorter* sorter, Value a, Value b) {
+  switch (sorter->kind) {
+    case SORT_NUMBERS:    return AS_NUMBER(a) < AS_NUMBER(b);
+    case SORT_STRINGS:    return compareStrings(a, b) < 0;
+    case SORT_COMPARATOR: return callComparator(sorter, a, b);
+  }
+  return false; // Unreachable.
+}
+
+static inline void swap(Value* values, int a, int b) {
+  Value temp = values[a];
+  values[a] = values[b];
+  values[b] = temp;
+}
+
+// What follows is a pattern-defeating quicksort: introsort with a few
+// tricks that make sorted, reversed and many-duplicate inputs run in
+// linear or near-linear time. Every scan is bounds-checked, so an
+// inconsistent comparator yields a jumbled list but never reads outside
+// the array.
+
+// Below this size, ranges are finished off with insertion sort.
+#define INSERTION_SORT_MAX 24
+// Above this size, the pivot is the median of three medians.
+#define NINTHER_MIN 128
+// A partial insertion sort gives up after moving this many items.
+#define PARTIAL_INSERTION_LIMIT 8
+
+static void insertionSort(Sorter* sorter, Value* values, int lo, int hi) {
+  for (int i = lo + 1; i < hi; i++) {
+    Value value = values[i];
+    int j = i;
+    while (j > lo && lessThan(sorter, value, values[j - 1])) {
+      values[j] = values[j - 1];
+      j--;
+    }
+    values[j] = value;
+  }
+}
+
+// Like insertionSort() but bails out once it has moved too many items.
+// Returns true if the range ended up sorted.
+static bool partialInsertionSort(Sorter* sorter, Value* values,
+                                 int lo, int hi) {
+  int moved = 0;
+  for (int i = lo + 1; i < hi; i++) {
+    Value value = values[i];
+    int j = i;
+    while (j > lo && lessThan(sorter, value, values[j - 1])) {
+      values[j] = values[j - 1];
+      j--;
+    }
+    values[j] = value;
+
+    moved += i - j;
+    if (moved > PARTIAL_INSERTION_LIMIT) return false;
+  }
+  return true;
+}
+
+static void siftDown(Sorter* sorter, Value* values, int lo, int root,
+                     int count) {
+  for (;;) {
+    int child = root * 2 + 1;
+    if (child >= count) return;
+    if (child + 1 < count &&
+        lessThan(sorter, values[lo + child], values[lo + child + 1])) {
+      child++;
+    }
+    if (!lessThan(sorter, values[lo + root], values[lo + child])) return;
+    swap(values, lo + root, lo + child);
+    root = child;
+  }
+}
+
+static void heapSort(Sorter* sorter, Value* values, int lo, int hi) {
+  int count = hi - lo;
+  for (int i = count / 2 - 1; i >= 0; i--) {
+    siftDown(sorter, values, lo, i, count);
+  }
+  for (int end = count - 1; end > 0; end--) {
+    swap(values, lo, lo + end);
+    siftDown(sorter, values, lo, 0, end);
+  }
+}
+
+// Sorts the items at [a], [b] and [c] among themselves.
+static void sort3(Sorter* sorter, Value* values, int a, int b, int c) {
+  if (lessThan(sorter, values[b], values[a])) swap(values, a, b);
+  if (lessThan(sorter, values[c], values[b])) swap(values, b, c);
+  if (lessThan(sorter, values[b], values[a])) swap(values, a, b);
+}
+
+// Partitions around the pivot at [lo], putting items equal to it on
+// the right. Returns the pivot's final position and sets
+// [alreadyPartitioned] if no items had to be swapped.
+static int partitionRight(Sorter* sorter, Value* values, int lo, int hi,
+                          bool* alreadyPartitioned) {
+  Value pivot = values[lo];
+  int i = lo;
+  int j = hi;
+
+  while (++i < hi && lessThan(sorter, values[i], pivot));
+  while (--j > lo && !lessThan(sorter, values[j], pivot));
+  *alreadyPartitioned = i >= j;
+
+  while (i < j) {
+    swap(values, i, j);
+    while (++i < hi && lessThan(sorter, values[i], pivot));
+    while (--j > lo && !lessThan(sorter, values[j], pivot));
+  }
+
+  int pivotPosition = i - 1;
+  values[lo] = values[pivotPosition];
+  values[pivotPosition] = pivot;
+  return pivotPosition;
+}
+
+// Partitions around the pivot at [lo], putting items equal to it on
+// the left. Used when the pivot equals the item just before the range,
+// which means everything equal to it is already in its final place.
+static int partitionLeft(Sorter* sorter, Value* values, int lo, int hi) {
+  Value pivot = values[lo];
+  int i = lo;
+  int j = hi;
+
+  while (--j > lo && lessThan(sorter, pivot, values[j]));
+  while (++i < j && !lessThan(sorter, pivot, values[i]));
+
+  while (i < j) {
+    swap(values, i, j);
+    while (--j > lo && lessThan(sorter, pivot, values[j]));
+    while (++i < j && !lessThan(sorter, pivot, values[i]));
+  }
+
+  values[lo] = values[j];
+  values[j] = pivot;
+  return j;
+}
+
+static void sortRange(Sorter* sorter, Value* values, int lo, int hi,
+                      int badAllowed, bool leftmost) {
+  for (;;) {
+    int count = hi - lo;
+    if (count <= INSERTION_SORT_MAX) {
+      insertionSort(sorter, values, lo, hi);
+      return;
+    }
+
+    // Move the pivot to values[lo].
+    int mid = lo + count / 2;
+    if (count > NINTHER_MIN) {
+      sort3(sorter, values, lo, mid, hi - 1);
+      sort3(sorter, values, lo + 1, mid - 1, hi - 2);
+      sort3(sorter, values, lo + 2, mid + 1, hi - 3);
+      sort3(sorter, values, mid - 1, mid, mid + 1);
+      swap(values, lo, mid);
+    } else {
+      sort3(sorter, values, mid, lo, hi - 1);
+    }
+
+    if (!leftmost && !lessThan(sorter, values[lo - 1], values[lo])) {
+      lo = partitionLeft(sorter, values, lo, hi) + 1;
+      continue;
+    }
+
+    bool alreadyPartitioned;
+    int pivot = partitionRight(sorter, values, lo, hi, &alreadyPartitioned);
+    int leftCount = pivot - lo;
+    int rightCount = hi - pivot - 1;
+
+    if (leftCount < count / 8 || rightCount < count / 8) {
+      // A lopsided split. After too many, fall back to heapsort to stay
+      // O(n log n). Otherwise shake up both sides to break patterns.
+      if (--badAllowed == 0) {
+        heapSort(sorter, values, lo, hi);
+        return;
+      }
+      if (leftCount >= INSERTION_SORT_MAX) {
+        swap(values, lo, lo + leftCount / 4);
+        swap(values, pivot - 1, pivot - leftCount / 4);
+      }
+      if (rightCount >= INSERTION_SORT_MAX) {
+        swap(values, pivot + 1, pivot + 1 + rightCount / 4);
+        swap(values, hi - 1, hi - rightCount / 4);
+      }
+    } else if (alreadyPartitioned &&
+               partialInsertionSort(sorter, values, lo, pivot) &&
+               partialInsertionSort(sorter, values, pivot + 1, hi)) {
+      // The input was probably close to sorted already.
+      return;
+    }
+
+    // Recurse into the left side and loop on the right.
+    sortRange(sorter, values, lo, pivot, badAllowed, leftmost);
+    lo = pivot + 1;
+    leftmost = false;
+  }
+}
+
+static void sortValues(Sorter* sorter, Value* values, int count) {
+  // log2(count) bad partitions are allowed before switching to heapsort.
+  int badAllowed = 1;
+  for (int n = count; n > 1; n >>= 1) badAllowed++;
+  sortRange(sorter, values, 0, count, badAllowed, true);
+}
+
+// NaN isn't ordered against anything, so it would break the sort's
+// invariants. Move any to the end first and sort the rest. Returns how
+// many items are left to sort.
+static int moveNaNsToEnd(Value* values, int count) {
+  int end = count;
+  for (int i = count - 1; i >= 0; i--) {
+    double number = AS_NUMBER(values[i]);
+    if (number != number) swap(values, i, --end);
+  }
+  return end;
+}
+
+bool sortList(ObjList* list, Value comparator) {
+  int count = list->items.count;
+  if (count < 2) return true;
+
+  Sorter sorter;
+  sorter.comparator = comparator;
+  sorter.failed = false;
+
+  if (IS_NIL(comparator)) {
+    // isNumeric can be false for a list that holds only numbers, so
+    // anything else is scanned.
+    bool allNumbers = true;
+    bool allStrings = !list->isNumeric;
+    for (int i = 0; i < count && !list->isNumeric &&
+                    (allNumbers || allStrings); i++) {
+      Value value = list->items.values[i];
+      if (!IS_NUMBER(value)) allNumbers = false;
+      if (!IS_ANY_STRING(value)) allStrings = false;
+    }
+
+    if (allNumbers) {
+      makeListWritable(list);
+      list->isNumeric = true;
+      sorter.kind = SORT_NUMBERS;
+      count = moveNaNsToEnd(list->items.values, count);
+    } else if (allStrings) {
+      for (int i = 0; i < count; i++) {
+        Value value = list->items.values[i];
+        if (IS_STRING(value)) flattenString(AS_STRING(value));
+      }
+      makeListWritable(list);
+      sorter.kind = SORT_STRINGS;
+    } else {
+      nativeError("Can only sort numbers or strings without a "
+                  "comparator.");
+      return false;
+    }
+
+    sortValues(&sorter, list->items.values, count);
+    return true;
+  }
+
+  // The comparator can run any code, including code that changes the
+  // list, so sort a private copy and write it back afterwards.
+  ObjList* copy = copyItems(list, 0, count);
+  push(OBJ_VAL(copy));
+
+  sorter.kind = SORT_COMPARATOR;
+  sortValues(&sorter, copy->items.values, count);
+  if (sorter.failed) return false;
+
+  if (list->items.count != count) {
+    nativeError("List changed size while it was being sorted.");
+    return false;
+  }
+
+  makeListWritable(list);
+  memcpy(list->items.values, copy->items.values, sizeof(Value) * count);
+  list->isNumeric = copy->isNumeric;
+  pop();
+  return true;
+}
+
+// Numeric operations --------------------------------------------------------
+
+#ifdef NAN_BOXING
+static double* borrowNumbers(ObjList* list) {
+  return LIST_NUMBERS(list);
+}
+
+static void releaseNumbers(ObjList* list, double* numbers, bool written) {
+}
+#else
+// Without NaN boxing the items aren't a double array, so the kernels
+// work on a copy.
+static double* borrowNumbers(ObjList* list) {
+  int count = list->items.count;
+  double* numbers = ALLOCATE(double, count);
+  for (int i = 0; i < count; i++) {
+    numbers[i] = AS_NUMBER(list->items.values[i]);
+  }
+  return numbers;
+}
+
+static void releaseNumbers(ObjList* list, double* numbers, bool written) {
+  int count = list->items.count;
+  if (written) {
+    for (int i = 0; i < count; i++) {
+      list->items.values[i] = NUMBER_VAL(numbers[i]);
+    }
+  }
+  FREE_ARRAY(double, numbers, count);
+}
+#endif
+
+bool listIsNumeric(ObjList* list) {
+  if (list->isNumeric) return true;
+
+  for (int i = 0; i < list->items.count; i++) {
+    if (!IS_NUMBER(list->items.values[i])) return false;
+  }
+  list->isNumeric = true;
+  return true;
+}
+
+double listSum(ObjList* list) {
+  double* numbers = borrowNumbers(list);
+  double sum = simdSum(numbers, list->items.count);
+  releaseNumbers(list, numbers, false);
+  return sum;
+}
+
+double listMin(ObjList* list) {
+  double* numbers = borrowNumbers(list);
+  double min = simdMin(numbers, list->items.count);
+  releaseNumbers(list, numbers, false);
+  return min;
+}
+
+double listMax(ObjList* list) {
+  double* numbers = borrowNumbers(list);
+  double max = simdMax(numbers, list->items.count);
+  releaseNumbers(list, numbers, false);
+  return max;
+}
+
+double listDot(ObjList* list, ObjList* other) {
+  double* numbers = borrowNumbers(list);
+  double* others = borrowNumbers(other);
+  double dot = simdDot(numbers, others, list->items.count);
+  releaseNumbers(other, others, false);
+  releaseNumbers(list, numbers, false);
+  return dot;
+}
+
+void scaleList(ObjList* list, double factor) {
+  makeListWritable(list);
+  double* numbers = borrowNumbers(list);
+  simdScale(numbers, list->items.count, factor);
+  releaseNumbers(list, numbers, true);
+}
+
+void addElementwise(ObjList* list, ObjList* other) {
+  makeListWritable(list);
+  double* numbers = borrowNumbers(list);
+  double* others = borrowNumbers(other);
+  simdAdd(numbers, others, list->items.count);
+  releaseNumbers(other, others, false);
+  releaseNumbers(list, numbers, true);
+}
+
+void fillList(ObjList* list, Value value, int count) {
+  reserveList(list, count);
+  // A plain store loop; the compiler vectorizes it as well as any kernel.
+  Value* values = list->items.values;
+  for (int i = 0; i < count; i++) values[i] = value;
+  list->items.count = count;
+  list->isNumeric = IS_NUMBER(value);
+}
+
+int listIndexOf(ObjList* list, Value value) {
+  if (list->isNumeric) {
+    if (!IS_NUMBER(value)) return -1;
+
+    double* numbers = borrowNumbers(list);
+    int index = simdIndexOf(numbers, list->items.count, AS_NUMBER(value));
+    releaseNumbers(list, numbers, false);
+    return index;
+  }
+
+  for (int i = 0; i < list->items.count; i++) {
+    if (valuesEqual(list->items.values[i], value)) return i;
+  }
+  return -1;
+}
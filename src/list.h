@@ -0,0 +1,37 @@
+#ifndef clox_list_h
+#define clox_list_h
+
+#include "common.h"
+#include "object.h"
+#include "value.h"
+
+// These all expect the list and any values passed in to be reachable by
+// the GC, and indexes to be in bounds.
+void insertInList(ObjList* list, int index, Value value);
+Value removeFromList(ObjList* list, int index);
+void reserveList(ObjList* list, int capacity);
+ObjList* sliceList(ObjList* list, int start, int end);
+// Copies the items into a new, exactly sized array.
+ObjList* copyList(ObjList* list);
+
+// Sorts in place. Without a comparator (nil) the items must be all
+// numbers or all strings. Returns false after reporting a runtime error.
+bool sortList(ObjList* list, Value comparator);
+
+// Returns whether every item is a number, setting isNumeric again if it
+// had gone stale after removals.
+bool listIsNumeric(ObjList* list);
+
+// The numeric operations run on the kernels in simd.c. All but
+// fillList() and listIndexOf() expect listIsNumeric() to hold, and the
+// two-list ones expect equal lengths.
+double listSum(ObjList* list);
+double listMin(ObjList* list);
+double listMax(ObjList* list);
+double listDot(ObjList* list, ObjList* other);
+void scaleList(ObjList* list, double factor);
+void addElementwise(ObjList* list, ObjList* other);
+void fillList(ObjList* list, Value value, int count);
+int listIndexOf(ObjList* list, Value value);
+
+#endif
@@ -0,0 +1,378 @@
+#include <stdlib.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
+#include "file.h"
+#include "input.h"
+#include "loop.h"
+#include "memory.h"
+#include "output.h"
+#include "vm.h"
+
+#define EVENTS_MAX 64
+
+void initLoop() {
+  EventLoop* loop = &vm.loop;
+  loop->epollFd = -1;
+  loop->ready = NULL;
+  loop->readyStart = 0;
+  loop->readyCount = 0;
+  loop->readyCapacity = 0;
+  loop->timers = NULL;
+  loop->timerCount = 0;
+  loop->timerCapacity = 0;
+  loop->nextOrder = 0;
+  loop->waits = NULL;
+  loop->waitCount = 0;
+  loop->waitCapacity = 0;
+  loop->fileWaitCount = 0;
+  loop->taskCount = 0;
+  loop->hasTasksWaiter = false;
+  loop->tasksWaiter = NULL;
+}
+
+void freeLoop() {
+  EventLoop* loop = &vm.loop;
+  resetLoop();
+  FREE_ARRAY(Wakeup, loop->ready, loop->readyCapacity);
+  FREE_ARRAY(Timer, loop->timers, loop->timerCapacity);
+  FREE_ARRAY(FileWait, loop->waits, loop->waitCapacity);
+  initLoop();
+}
+
+void resetLoop() {
+  EventLoop* loop = &vm.loop;
+#ifdef __linux__
+  // Closing it drops every file it watches.
+  if (loop->epollFd >= 0) close(loop->epollFd);
+#endif
+  loop->epollFd = -1;
+  loop->readyStart = 0;
+  loop->readyCount = 0;
+  loop->timerCount = 0;
+  loop->waitCount = 0;
+  loop->fileWaitCount = 0;
+  loop->taskCount = 0;
+  loop->hasTasksWaiter = false;
+  loop->tasksWaiter = NULL;
+}
+
+void markLoop() {
+  EventLoop* loop = &vm.loop;
+  for (int i = 0; i < loop->readyCount; i++) {
+    Wakeup* wakeup =
+        &loop->ready[(loop->readyStart + i) % loop->readyCapacity];
+    markObject((Obj*)wakeup->context);
+    markValue(wakeup->value);
+  }
+  for (int i = 0; i < loop->timerCount; i++) {
+    markObject((Obj*)loop->timers[i].context);
+  }
+  for (int i = 0; i < loop->waitCount; i++) {
+    markObject((Obj*)loop->waits[i].file);
+    markObject((Obj*)loop->waits[i].context);
+  }
+  markObject((Obj*)loop->tasksWaiter);
+}
+
+static double now() {
+#ifdef _WIN32
+  return GetTickCount64() / 1000.0;
+#else
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec / 1e9;
+#endif
+}
+
+// The value must be reachable by the GC, since the queue may grow.
+static void addReady(ObjCoroutine* context, Value value) {
+  EventLoop* loop = &vm.loop;
+  if (loop->readyCount == loop->readyCapacity) {
+    // Unwrap the queue into the new array.
+    int capacity = GROW_CAPACITY(loop->readyCapacity);
+    Wakeup* ready = ALLOCATE(Wakeup, capacity);
+    for (int i = 0; i < loop->readyCount; i++) {
+      ready[i] = loop->ready[(loop->readyStart + i) % loop->readyCapacity];
+    }
+    FREE_ARRAY(Wakeup, loop->ready, loop->readyCapacity);
+    loop->ready = ready;
+    loop->readyStart = 0;
+    loop->readyCapacity = capacity;
+  }
+
+  int index = (loop->readyStart + loop->readyCount) % loop->readyCapacity;
+  loop->ready[index].context = context;
+  loop->ready[index].value = value;
+  loop->readyCount++;
+}
+
+void addTask(ObjCoroutine* task, Value argument) {
+  addReady(task, argument);
+  vm.loop.taskCount++;
+}
+
+void finishTask() {
+  EventLoop* loop = &vm.loop;
+  loop->taskCount--;
+  if (loop->taskCount == 0 && loop->hasTasksWaiter) {
+    loop->hasTasksWaiter = false;
+    addReady(loop->tasksWaiter, NIL_VAL);
+    loop->tasksWaiter = NULL;
+  }
+}
+
+int taskCount() {
+  return vm.loop.taskCount;
+}
+
+bool waitForTasks(ObjCoroutine* context) {
+  EventLoop* loop = &vm.loop;
+  if (loop->hasTasksWaiter) return false;
+  loop->hasTasksWaiter = true;
+  loop->tasksWaiter = context;
+  return true;
+}
+
+static bool isEarlier(Timer* a, Timer* b) {
+  if (a->time != b->time) return a->time < b->time;
+  return a->order < b->order;
+}
+
+void waitForTime(ObjCoroutine* context, double seconds) {
+  EventLoop* loop = &vm.loop;
+  if (loop->timerCount == loop->timerCapacity) {
+    int oldCapacity = loop->timerCapacity;
+    loop->timerCapacity = GROW_CAPACITY(oldCapacity);
+    loop->timers = GROW_ARRAY(Timer, loop->timers, oldCapacity,
+                              loop->timerCapacity);
+  }
+
+  Timer timer;
+  timer.time = now() + seconds;
+  timer.order = loop->nextOrder++;
+  timer.context = context;
+
+  // Sift up.
+  int index = loop->timerCount++;
+  while (index > 0) {
+    int parent = (index - 1) / 2;
+    if (!isEarlier(&timer, &loop->timers[parent])) break;
+    loop->timers[index] = loop->timers[parent];
+    index = parent;
+  }
+  loop->timers[index] = timer;
+}
+
+static void removeFirstTimer() {
+  EventLoop* loop = &vm.loop;
+  Timer last = loop->timers[--loop->timerCount];
+
+  // Sift the last timer down from the top.
+  int index = 0;
+  for (;;) {
+    int child = index * 2 + 1;
+    if (child >= loop->timerCount) break;
+    if (child + 1 < loop->timerCount &&
+        isEarlier(&loop->timers[child + 1], &loop->timers[child])) {
+      child++;
+    }
+    if (!isEarlier(&loop->timers[child], &last)) break;
+    loop->timers[index] = loop->timers[child];
+    index = child;
+  }
+  loop->timers[index] = last;
+}
+
+static void fireTimers() {
+  EventLoop* loop = &vm.loop;
+  double time = now();
+  while (loop->timerCount > 0 && loop->timers[0].time <= time) {
+    addReady(loop->timers[0].context, NIL_VAL);
+    removeFirstTimer();
+  }
+}
+
+// Finishes a wait on a file that is ready. Only blocks for files epoll
+// can't watch.
+static Value finishFileWait(ObjFile* file, WaitKind kind) {
+  if (kind == WAIT_CONNECTION) {
+    ObjFile* connection = acceptSocket(file);
+    return connection == NULL ? NIL_VAL : OBJ_VAL(connection);
+  }
+
+  Value line;
+  if (!readInputLine(&file->input, &line)) return NIL_VAL;
+  return line;
+}
+
+static int findFileWait(ObjFile* file) {
+  EventLoop* loop = &vm.loop;
+  for (int i = 0; i < loop->waitCount; i++) {
+    if (loop->waits[i].file == file) return i;
+  }
+  return -1;
+}
+
+// Stops watching the file in [slot] and wakes its context with value,
+// which must be reachable by the GC.
+static void removeFileWait(int slot, Value value) {
+  EventLoop* loop = &vm.loop;
+  // Queued first so the wait keeps the context reachable meanwhile.
+  addReady(loop->waits[slot].context, value);
+
+  FileWait* wait = &loop->waits[slot];
+#ifdef __linux__
+  epoll_ctl(loop->epollFd, EPOLL_CTL_DEL, wait->file->input.fd, NULL);
+#endif
+  wait->file = NULL;
+  wait->context = NULL;
+  loop->fileWaitCount--;
+}
+
+#ifdef __linux__
+// Returns false if epoll can't watch the file.
+static bool watchFile(ObjCoroutine* context, ObjFile* file,
+                      WaitKind kind) {
+  EventLoop* loop = &vm.loop;
+  if (loop->epollFd < 0) {
+    loop->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epollFd < 0) return false;
+  }
+
+  int slot = findFileWait(NULL);
+  if (slot == -1) {
+    if (loop->waitCount == loop->waitCapacity) {
+      int oldCapacity = loop->waitCapacity;
+      loop->waitCapacity = GROW_CAPACITY(oldCapacity);
+      loop->waits = GROW_ARRAY(FileWait, loop->waits, oldCapacity,
+                               loop->waitCapacity);
+    }
+    slot = loop->waitCount++;
+    loop->waits[slot].file = NULL;
+    loop->waits[slot].context = NULL;
+  }
+
+  struct epoll_event event;
+  event.events = EPOLLIN;
+  event.data.u32 = (uint32_t)slot;
+  if (epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, file->input.fd,
+                &event) != 0) {
+    return false;
+  }
+
+  loop->waits[slot].file = file;
+  loop->waits[slot].context = context;
+  loop->waits[slot].kind = kind;
+  loop->fileWaitCount++;
+  return true;
+}
+#endif
+
+bool waitForFile(ObjCoroutine* context, ObjFile* file, WaitKind kind) {
+  if (findFileWait(file) != -1) return false;
+
+#ifdef __linux__
+  bool isReady = kind == WAIT_LINE && hasInputLine(&file->input);
+  if (!isReady && watchFile(context, file, kind)) return true;
+#endif
+
+  Value value = finishFileWait(file, kind);
+  push(value);
+  addReady(context, value);
+  pop();
+  return true;
+}
+
+void cancelFileWait(ObjFile* file) {
+  int slot = findFileWait(file);
+  if (slot != -1) removeFileWait(slot, NIL_VAL);
+}
+
+#ifdef __linux__
+static void fileReady(int slot) {
+  FileWait* wait = &vm.loop.waits[slot];
+  ObjFile* file = wait->file;
+  if (file == NULL) return;
+
+  // Half a line isn't enough. Keep what came and go on waiting.
+  if (wait->kind == WAIT_LINE) {
+    fillInput(&file->input);
+    if (!hasInputLine(&file->input)) return;
+  }
+
+  // The wait keeps the file and context reachable until it is removed.
+  Value value = finishFileWait(file, wait->kind);
+  push(value);
+  removeFileWait(slot, value);
+  pop();
+}
+#endif
+
+static void sleepFor(int milliseconds) {
+#ifdef _WIN32
+  Sleep(milliseconds);
+#else
+  struct timespec time;
+  time.tv_sec = milliseconds / 1000;
+  time.tv_nsec = (long)(milliseconds % 1000) * 1000000;
+  while (nanosleep(&time, &time) != 0 && errno == EINTR) {}
+#endif
+}
+
+// Waits up to timeout milliseconds, or for good if it's -1, for files
+// to be ready.
+static bool pollFiles(int timeout) {
+  EventLoop* loop = &vm.loop;
+  if (timeout != 0) flushOutput();
+  if (loop->fileWaitCount == 0) {
+    if (timeout > 0) sleepFor(timeout);
+    return true;
+  }
+
+#ifdef __linux__
+  struct epoll_event events[EVENTS_MAX];
+  int count = epoll_wait(loop->epollFd, events, EVENTS_MAX, timeout);
+  if (count < 0) {
+    if (errno == EINTR) return true;
+    nativeError("Could not wait for files.");
+    return false;
+  }
+  for (int i = 0; i < count; i++) fileReady((int)events[i].data.u32);
+#endif
+  return true;
+}
+
+bool nextWakeup(Wakeup* wakeup) {
+  EventLoop* loop = &vm.loop;
+  while (loop->readyCount == 0) {
+    if (loop->timerCount == 0 && loop->fileWaitCount == 0) {
+      nativeError("Every context is waiting and nothing can wake one.");
+      return false;
+    }
+
+    int timeout = -1;
+    if (loop->timerCount > 0) {
+      // Round up so a timer isn't polled for over and over just before
+      // it is due.
+      double seconds = loop->timers[0].time - now();
+      timeout = seconds <= 0 ? 0 : (int)(seconds * 1000 + 0.999);
+    }
+    if (!pollFiles(timeout)) return false;
+    fireTimers();
+  }
+
+  *wakeup = loop->ready[loop->readyStart];
+  loop->readyStart = (loop->readyStart + 1) % loop->readyCapacity;
+  loop->readyCount--;
+  return true;
+}
@@ -0,0 +1,90 @@
+#ifndef clox_loop_h
+#define clox_loop_h
+
+#include "common.h"
+#include "object.h"
+#include "value.h"
+
+// A context is a stack that script code runs on: the main one, written
+// as NULL, or a coroutine's. A context waiting on a timer or a file is
+// parked here while the VM runs another that is ready, and the loop
+// only blocks in epoll_wait() when none is. Tasks are coroutines that
+// the loop starts itself.
+
+typedef enum {
+  // Wakes with the next line, or nil at the end of the file.
+  WAIT_LINE,
+  // Wakes with a socket accepted from a listening one, or nil.
+  WAIT_CONNECTION,
+} WaitKind;
+
+typedef struct {
+  ObjCoroutine* context;
+  // The result of the call the context is waiting in, or the argument
+  // of a task that hasn't started.
+  Value value;
+} Wakeup;
+
+typedef struct {
+  double time;
+  // Timers due at the same time fire in the order they were set.
+  uint64_t order;
+  ObjCoroutine* context;
+} Timer;
+
+typedef struct {
+  // NULL for a free slot.
+  ObjFile* file;
+  ObjCoroutine* context;
+  WaitKind kind;
+} FileWait;
+
+typedef struct {
+  // -1 until something first waits on a file.
+  int epollFd;
+  // A queue of contexts that are ready to run.
+  Wakeup* ready;
+  int readyStart;
+  int readyCount;
+  int readyCapacity;
+  // A binary heap with the next timer due first.
+  Timer* timers;
+  int timerCount;
+  int timerCapacity;
+  uint64_t nextOrder;
+  // epoll refers to waits by their slot here.
+  FileWait* waits;
+  int waitCount;
+  int waitCapacity;
+  int fileWaitCount;
+  int taskCount;
+  // The context waiting in prisDetyrat(), if any.
+  bool hasTasksWaiter;
+  ObjCoroutine* tasksWaiter;
+} EventLoop;
+
+void initLoop();
+void freeLoop();
+// Drops every waiting context after a runtime error unwound them.
+void resetLoop();
+void markLoop();
+
+// Queues a task that hasn't started. It gets [argument] if its function
+// takes one.
+void addTask(ObjCoroutine* task, Value argument);
+void finishTask();
+int taskCount();
+// Returns false if a context is already waiting for the tasks.
+bool waitForTasks(ObjCoroutine* context);
+void waitForTime(ObjCoroutine* context, double seconds);
+// Returns false if a context is already waiting on the file. Files that
+// epoll can't watch, like regular files, are read right away.
+bool waitForFile(ObjCoroutine* context, ObjFile* file, WaitKind kind);
+// The context waiting on a file that is being closed wakes with nil.
+void cancelFileWait(ObjFile* file);
+
+// Takes the next context to run, waiting on timers and files until one
+// is ready. Reports failures through nativeError() and returns false.
+bool nextWakeup(Wakeup* wakeup);
+
+#endif
@@ -11,6 +11,10 @@
 //< main-include-chunk
 //> main-include-debug
 #include "debug.h"
+#include "output.h"
+#include "server.h"
+#include "snapshot.h"
+#include "source.h"
 //< main-include-debug
 //> A Virtual Machine main-include-vm
 #include "vm.h"
@@ -20,6 +24,7 @@
 static void repl() {
   char line[1024];
   for (;;) {
+    flushOutput();
     printf("> ");
 
     if (!fgets(line, sizeof(line), stdin)) {
@@ -27,58 +32,37 @@ static void repl() {
       break;
     }
 
-    interpret(line);
+    interpret(line, (int)strlen(line));
   }
 }
 //< Scanning on Demand repl
-//> Scanning on Demand read-file
-static char* readFile(const char* path) {
-  FILE* file = fopen(path, "rb");
-//> no-file
-  if (file == NULL) {
-    fprintf(stderr, "Could not open file \"%s\".\n", path);
-    exit(74);
-  }
-//< no-file
-
-  fseek(file, 0L, SEEK_END);
-  size_t fileSize = ftell(file);
-  rewind(file);
-
-  char* buffer = (char*)malloc(fileSize + 1);
-//> no-buffer
-  if (buffer == NULL) {
-    fprintf(stderr, "Not enough memory to read \"%s\".\n", path);
-    exit(74);
-  }
-  
-//< no-buffer
-  size_t bytesRead = fread(buffer, sizeof(char), fileSize, file);
-//> no-read
-  if (bytesRead < fileSize) {
-    fprintf(stderr, "Could not read file \"%s\".\n", path);
-    exit(74);
-  }
-  
-//< no-read
-  buffer[bytesRead] = '\0';
-
-  fclose(file);
-  return buffer;
-}
-//< Scanning on Demand read-file
 //> Scanning on Demand run-file
 static void runFile(const char* path) {
-  char* source = readFile(path);
-  InterpretResult result = interpret(source);
-  free(source); // [owner]
+  Source source;
+  if (!readSource(path, &source)) exit(74);
+  InterpretResult result = interpret(source.chars, (int)source.length);
+  freeSource(&source);
 
+  if (result == INTERPRET_OK) return;
+
+  // Writes still sitting in file buffers go out before exiting.
+  freeVM();
   if (result == INTERPRET_COMPILE_ERROR) exit(65);
   if (result == INTERPRET_RUNTIME_ERROR) exit(70);
 }
 //< Scanning on Demand run-file
 
 int main(int argc, const char* argv[]) {
+  // With DOTAL_SERVER set, a script runs on that server if one is up,
+  // which skips setting up a VM here at all.
+  const char* server = getenv("DOTAL_SERVER");
+  if (argc >= 2 && server != NULL && strncmp(argv[1], "--", 2) != 0) {
+    int exitCode;
+    if (runOnServer(server, argv[1], argc - 2, argv + 2, &exitCode)) {
+      return exitCode;
+    }
+  }
+
 //> A Virtual Machine main-init-vm
   initVM();
 
@@ -134,10 +118,25 @@ int main(int argc, const char* argv[]) {
 //> Scanning on Demand args
   if (argc == 1) {
     repl();
-  } else if (argc == 2) {
+  } else if (strncmp(argv[1], "--", 2) != 0) {
+    setArguments(argc - 2, argv + 2);
     runFile(argv[1]);
+  } else if (strcmp(argv[1], "--server") == 0 && (argc == 3 || argc == 4)) {
+    // Each request forks from this VM, so a prelude loaded here is free.
+    if (argc == 4 && !loadSnapshot(argv[3])) exit(74);
+    exit(runServer(argv[2]));
+  } else if (strcmp(argv[1], "--snapshot") == 0 && argc == 4) {
+    runFile(argv[2]);
+    if (!writeSnapshot(argv[3])) exit(74);
+  } else if (strcmp(argv[1], "--prelude") == 0 && argc >= 4) {
+    if (!loadSnapshot(argv[2])) exit(74);
+    setArguments(argc - 4, argv + 4);
+    runFile(argv[3]);
   } else {
-    fprintf(stderr, "Usage: clox [path]\n");
+    fprintf(stderr, "Usage: clox [path [arguments...]]\n"
+                    "       clox --prelude snapshot path [arguments...]\n"
+                    "       clox --snapshot prelude snapshot\n"
+                    "       clox --server socket [snapshot]\n");
     exit(64);
   }
   
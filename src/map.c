@@ -0,0 +1,161 @@
+#include <string.h>
+
+#include "hash.h"
+#include "map.h"
+#include "memory.h"
+
+#define MAP_MAX_LOAD 0.75
+
+bool isValidMapKey(Value key) {
+  if (IS_NIL(key)) return false;
+  if (IS_NUMBER(key) && AS_NUMBER(key) != AS_NUMBER(key)) return false;
+  return true;
+}
+
+// Runtime strings short enough to pack always are, but a heap one can
+// still turn up, like an empty string or a compiler-made constant.
+// Packing it gives every string key a single form, and so a single hash.
+static Value packKey(Value key) {
+  if (!IS_STRING(key)) return key;
+
+  ObjString* string = AS_STRING(key);
+  if (string->length > SHORT_STRING_MAX) return key;
+  flattenString(string);
+  if (!fitsShortString(string->chars, string->length)) return key;
+  return makeShortString(string->chars, string->length);
+}
+
+// Keys that are equal under valuesEqual() must hash alike. Heap strings,
+// which packKey() leaves only when they can't be packed, hash their
+// characters. Every other key is equal only to a key with the same bits,
+// once -0 is folded into 0.
+static uint32_t hashValue(Value key) {
+  if (IS_STRING(key)) return stringHash(AS_STRING(key));
+
+#ifdef NAN_BOXING
+  if (IS_NUMBER(key) && AS_NUMBER(key) == 0) key = NUMBER_VAL(0);
+  return hashBits(key);
+#else
+  uint64_t bits = 0;
+  switch (key.type) {
+    case VAL_BOOL:   bits = AS_BOOL(key); break;
+    case VAL_NIL:    bits = 0; break;
+    case VAL_NUMBER: {
+      double number = AS_NUMBER(key) == 0 ? 0 : AS_NUMBER(key);
+      memcpy(&bits, &number, sizeof(bits));
+      break;
+    }
+    case VAL_OBJ:    bits = (uintptr_t)AS_OBJ(key); break;
+    case VAL_SHORT_STRING: bits = AS_SHORT_STRING(key); break;
+  }
+  return hashBits(bits ^ ((uint64_t)key.type << 56));
+#endif
+}
+
+static MapEntry* findEntry(MapEntry* entries, int capacity, Value key,
+                           uint32_t hash) {
+  uint32_t index = hash & (capacity - 1);
+  MapEntry* tombstone = NULL;
+
+  for (;;) {
+    MapEntry* entry = &entries[index];
+    if (IS_NIL(entry->key)) {
+      if (IS_NIL(entry->value)) {
+        // Empty entry.
+        return tombstone != NULL ? tombstone : entry;
+      } else {
+        // We found a tombstone.
+        if (tombstone == NULL) tombstone = entry;
+      }
+    } else if (valuesEqual(entry->key, key)) {
+      // We found the key.
+      return entry;
+    }
+
+    index = (index + 1) & (capacity - 1);
+  }
+}
+
+bool mapGet(ObjMap* map, Value key, Value* value) {
+  if (map->count == 0 || !isValidMapKey(key)) return false;
+
+  key = packKey(key);
+  MapEntry* entry = findEntry(map->entries, map->capacity, key,
+                              hashValue(key));
+  if (IS_NIL(entry->key)) return false;
+
+  *value = entry->value;
+  return true;
+}
+
+static void adjustCapacity(ObjMap* map, int capacity) {
+  MapEntry* entries = ALLOCATE(MapEntry, capacity);
+  for (int i = 0; i < capacity; i++) {
+    entries[i].key = NIL_VAL;
+    entries[i].value = NIL_VAL;
+  }
+
+  for (int i = 0; i < map->capacity; i++) {
+    MapEntry* entry = &map->entries[i];
+    if (IS_NIL(entry->key)) continue;
+
+    MapEntry* dest = findEntry(entries, capacity, entry->key,
+                               hashValue(entry->key));
+    *dest = *entry;
+  }
+
+  FREE_ARRAY(MapEntry, map->entries, map->capacity);
+  map->entries = entries;
+  map->capacity = capacity;
+  map->tombstones = 0;
+}
+
+// The map, key and value must all be reachable by the GC. Returns true
+// if the key is new.
+bool mapSet(ObjMap* map, Value key, Value value) {
+  if (map->count + map->tombstones + 1 > map->capacity * MAP_MAX_LOAD) {
+    adjustCapacity(map, GROW_CAPACITY(map->capacity));
+  }
+
+  // String keys are interned so that the map shares one copy of each
+  // and later lookups with the same key compare pointers. This can
+  // collect, which is why the map grows first.
+  key = packKey(key);
+  if (IS_STRING(key)) key = OBJ_VAL(internString(AS_STRING(key)));
+
+  MapEntry* entry = findEntry(map->entries, map->capacity, key,
+                              hashValue(key));
+  bool isNewKey = IS_NIL(entry->key);
+  if (isNewKey) {
+    map->count++;
+    if (!IS_NIL(entry->value)) map->tombstones--;
+  }
+
+  entry->key = key;
+  entry->value = value;
+  return isNewKey;
+}
+
+bool mapDelete(ObjMap* map, Value key) {
+  if (map->count == 0 || !isValidMapKey(key)) return false;
+
+  key = packKey(key);
+  MapEntry* entry = findEntry(map->entries, map->capacity, key,
+                              hashValue(key));
+  if (IS_NIL(entry->key)) return false;
+
+  // Place a tombstone in the entry.
+  entry->key = NIL_VAL;
+  entry->value = BOOL_VAL(true);
+  map->count--;
+  map->tombstones++;
+  return true;
+}
+
+void markMap(ObjMap* map) {
+  for (int i = 0; i < map->capacity; i++) {
+    MapEntry* entry = &map->entries[i];
+    markValue(entry->key);
+    markValue(entry->value);
+  }
+}
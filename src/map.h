@@ -0,0 +1,17 @@
+#ifndef clox_map_h
+#define clox_map_h
+
+#include "common.h"
+#include "object.h"
+#include "value.h"
+
+// Nil can't be a key since it marks empty slots, and NaN never equals
+// itself so it could never be looked up again.
+bool isValidMapKey(Value key);
+
+bool mapGet(ObjMap* map, Value key, Value* value);
+bool mapSet(ObjMap* map, Value key, Value value);
+bool mapDelete(ObjMap* map, Value key);
+void markMap(ObjMap* map);
+
+#endif
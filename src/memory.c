@@ -4,6 +4,9 @@
 //> Garbage Collection memory-include-compiler
 #include "compiler.h"
 //< Garbage Collection memory-include-compiler
+#include "file.h"
+#include "server.h"
+#include "map.h"
 #include "memory.h"
 //> Strings memory-include-vm
 #include "vm.h"
@@ -93,6 +96,20 @@ static void markArray(ValueArray* array) {
   }
 }
 //< Garbage Collection mark-array
+
+static void markCallStack(CallStack* stack) {
+  for (Value* slot = stack->stack; slot < stack->stackTop; slot++) {
+    markValue(*slot);
+  }
+  for (int i = 0; i < stack->frameCount; i++) {
+    markObject((Obj*)stack->frames[i].closure);
+  }
+  for (ObjUpvalue* upvalue = stack->openUpvalues;
+       upvalue != NULL;
+       upvalue = upvalue->next) {
+    markObject((Obj*)upvalue);
+  }
+}
 //> Garbage Collection blacken-object
 static void blackenObject(Obj* object) {
 //> log-blacken-object
@@ -133,11 +150,33 @@ static void blackenObject(Obj* object) {
     }
      case OBJ_LIST: {
             ObjList* list = (ObjList*)object;
+            markObject((Obj*)list->base);
+            // Numbers hold no references, and a slice's items are all
+            // in its base list.
+            if (list->isNumeric || list->base != NULL) break;
             for (int i = 0; i < list->items.count; i++) {
                 markValue(list->items.values[i]);
             }
             break;
         }
+    case OBJ_MAP:
+      markMap((ObjMap*)object);
+      break;
+    case OBJ_FILE: {
+      ObjFile* file = (ObjFile*)object;
+      markObject((Obj*)file->path);
+      markObject((Obj*)file->input.block);
+      markArray(&file->pending);
+      break;
+    }
+    case OBJ_COROUTINE: {
+      ObjCoroutine* coroutine = (ObjCoroutine*)object;
+      markObject((Obj*)coroutine->closure);
+      markObject((Obj*)coroutine->resumer);
+      // The running coroutine's stack is marked from the VM.
+      if (coroutine != vm.coroutine) markCallStack(&coroutine->stack);
+      break;
+    }
 //< blacken-closure
 //> blacken-function
     case OBJ_FUNCTION: {
@@ -160,8 +199,14 @@ static void blackenObject(Obj* object) {
       markValue(((ObjUpvalue*)object)->closed);
       break;
 //< blacken-upvalue
+    case OBJ_STRING: {
+      ObjString* string = (ObjString*)object;
+      markObject((Obj*)string->left);
+      markObject((Obj*)string->right);
+      markObject((Obj*)string->base);
+      break;
+    }
     case OBJ_NATIVE:
-    case OBJ_STRING:
       break;
   }
 }
@@ -183,10 +228,29 @@ static void freeObject(Obj* object) {
 //> Classes and Instances free-class
     case OBJ_LIST: {
             ObjList* list = (ObjList*)object;
-            freeValueArray(&list->items); // Free the internal item array
+            // Slices don't own their items.
+            if (list->base == NULL) freeValueArray(&list->items);
             FREE(ObjList, object); // Free the list object itself
             break;
         }
+    case OBJ_MAP: {
+      ObjMap* map = (ObjMap*)object;
+      FREE_ARRAY(MapEntry, map->entries, map->capacity);
+      FREE(ObjMap, object);
+      break;
+    }
+    case OBJ_FILE: {
+      // Open files are roots, so this one is already closed.
+      FREE(ObjFile, object);
+      break;
+    }
+    case OBJ_COROUTINE: {
+      ObjCoroutine* coroutine = (ObjCoroutine*)object;
+      FREE_ARRAY(Value, coroutine->stack.stack, STACK_MAX);
+      FREE_ARRAY(CallFrame, coroutine->stack.frames, FRAMES_MAX);
+      FREE(ObjCoroutine, object);
+      break;
+    }
     case OBJ_CLASS: {
 //> Methods and Initializers free-methods
       ObjClass* klass = (ObjClass*)object;
@@ -230,7 +294,15 @@ static void freeObject(Obj* object) {
 //< Calls and Functions free-native
     case OBJ_STRING: {
       ObjString* string = (ObjString*)object;
-      FREE_ARRAY(char, string->chars, string->length + 1);
+      if (string->isMapped) {
+        unmapChars(string->chars, string->length);
+      } else if (!IS_ROPE(string) && string->base == NULL) {
+        FREE_ARRAY(char, string->chars, string->length + 1);
+      }
+      if (string->charIndex != NULL) {
+        FREE_ARRAY(int, string->charIndex,
+                   string->charCount / CHAR_INDEX_STRIDE + 1);
+      }
       FREE(ObjString, object);
       break;
     }
@@ -268,9 +340,25 @@ static void markRoots() {
 //> call-mark-compiler-roots
   markCompilerRoots();
 //< call-mark-compiler-roots
+  markServerRoots();
 //> Methods and Initializers mark-init-string
   markObject((Obj*)vm.initString);
 //< Methods and Initializers mark-init-string
+  markObject((Obj*)vm.stringClass);
+  markObject((Obj*)vm.listClass);
+  markObject((Obj*)vm.mapClass);
+  markObject((Obj*)vm.fileClass);
+  markObject((Obj*)vm.coroutineClass);
+  // The main stack waits in mainStack while a coroutine runs, and every
+  // coroutine it resumed is reachable from the running one.
+  markObject((Obj*)vm.coroutine);
+  if (vm.coroutine != NULL) markCallStack(&vm.mainStack);
+  markLoop();
+  markObject((Obj*)vm.arguments);
+  markObject((Obj*)vm.input.block);
+  for (ObjFile* file = vm.openFiles; file != NULL; file = file->next) {
+    markObject((Obj*)file);
+  }
 }
 //< Garbage Collection mark-roots
 //> Garbage Collection trace-references
@@ -324,7 +412,7 @@ void collectGarbage() {
   traceReferences();
 //< call-trace-references
 //> sweep-strings
-  tableRemoveWhite(&vm.strings);
+  internSetRemoveWhite(&vm.strings);
 //< sweep-strings
 //> call-sweep
   sweep();
@@ -1,9 +1,12 @@
 //> Strings object-c
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include "hash.h"
 #include "memory.h"
 #include "object.h"
+#include "output.h"
 //> Hash Tables object-include-table
 #include "table.h"
 //< Hash Tables object-include-table
@@ -11,6 +14,10 @@
 #include "vm.h"
 //> allocate-obj
 
+// Concatenations shorter than this are copied eagerly. Building a rope
+// node for a handful of characters costs more than it saves.
+#define ROPE_MIN_LENGTH 32
+
 #define ALLOCATE_OBJ(type, objectType) \
     (type*)allocateObject(sizeof(type), objectType)
 //< allocate-obj
@@ -93,8 +100,84 @@ ObjFunction* newFunction() {
 ObjList* newList() {
     ObjList* list = (ObjList*)allocateObject(sizeof(ObjList), OBJ_LIST);
     initValueArray(&list->items);
+    list->isNumeric = true;
+    list->base = NULL;
     return list;
 }
+
+// Gives a slice its own copy of its items before it is modified. The
+// list must be reachable by the GC.
+void makeListWritable(ObjList* list) {
+  if (list->base == NULL) return;
+
+  int count = list->items.count;
+  Value* values = NULL;
+  if (count > 0) {
+    values = ALLOCATE(Value, count);
+    memcpy(values, list->items.values, sizeof(Value) * count);
+  }
+  list->items.values = values;
+  list->items.capacity = count;
+  list->base = NULL;
+}
+
+// All writes to a list's items go through makeListWritable() and then
+// keep isNumeric accurate, as these two do.
+void appendToList(ObjList* list, Value value) {
+  makeListWritable(list);
+  if (!IS_NUMBER(value)) list->isNumeric = false;
+  writeValueArray(&list->items, value);
+}
+
+void storeInList(ObjList* list, int index, Value value) {
+  makeListWritable(list);
+  if (!IS_NUMBER(value)) list->isNumeric = false;
+  list->items.values[index] = value;
+}
+
+ObjMap* newMap() {
+  ObjMap* map = ALLOCATE_OBJ(ObjMap, OBJ_MAP);
+  map->count = 0;
+  map->tombstones = 0;
+  map->capacity = 0;
+  map->entries = NULL;
+  return map;
+}
+ObjFile* newFile(ObjString* path) {
+  ObjFile* file = ALLOCATE_OBJ(ObjFile, OBJ_FILE);
+  file->path = path;
+  file->isOpen = true;
+  file->isReadable = true;
+  file->isWritable = false;
+  file->isListening = false;
+  initInput(&file->input, -1);
+  file->buffer = NULL;
+  file->bufferLength = 0;
+  file->pieceCount = 0;
+  file->lastPieceBuffered = false;
+  initValueArray(&file->pending);
+  file->next = NULL;
+  return file;
+}
+ObjCoroutine* newCoroutine(ObjClosure* closure) {
+  // The stacks are plain memory, so nothing has to hold them if
+  // allocating the object collects.
+  Value* stack = ALLOCATE(Value, STACK_MAX);
+  CallFrame* frames = ALLOCATE(CallFrame, FRAMES_MAX);
+
+  ObjCoroutine* coroutine = ALLOCATE_OBJ(ObjCoroutine, OBJ_COROUTINE);
+  coroutine->state = COROUTINE_SUSPENDED;
+  coroutine->closure = closure;
+  coroutine->stack.stack = stack;
+  coroutine->stack.stackTop = stack;
+  coroutine->stack.frames = frames;
+  coroutine->stack.frameCount = 0;
+  coroutine->stack.baseFrameCount = 0;
+  coroutine->stack.openUpvalues = NULL;
+  coroutine->resumer = NULL;
+  coroutine->isTask = false;
+  return coroutine;
+}
 ObjInstance* newInstance(ObjClass* klass) {
   ObjInstance* instance = ALLOCATE_OBJ(ObjInstance, OBJ_INSTANCE);
   instance->klass = klass;
@@ -124,12 +207,20 @@ static ObjString* allocateString(char* chars, int length,
 //> Hash Tables allocate-store-hash
   string->hash = hash;
 //< Hash Tables allocate-store-hash
+  string->hasHash = true;
+  string->isInterned = true;
+  string->isMapped = false;
+  string->left = NULL;
+  string->right = NULL;
+  string->base = NULL;
+  string->charCount = -1;
+  string->charIndex = NULL;
 //> Hash Tables allocate-store-string
 //> Garbage Collection push-string
 
   push(OBJ_VAL(string));
 //< Garbage Collection push-string
-  tableSet(&vm.strings, string, NIL_VAL);
+  internSetAdd(&vm.strings, string);
 //> Garbage Collection pop-string
   pop();
 
@@ -138,16 +229,6 @@ static ObjString* allocateString(char* chars, int length,
   return string;
 }
 //< allocate-string
-//> Hash Tables hash-string
-static uint32_t hashString(const char* key, int length) {
-  uint32_t hash = 2166136261u;
-  for (int i = 0; i < length; i++) {
-    hash ^= (uint8_t)key[i];
-    hash *= 16777619;
-  }
-  return hash;
-}
-//< Hash Tables hash-string
 //> take-string
 
 ObjString* takeString(char* chars, int length) {
@@ -155,10 +236,9 @@ ObjString* takeString(char* chars, int length) {
   return allocateString(chars, length);
 */
 //> Hash Tables take-string-hash
-  uint32_t hash = hashString(chars, length);
+  uint32_t hash = hashBytes(chars, length);
 //> take-string-intern
-  ObjString* interned = tableFindString(&vm.strings, chars, length,
-                                        hash);
+  ObjString* interned = internSetFind(&vm.strings, chars, length, hash);
   if (interned != NULL) {
     FREE_ARRAY(char, chars, length + 1);
     return interned;
@@ -171,10 +251,9 @@ ObjString* takeString(char* chars, int length) {
 //< take-string
 ObjString* copyString(const char* chars, int length) {
 //> Hash Tables copy-string-hash
-  uint32_t hash = hashString(chars, length);
+  uint32_t hash = hashBytes(chars, length);
 //> copy-string-intern
-  ObjString* interned = tableFindString(&vm.strings, chars, length,
-                                        hash);
+  ObjString* interned = internSetFind(&vm.strings, chars, length, hash);
   if (interned != NULL) return interned;
 
 //< copy-string-intern
@@ -189,6 +268,274 @@ ObjString* copyString(const char* chars, int length) {
   return allocateString(heapChars, length, hash);
 //< Hash Tables copy-string-allocate
 }
+
+static ObjString* allocateTransientString(char* chars, int length) {
+  ObjString* string = ALLOCATE_OBJ(ObjString, OBJ_STRING);
+  string->length = length;
+  string->chars = chars;
+  string->hash = 0;
+  string->hasHash = false;
+  string->isInterned = false;
+  string->isMapped = false;
+  string->left = NULL;
+  string->right = NULL;
+  string->base = NULL;
+  string->charCount = -1;
+  string->charIndex = NULL;
+  return string;
+}
+
+ObjString* takeTransientString(char* chars, int length) {
+  return allocateTransientString(chars, length);
+}
+
+ObjString* copyTransientString(const char* chars, int length) {
+  char* heapChars = ALLOCATE(char, length + 1);
+  memcpy(heapChars, chars, length);
+  heapChars[length] = '\0';
+  return allocateTransientString(heapChars, length);
+}
+
+uint32_t stringHash(ObjString* string) {
+  if (!string->hasHash) {
+    flattenString(string);
+    string->hash = hashBytes(string->chars, string->length);
+    string->hasHash = true;
+  }
+  return string->hash;
+}
+
+// Returns the canonical copy of [string], which is what tables key on.
+// A transient string with no interned twin becomes the canonical copy
+// itself, so interning only copies the characters of a slice.
+ObjString* internString(ObjString* string) {
+  if (string->isInterned) return string;
+
+  uint32_t hash = stringHash(string);
+  ObjString* interned = internSetFind(&vm.strings, string->chars,
+                                      string->length, hash);
+  if (interned != NULL) return interned;
+
+  push(OBJ_VAL(string));
+  // Interned strings can end up as names printed with %s, so a slice
+  // takes its own NUL-terminated copy first.
+  if (string->base != NULL) {
+    char* chars = ALLOCATE(char, string->length + 1);
+    memcpy(chars, string->chars, string->length);
+    chars[string->length] = '\0';
+    string->chars = chars;
+    string->base = NULL;
+  }
+  internSetAdd(&vm.strings, string);
+  pop();
+  string->isInterned = true;
+  return string;
+}
+
+// Returns [chars] as a string value. Short strings are packed into the
+// value itself and never touch the heap.
+Value copyStringValue(const char* chars, int length) {
+  if (fitsShortString(chars, length)) {
+    return makeShortString(chars, length);
+  }
+  return OBJ_VAL(copyTransientString(chars, length));
+}
+
+Value takeStringValue(char* chars, int length) {
+  if (fitsShortString(chars, length)) {
+    Value value = makeShortString(chars, length);
+    FREE_ARRAY(char, chars, length + 1);
+    return value;
+  }
+  return OBJ_VAL(takeTransientString(chars, length));
+}
+
+int stringValueLength(Value value) {
+  if (IS_SHORT_STRING(value)) return shortStringLength(value);
+  return AS_STRING(value)->length;
+}
+
+// Returns a heap string for places that need an ObjString pointer, like
+// rope children and table keys.
+ObjString* materializeString(Value value) {
+  if (IS_STRING(value)) return AS_STRING(value);
+
+  char chars[SHORT_STRING_MAX];
+  int length = unpackShortString(value, chars);
+  return copyString(chars, length);
+}
+
+// Writes the characters of a string that is not a rope into [dest].
+static void writeStringChars(Value value, char* dest) {
+  if (IS_SHORT_STRING(value)) {
+    unpackShortString(value, dest);
+  } else {
+    ObjString* string = AS_STRING(value);
+    memcpy(dest, string->chars, string->length);
+  }
+}
+
+// Both operands must be reachable by the GC.
+Value concatenateStrings(Value a, Value b) {
+  int aLength = stringValueLength(a);
+  int bLength = stringValueLength(b);
+  if (aLength == 0) return b;
+  if (bLength == 0) return a;
+
+  int length = aLength + bLength;
+  if (IS_SHORT_STRING(a) && IS_SHORT_STRING(b) &&
+      length <= SHORT_STRING_MAX) {
+    return SHORT_STRING_VAL(AS_SHORT_STRING(a) |
+                            (AS_SHORT_STRING(b) << (8 * aLength)));
+  }
+
+  if (length < ROPE_MIN_LENGTH) {
+    // Neither operand can be a rope since ropes are never this short.
+    char* chars = ALLOCATE(char, length + 1);
+    writeStringChars(a, chars);
+    writeStringChars(b, chars + aLength);
+    chars[length] = '\0';
+    return takeStringValue(chars, length);
+  }
+
+  ObjString* left = materializeString(a);
+  push(OBJ_VAL(left));
+  ObjString* right = materializeString(b);
+  push(OBJ_VAL(right));
+
+  ObjString* rope = ALLOCATE_OBJ(ObjString, OBJ_STRING);
+  rope->length = length;
+  rope->chars = NULL;
+  rope->hash = 0;
+  rope->hasHash = false;
+  rope->isInterned = false;
+  rope->isMapped = false;
+  rope->left = left;
+  rope->right = right;
+  rope->base = NULL;
+  rope->charCount = -1;
+  rope->charIndex = NULL;
+  pop();
+  pop();
+  return OBJ_VAL(rope);
+}
+
+// Slices shorter than this are copied. Below it a copy costs about as
+// much as the slice object and doesn't keep a large parent alive.
+#define SLICE_SHARE_MIN 16
+
+// Returns the bytes from start up to end. The string must be reachable
+// by the GC.
+Value sliceString(Value string, int start, int end) {
+  int length = end - start;
+  if (IS_SHORT_STRING(string)) {
+    char chars[SHORT_STRING_MAX];
+    unpackShortString(string, chars);
+    return copyStringValue(chars + start, length);
+  }
+
+  ObjString* parent = AS_STRING(string);
+  if (length == parent->length) return string;
+  flattenString(parent);
+  return sliceBuffer(parent, start, end);
+}
+
+// Like sliceString(), but never returns [buffer] itself. The readers use
+// it for their block strings, which are still being filled or mapped.
+Value sliceBuffer(ObjString* buffer, int start, int end) {
+  int length = end - start;
+  if (length < SLICE_SHARE_MIN) {
+    return copyStringValue(buffer->chars + start, length);
+  }
+
+  ObjString* slice = allocateTransientString(buffer->chars + start, length);
+  slice->base = buffer->base != NULL ? buffer->base : buffer;
+  return OBJ_VAL(slice);
+}
+
+// Returns the characters of any string value, flattening a rope. A
+// short string is unpacked into buffer, which must hold
+// SHORT_STRING_MAX bytes.
+const char* stringValueChars(Value value, char* buffer, int* length) {
+  if (IS_SHORT_STRING(value)) {
+    *length = unpackShortString(value, buffer);
+    return buffer;
+  }
+
+  ObjString* string = AS_STRING(value);
+  flattenString(string);
+  *length = string->length;
+  return string->chars;
+}
+
+void flattenString(ObjString* string) {
+  if (!IS_ROPE(string)) return;
+
+  char* chars = ALLOCATE(char, string->length + 1);
+  chars[string->length] = '\0';
+
+  // Fill the buffer from the end. A rope built by appending in a loop
+  // leans left, so visiting the right child first keeps the explicit
+  // stack at a couple of entries no matter how deep the rope is.
+  int capacity = 8;
+  int count = 0;
+  ObjString** stack = (ObjString**)malloc(sizeof(ObjString*) * capacity);
+  if (stack == NULL) exit(1);
+  stack[count++] = string;
+
+  char* end = chars + string->length;
+  while (count > 0) {
+    ObjString* node = stack[--count];
+    if (!IS_ROPE(node)) {
+      end -= node->length;
+      memcpy(end, node->chars, node->length);
+      continue;
+    }
+
+    if (capacity < count + 2) {
+      capacity *= 2;
+      stack = (ObjString**)realloc(stack, sizeof(ObjString*) * capacity);
+      if (stack == NULL) exit(1);
+    }
+    stack[count++] = node->left;
+    stack[count++] = node->right;
+  }
+  free(stack);
+
+  string->chars = chars;
+  string->left = NULL;
+  string->right = NULL;
+}
+
+bool stringsEqual(ObjString* a, ObjString* b) {
+  if (a == b) return true;
+  // Interned strings are unique, so two of them are never equal.
+  if (a->isInterned && b->isInterned) return false;
+  if (a->length != b->length) return false;
+  if (a->hasHash && b->hasHash && a->hash != b->hash) return false;
+
+  flattenString(a);
+  flattenString(b);
+  return memcmp(a->chars, b->chars, a->length) == 0;
+}
+
+bool stringValuesEqual(Value a, Value b) {
+  if (IS_STRING(a) && IS_STRING(b)) {
+    return stringsEqual(AS_STRING(a), AS_STRING(b));
+  }
+  if (IS_SHORT_STRING(a) && IS_SHORT_STRING(b)) {
+    return AS_SHORT_STRING(a) == AS_SHORT_STRING(b);
+  }
+
+  // Runtime strings this short are always packed, but compiler-made
+  // heap strings can still meet a packed one.
+  Value packed = IS_SHORT_STRING(a) ? a : b;
+  ObjString* string = AS_STRING(IS_SHORT_STRING(a) ? b : a);
+  char chars[SHORT_STRING_MAX];
+  int length = unpackShortString(packed, chars);
+  if (string->length != length) return false;
+  return memcmp(string->chars, chars, length) == 0;
+}
 //> Closures new-upvalue
 ObjUpvalue* newUpvalue(Value* slot) {
   ObjUpvalue* upvalue = ALLOCATE_OBJ(ObjUpvalue, OBJ_UPVALUE);
@@ -206,13 +553,46 @@ ObjUpvalue* newUpvalue(Value* slot) {
 static void printFunction(ObjFunction* function) {
 //> print-script
   if (function->name == NULL) {
-    printf("<script>");
+    writeOutput("<script>", 8);
     return;
   }
 //< print-script
-  printf("<fn %s>", function->name->chars);
+  writeOutput("<fn ", 4);
+  printString(function->name);
+  writeOutput(">", 1);
 }
 //< Calls and Functions print-function-helper
+// Prints without flattening, so it is safe to call from the GC's debug
+// logging where allocating would be a problem.
+void printString(ObjString* string) {
+  if (!IS_ROPE(string)) {
+    writeOutput(string->chars, string->length);
+    return;
+  }
+
+  int capacity = 8;
+  int count = 0;
+  ObjString** stack = (ObjString**)malloc(sizeof(ObjString*) * capacity);
+  if (stack == NULL) exit(1);
+  stack[count++] = string;
+
+  while (count > 0) {
+    ObjString* node = stack[--count];
+    if (!IS_ROPE(node)) {
+      writeOutput(node->chars, node->length);
+      continue;
+    }
+
+    if (capacity < count + 2) {
+      capacity *= 2;
+      stack = (ObjString**)realloc(stack, sizeof(ObjString*) * capacity);
+      if (stack == NULL) exit(1);
+    }
+    stack[count++] = node->right;
+    stack[count++] = node->left;
+  }
+  free(stack);
+}
 //> print-object
 void printObject(Value value) {
   switch (OBJ_TYPE(value)) {
@@ -223,7 +603,7 @@ void printObject(Value value) {
 //< Methods and Initializers print-bound-method
 //> Classes and Instances print-class
     case OBJ_CLASS:
-      printf("%s", AS_CLASS(value)->name->chars);
+      printString(AS_CLASS(value)->name);
       break;
 
 //< Classes and Instances print-class
@@ -239,32 +619,57 @@ void printObject(Value value) {
 //< Calls and Functions print-function
 //> Classes and Instances print-instance
     case OBJ_INSTANCE:
-      printf("%s instance",
-             AS_INSTANCE(value)->klass->name->chars);
+      printString(AS_INSTANCE(value)->klass->name);
+      writeOutput(" instance", 9);
       break;
 //< Classes and Instances print-instance
 //> Calls and Functions print-native
     case OBJ_NATIVE:
-      printf("<native fn>");
+      writeOutput("<native fn>", 11);
       break;
 //< Calls and Functions print-native
     case OBJ_STRING:
-      printf("%s", AS_CSTRING(value));
+      printString(AS_STRING(value));
       break;
 //> Closures print-upvalue
     case OBJ_UPVALUE:
-      printf("upvalue");
+      writeOutput("upvalue", 7);
       break;
     case OBJ_LIST: {
       ObjList* list = AS_LIST(value);
-      printf("[");
+      writeOutput("[", 1);
       for (int i = 0; i < list->items.count; i++) {
         printValue(list->items.values[i]); // Note: it calls printValue, not printObject
-        if (i < list->items.count - 1) printf(", ");
+        if (i < list->items.count - 1) writeOutput(", ", 2);
       }
-      printf("]");
+      writeOutput("]", 1);
       break;
     }  
+    case OBJ_MAP: {
+      ObjMap* map = AS_MAP(value);
+      bool first = true;
+      writeOutput("{", 1);
+      for (int i = 0; i < map->capacity; i++) {
+        MapEntry* entry = &map->entries[i];
+        if (IS_NIL(entry->key)) continue;
+
+        if (!first) writeOutput(", ", 2);
+        printValue(entry->key);
+        writeOutput(": ", 2);
+        printValue(entry->value);
+        first = false;
+      }
+      writeOutput("}", 1);
+      break;
+    }
+    case OBJ_FILE:
+      writeOutput("<skedar ", 8);
+      printString(AS_FILE(value)->path);
+      writeOutput(">", 1);
+      break;
+    case OBJ_COROUTINE:
+      writeOutputString("<korutine>");
+      break;
 //< Closures print-upvalue
   }
 }
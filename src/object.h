@@ -9,6 +9,7 @@
 //> Classes and Instances object-include-table
 #include "table.h"
 //< Classes and Instances object-include-table
+#include "input.h"
 #include "value.h"
 //> obj-type-macro
 
@@ -36,6 +37,8 @@
 //< Calls and Functions is-native
 #define IS_STRING(value)       isObjType(value, OBJ_STRING)
 //< is-string
+#define IS_ANY_STRING(value) \
+    (IS_STRING(value) || IS_SHORT_STRING(value))
 //> as-string
 typedef Value (*NativeFn)(int argCount, Value* args);
 //> Methods and Initializers as-bound-method
@@ -85,6 +88,9 @@ typedef enum {
 //> Closures obj-type-upvalue
   OBJ_UPVALUE,
    OBJ_LIST ,
+  OBJ_MAP,
+  OBJ_FILE,
+  OBJ_COROUTINE,
 //< Closures obj-type-upvalue
 } ObjType;
 //< obj-type
@@ -128,8 +134,33 @@ struct ObjString {
 //> Hash Tables obj-string-hash
   uint32_t hash;
 //< Hash Tables obj-string-hash
+  // Strings made at runtime start out transient: they are not in
+  // vm.strings and their hash is only computed when first needed.
+  bool hasHash;
+  bool isInterned;
+  // The characters are a read-only mmap() of a file and are unmapped
+  // when the string is freed. Such a string is only ever seen through
+  // slices.
+  bool isMapped;
+  // A string built by concatenation starts out as a rope: chars is
+  // NULL and the contents are left followed by right. The characters
+  // are only materialized by flattenString() when something needs them.
+  ObjString* left;
+  ObjString* right;
+  // A slice made by sliceString() points into base's characters instead
+  // of owning a copy, so its chars are not NUL-terminated.
+  ObjString* base;
+  // The number of UTF-8 code points, or -1 until first needed. When it
+  // equals length every byte is a character of its own.
+  int charCount;
+  // For long strings with multibyte characters, the byte offset of
+  // every CHAR_INDEX_STRIDE-th character, built on first indexing.
+  int* charIndex;
 };
 //< obj-string
+
+#define IS_ROPE(string)        ((string)->chars == NULL)
+#define CHAR_INDEX_STRIDE 64
 //> Closures obj-upvalue
 typedef struct ObjUpvalue {
   Obj obj;
@@ -153,11 +184,94 @@ typedef struct {
 } ObjClosure;
 //< Closures obj-closure
 //> Classes and Instances obj-class
-typedef struct {
+typedef struct ObjList {
     Obj obj;
     ValueArray items; // A list is just a dynamic array of Values!
+    // If true, every item is a number and the GC doesn't scan the list.
+    // It may be false for a list that holds only numbers, for example
+    // after the last string is overwritten. listIsNumeric() rescans the
+    // items then and sets it back.
+    bool isNumeric;
+    // A slice shares the items of a hidden, never-modified list until
+    // either side is written. Its items then point into the base list's
+    // array, and items.capacity is zero since the slice doesn't own them.
+    struct ObjList* base;
 } ObjList;
 
+// A map slot with a nil key is empty, or a tombstone if its value is
+// true. Nil is not a valid key.
+typedef struct {
+  Value key;
+  Value value;
+} MapEntry;
+
+typedef struct {
+  Obj obj;
+  int count;
+  int tombstones;
+  int capacity;
+  MapEntry* entries;
+} ObjMap;
+
+#define FILE_MAX_PIECES 64
+
+typedef struct ObjFile {
+  Obj obj;
+  ObjString* path;
+  bool isOpen;
+  bool isReadable;
+  bool isWritable;
+  // A listening socket, which can only accept connections.
+  bool isListening;
+  // Reads go through the same block reader as stdin. A mapped file is a
+  // single block holding all of it. input.fd is also where writes go.
+  InputBuffer input;
+  // Writes wait here as pieces for a single writev(). Short ones are
+  // copied into buffer. Long strings are written from their own
+  // characters and kept alive in pending until then.
+  char* buffer;
+  int bufferLength;
+  const char* pieceChars[FILE_MAX_PIECES];
+  int pieceLengths[FILE_MAX_PIECES];
+  int pieceCount;
+  bool lastPieceBuffered;
+  ValueArray pending;
+  // The next file in vm.openFiles.
+  struct ObjFile* next;
+} ObjFile;
+
+typedef enum {
+  // Not started yet, or stopped in jep().
+  COROUTINE_SUSPENDED,
+  // Running, or waiting on a coroutine it resumed or in the event loop.
+  COROUTINE_RUNNING,
+  COROUTINE_DONE,
+} CoroutineState;
+
+// A value stack and its call frames. The VM runs on one at a time, and
+// the others keep where they stopped in here.
+typedef struct {
+  Value* stack;
+  Value* stackTop;
+  struct CallFrame* frames;
+  int frameCount;
+  int baseFrameCount;
+  // Each stack has its own open upvalues, sorted by slot like the VM's.
+  ObjUpvalue* openUpvalues;
+} CallStack;
+
+typedef struct ObjCoroutine {
+  Obj obj;
+  CoroutineState state;
+  ObjClosure* closure;
+  CallStack stack;
+  // While it runs, the coroutine to go back to when it yields or
+  // returns, or NULL for the main stack.
+  struct ObjCoroutine* resumer;
+  // Started by the event loop instead of by vazhdo().
+  bool isTask;
+} ObjCoroutine;
+
 typedef struct {
   Obj obj;
   ObjString* name;
@@ -183,6 +297,17 @@ typedef struct {
 } ObjBoundMethod;
 #define IS_LIST(value) isObjType(value, OBJ_LIST)
 #define AS_LIST(value) ((ObjList*)AS_OBJ(value))
+#ifdef NAN_BOXING
+// A NaN-boxed number is its double, so a numeric list's items already
+// form a plain double array.
+#define LIST_NUMBERS(list) ((double*)(list)->items.values)
+#endif
+#define IS_MAP(value) isObjType(value, OBJ_MAP)
+#define AS_MAP(value) ((ObjMap*)AS_OBJ(value))
+#define IS_FILE(value) isObjType(value, OBJ_FILE)
+#define AS_FILE(value) ((ObjFile*)AS_OBJ(value))
+#define IS_COROUTINE(value) isObjType(value, OBJ_COROUTINE)
+#define AS_COROUTINE(value) ((ObjCoroutine*)AS_OBJ(value))
 
 //< Methods and Initializers obj-bound-method
 //> Methods and Initializers new-bound-method-h
@@ -209,11 +334,33 @@ ObjString* takeString(char* chars, int length);
 //< take-string-h
 //> copy-string-h
 ObjString* copyString(const char* chars, int length);
+ObjString* takeTransientString(char* chars, int length);
+ObjString* copyTransientString(const char* chars, int length);
+uint32_t stringHash(ObjString* string);
+ObjString* internString(ObjString* string);
+Value copyStringValue(const char* chars, int length);
+Value takeStringValue(char* chars, int length);
+int stringValueLength(Value value);
+ObjString* materializeString(Value value);
+Value concatenateStrings(Value a, Value b);
+Value sliceString(Value string, int start, int end);
+Value sliceBuffer(ObjString* buffer, int start, int end);
+const char* stringValueChars(Value value, char* buffer, int* length);
+void flattenString(ObjString* string);
+bool stringsEqual(ObjString* a, ObjString* b);
+bool stringValuesEqual(Value a, Value b);
 //> Closures new-upvalue-h
 ObjUpvalue* newUpvalue(Value* slot);
 ObjList* newList(); 
+void makeListWritable(ObjList* list);
+void appendToList(ObjList* list, Value value);
+void storeInList(ObjList* list, int index, Value value);
+ObjMap* newMap();
+ObjFile* newFile(ObjString* path);
+ObjCoroutine* newCoroutine(ObjClosure* closure);
 //< Closures new-upvalue-h
 //> print-object-h
+void printString(ObjString* string);
 void printObject(Value value);
 //< print-object-h
 
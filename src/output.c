@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <io.h>
+#define isatty _isatty
+#define fileno _fileno
+#else
+#include <unistd.h>
+#endif
+
+#include "dtoa.h"
+#include "output.h"
+#include "vm.h"
+
+// The debug logging writes straight to stdout, so those builds flush
+// after every write to keep it in order with the script's output.
+#if defined(DEBUG_PRINT_CODE) || defined(DEBUG_TRACE_EXECUTION) || \
+    defined(DEBUG_LOG_GC)
+#define OUTPUT_UNBUFFERED
+#endif
+
+void initOutput() {
+  vm.output.length = 0;
+  vm.output.lineBuffered = isatty(fileno(stdout));
+}
+
+void flushOutput() {
+  OutputBuffer* output = &vm.output;
+  if (output->length > 0) {
+    fwrite(output->chars, 1, output->length, stdout);
+    output->length = 0;
+  }
+  fflush(stdout);
+}
+
+static void finishWrite(const char* chars, int length) {
+#ifdef OUTPUT_UNBUFFERED
+  flushOutput();
+#else
+  if (vm.output.lineBuffered && memchr(chars, '\n', length) != NULL) {
+    flushOutput();
+  }
+#endif
+}
+
+void writeOutput(const char* chars, int length) {
+  OutputBuffer* output = &vm.output;
+  if (output->length + length > OUTPUT_BUFFER_SIZE) {
+    flushOutput();
+
+    // Too big to be worth copying.
+    if (length > OUTPUT_BUFFER_SIZE / 2) {
+      fwrite(chars, 1, length, stdout);
+      if (output->lineBuffered) fflush(stdout);
+      return;
+    }
+  }
+
+  memcpy(output->chars + output->length, chars, length);
+  output->length += length;
+  finishWrite(chars, length);
+}
+
+void writeOutputString(const char* string) {
+  writeOutput(string, (int)strlen(string));
+}
+
+void writeOutputNumber(double number) {
+  OutputBuffer* output = &vm.output;
+  if (output->length + NUMBER_BUFFER_SIZE > OUTPUT_BUFFER_SIZE) {
+    flushOutput();
+  }
+
+  char* chars = output->chars + output->length;
+  int length = formatNumber(number, chars);
+  output->length += length;
+  finishWrite(chars, length);
+}
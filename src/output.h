@@ -0,0 +1,24 @@
+#ifndef clox_output_h
+#define clox_output_h
+
+#include "common.h"
+
+#define OUTPUT_BUFFER_SIZE (64 * 1024)
+
+// Everything a script prints collects here and goes to stdout in big
+// writes. The buffer is flushed when it fills, before reading input or
+// reporting an error, and at exit. When stdout is a terminal it is also
+// flushed after every line so output still shows up as it is printed.
+typedef struct {
+  char chars[OUTPUT_BUFFER_SIZE];
+  int length;
+  bool lineBuffered;
+} OutputBuffer;
+
+void initOutput();
+void writeOutput(const char* chars, int length);
+void writeOutputString(const char* string);
+void writeOutputNumber(double number);
+void flushOutput();
+
+#endif
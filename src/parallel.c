@@ -0,0 +1,591 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#include "list.h"
+#include "memory.h"
+#include "output.h"
+#include "parallel.h"
+#include "table.h"
+#include "vm.h"
+
+static bool checkFunction(Value function) {
+  if (!IS_CLOSURE(function)) {
+    nativeError("Expected a function.");
+    return false;
+  }
+  if (AS_CLOSURE(function)->upvalueCount > 0) {
+    nativeError("A function run by workers can't capture variables.");
+    return false;
+  }
+  return true;
+}
+
+#ifdef _WIN32
+
+// Without threads the items are handled in order, in this VM.
+
+bool parallelMap(ObjList* list, Value function, Value* result) {
+  if (!checkFunction(function)) return false;
+
+  ObjList* results = newList();
+  push(OBJ_VAL(results));
+  for (int i = 0; i < list->items.count; i++) {
+    push(function);
+    push(list->items.values[i]);
+    if (!callFromNative(function, 1)) return false;
+    appendToList(results, vm.stackTop[-1]);
+    pop();
+  }
+  *result = pop();
+  return true;
+}
+
+bool parallelReduce(ObjList* list, Value function, Value initial,
+                    Value* result) {
+  if (!checkFunction(function)) return false;
+
+  Value accumulator = initial;
+  for (int i = 0; i < list->items.count; i++) {
+    push(function);
+    push(accumulator);
+    push(list->items.values[i]);
+    if (!callFromNative(function, 2)) return false;
+    accumulator = pop();
+  }
+  *result = accumulator;
+  return true;
+}
+
+#else
+
+#define MAX_WORKERS 64
+// Deeper lists, including any list that holds itself, can't be copied.
+#define MAX_PACK_DEPTH 64
+
+// Values copied out of one VM to be made again in another.
+typedef struct {
+  uint8_t* bytes;
+  size_t length;
+  size_t capacity;
+} Packed;
+
+typedef enum {
+  PACK_NIL,
+  PACK_FALSE,
+  PACK_TRUE,
+  PACK_NUMBER,
+  PACK_STRING,
+  // An interned string, like the names the compiler stores as constants.
+  PACK_NAME,
+  PACK_LIST,
+  PACK_FUNCTION,
+} PackTag;
+
+typedef struct {
+  Packed* packed;
+  // Functions may only be packed along with the code that runs them.
+  bool allowFunctions;
+  // Every string constant of the packed functions. Those that name a
+  // global are packed too.
+  ObjString** names;
+  int nameCount;
+  int nameCapacity;
+} Packer;
+
+static void packBytes(Packed* packed, const void* bytes, size_t length) {
+  if (packed->length + length > packed->capacity) {
+    size_t capacity = packed->capacity < 256 ? 256 : packed->capacity;
+    while (capacity < packed->length + length) capacity *= 2;
+    packed->bytes = (uint8_t*)realloc(packed->bytes, capacity);
+    if (packed->bytes == NULL) {
+      fprintf(stderr, "Not enough memory for the workers.\n");
+      exit(70);
+    }
+    packed->capacity = capacity;
+  }
+  memcpy(packed->bytes + packed->length, bytes, length);
+  packed->length += length;
+}
+
+static void packByte(Packed* packed, uint8_t byte) {
+  packBytes(packed, &byte, 1);
+}
+
+static void packInt(Packed* packed, uint32_t value) {
+  packBytes(packed, &value, sizeof(value));
+}
+
+static void addName(Packer* packer, ObjString* name) {
+  for (int i = 0; i < packer->nameCount; i++) {
+    if (packer->names[i] == name) return;
+  }
+
+  if (packer->nameCount == packer->nameCapacity) {
+    packer->nameCapacity = packer->nameCapacity < 8
+        ? 8 : packer->nameCapacity * 2;
+    packer->names = (ObjString**)realloc(packer->names,
+        packer->nameCapacity * sizeof(ObjString*));
+    if (packer->names == NULL) {
+      fprintf(stderr, "Not enough memory for the workers.\n");
+      exit(70);
+    }
+  }
+  packer->names[packer->nameCount++] = name;
+}
+
+static void packString(Packer* packer, ObjString* string) {
+  flattenString(string);
+  packByte(packer->packed, string->isInterned ? PACK_NAME : PACK_STRING);
+  packInt(packer->packed, (uint32_t)string->length);
+  packBytes(packer->packed, string->chars, string->length);
+}
+
+static bool packValue(Packer* packer, Value value, int depth);
+
+static bool packFunction(Packer* packer, ObjFunction* function) {
+  Packed* packed = packer->packed;
+  Chunk* chunk = &function->chunk;
+  packByte(packed, PACK_FUNCTION);
+  packInt(packed, (uint32_t)function->arity);
+  packInt(packed, (uint32_t)function->upvalueCount);
+  if (function->name == NULL) {
+    packByte(packed, PACK_NIL);
+  } else {
+    packString(packer, function->name);
+  }
+  packInt(packed, (uint32_t)chunk->count);
+  packBytes(packed, chunk->code, chunk->count);
+  packBytes(packed, chunk->lines, chunk->count * sizeof(int));
+
+  // Constants are numbers, strings, functions and the list templates
+  // OP_CONSTANT_LIST copies, which pack like any other list.
+  packInt(packed, (uint32_t)chunk->constants.count);
+  for (int i = 0; i < chunk->constants.count; i++) {
+    Value constant = chunk->constants.values[i];
+    if (IS_FUNCTION(constant)) {
+      if (!packFunction(packer, AS_FUNCTION(constant))) return false;
+    } else {
+      if (IS_STRING(constant)) addName(packer, AS_STRING(constant));
+      if (!packValue(packer, constant, 0)) return false;
+    }
+  }
+  return true;
+}
+
+// Reports the value that can't be copied.
+static bool packValue(Packer* packer, Value value, int depth) {
+  Packed* packed = packer->packed;
+  if (IS_NIL(value)) {
+    packByte(packed, PACK_NIL);
+  } else if (IS_BOOL(value)) {
+    packByte(packed, AS_BOOL(value) ? PACK_TRUE : PACK_FALSE);
+  } else if (IS_NUMBER(value)) {
+    double number = AS_NUMBER(value);
+    packByte(packed, PACK_NUMBER);
+    packBytes(packed, &number, sizeof(number));
+  } else if (IS_SHORT_STRING(value)) {
+    char chars[SHORT_STRING_MAX];
+    int length = unpackShortString(value, chars);
+    packByte(packed, PACK_STRING);
+    packInt(packed, (uint32_t)length);
+    packBytes(packed, chars, length);
+  } else if (IS_STRING(value)) {
+    packString(packer, AS_STRING(value));
+  } else if (IS_LIST(value) && depth < MAX_PACK_DEPTH) {
+    ObjList* list = AS_LIST(value);
+    packByte(packed, PACK_LIST);
+    packInt(packed, (uint32_t)list->items.count);
+    for (int i = 0; i < list->items.count; i++) {
+      if (!packValue(packer, list->items.values[i], depth + 1)) {
+        return false;
+      }
+    }
+  } else if (IS_CLOSURE(value) && packer->allowFunctions &&
+             AS_CLOSURE(value)->upvalueCount == 0) {
+    return packFunction(packer, AS_CLOSURE(value)->function);
+  } else {
+    nativeError("Only nil, booleans, numbers, strings and lists can be "
+                "passed to workers.");
+    return false;
+  }
+  return true;
+}
+
+// Whether packValue() would take the value along with a function.
+static bool isPackable(Value value, int depth) {
+  if (IS_CLOSURE(value)) return AS_CLOSURE(value)->upvalueCount == 0;
+  if (!IS_LIST(value)) {
+    return IS_NIL(value) || IS_BOOL(value) || IS_NUMBER(value) ||
+           IS_ANY_STRING(value);
+  }
+  if (depth == MAX_PACK_DEPTH) return false;
+
+  ObjList* list = AS_LIST(value);
+  for (int i = 0; i < list->items.count; i++) {
+    if (!isPackable(list->items.values[i], depth + 1)) return false;
+  }
+  return true;
+}
+
+// Packs the function, followed by a name and value for each global that
+// it, or a function packed with it, names.
+static bool packCode(Packed* packed, Value function) {
+  Packer packer;
+  packer.packed = packed;
+  packer.allowFunctions = true;
+  packer.names = NULL;
+  packer.nameCount = 0;
+  packer.nameCapacity = 0;
+
+  bool succeeded = packValue(&packer, function, 0);
+  for (int i = 0; succeeded && i < packer.nameCount; i++) {
+    Value value;
+    if (!tableGet(&vm.globals, packer.names[i], &value)) continue;
+    // Workers have natives of their own.
+    if (!isPackable(value, 0)) continue;
+
+    packString(&packer, packer.names[i]);
+    succeeded = packValue(&packer, value, 0);
+  }
+  free(packer.names);
+  return succeeded;
+}
+
+static bool packData(Packed* packed, Value value) {
+  Packer packer;
+  packer.packed = packed;
+  packer.allowFunctions = false;
+  packer.names = NULL;
+  packer.nameCount = 0;
+  packer.nameCapacity = 0;
+  return packValue(&packer, value, 0);
+}
+
+typedef struct {
+  const uint8_t* current;
+  const uint8_t* end;
+} Unpacker;
+
+static uint32_t unpackInt(Unpacker* unpacker) {
+  uint32_t value;
+  memcpy(&value, unpacker->current, sizeof(value));
+  unpacker->current += sizeof(value);
+  return value;
+}
+
+static Value unpackValue(Unpacker* unpacker);
+
+static ObjFunction* unpackFunction(Unpacker* unpacker) {
+  ObjFunction* function = newFunction();
+  push(OBJ_VAL(function));
+  function->arity = (int)unpackInt(unpacker);
+  function->upvalueCount = (int)unpackInt(unpacker);
+  Value name = unpackValue(unpacker);
+  if (!IS_NIL(name)) function->name = AS_STRING(name);
+
+  Chunk* chunk = &function->chunk;
+  int count = (int)unpackInt(unpacker);
+  chunk->code = ALLOCATE(uint8_t, count);
+  chunk->lines = ALLOCATE(int, count);
+  chunk->count = count;
+  chunk->capacity = count;
+  memcpy(chunk->code, unpacker->current, count);
+  unpacker->current += count;
+  memcpy(chunk->lines, unpacker->current, count * sizeof(int));
+  unpacker->current += count * sizeof(int);
+
+  int constantCount = (int)unpackInt(unpacker);
+  for (int i = 0; i < constantCount; i++) {
+    Value constant;
+    if (*unpacker->current == PACK_FUNCTION) {
+      unpacker->current++;
+      constant = OBJ_VAL(unpackFunction(unpacker));
+    } else {
+      constant = unpackValue(unpacker);
+    }
+    push(constant);
+    writeValueArray(&chunk->constants, constant);
+    pop();
+  }
+
+  pop();
+  return function;
+}
+
+// The value is new, so the caller must keep it reachable.
+static Value unpackValue(Unpacker* unpacker) {
+  switch (*unpacker->current++) {
+    case PACK_FALSE: return BOOL_VAL(false);
+    case PACK_TRUE: return BOOL_VAL(true);
+    case PACK_NUMBER: {
+      double number;
+      memcpy(&number, unpacker->current, sizeof(number));
+      unpacker->current += sizeof(number);
+      return NUMBER_VAL(number);
+    }
+    case PACK_STRING:
+    case PACK_NAME: {
+      bool isName = unpacker->current[-1] == PACK_NAME;
+      int length = (int)unpackInt(unpacker);
+      const char* chars = (const char*)unpacker->current;
+      unpacker->current += length;
+      if (isName) return OBJ_VAL(copyString(chars, length));
+      return copyStringValue(chars, length);
+    }
+    case PACK_LIST: {
+      ObjList* list = newList();
+      push(OBJ_VAL(list));
+      int count = (int)unpackInt(unpacker);
+      reserveList(list, count);
+      for (int i = 0; i < count; i++) {
+        push(unpackValue(unpacker));
+        appendToList(list, vm.stackTop[-1]);
+        pop();
+      }
+      return pop();
+    }
+    case PACK_FUNCTION: {
+      push(OBJ_VAL(unpackFunction(unpacker)));
+      ObjClosure* closure = newClosure(AS_FUNCTION(vm.stackTop[-1]));
+      pop();
+      return OBJ_VAL(closure);
+    }
+    default:
+      return NIL_VAL;
+  }
+}
+
+typedef struct {
+  pthread_t thread;
+  const Packed* code;
+  // The worker's run of items, as one packed list.
+  Packed items;
+  // What the worker returns: a packed list for a map or a single value
+  // for a reduce.
+  Packed result;
+  bool reduce;
+  bool failed;
+} Worker;
+
+static THREAD_LOCAL Worker* currentWorker;
+
+// Does a worker's job inside its VM. It is called from a one-line
+// script so that callFromNative() has a frame to return to.
+static Value workNative(int argCount, Value* args) {
+  Worker* worker = currentWorker;
+
+  Unpacker unpacker;
+  unpacker.current = worker->code->bytes;
+  unpacker.end = worker->code->bytes + worker->code->length;
+  Value function = unpackValue(&unpacker);
+  push(function);
+  while (unpacker.current < unpacker.end) {
+    push(unpackValue(&unpacker));
+    push(unpackValue(&unpacker));
+    tableSet(&vm.globals, AS_STRING(vm.stackTop[-2]), vm.stackTop[-1]);
+    pop();
+    pop();
+  }
+
+  unpacker.current = worker->items.bytes;
+  unpacker.end = worker->items.bytes + worker->items.length;
+  ObjList* items = AS_LIST(unpackValue(&unpacker));
+  push(OBJ_VAL(items));
+
+  Value result;
+  if (worker->reduce) {
+    result = items->items.values[0];
+    for (int i = 1; i < items->items.count; i++) {
+      push(function);
+      push(result);
+      push(items->items.values[i]);
+      if (!callFromNative(function, 2)) return NIL_VAL;
+      result = pop();
+    }
+  } else {
+    ObjList* results = newList();
+    push(OBJ_VAL(results));
+    reserveList(results, items->items.count);
+    for (int i = 0; i < items->items.count; i++) {
+      push(function);
+      push(items->items.values[i]);
+      if (!callFromNative(function, 1)) return NIL_VAL;
+      appendToList(results, vm.stackTop[-1]);
+      pop();
+    }
+    result = OBJ_VAL(results);
+  }
+
+  // A result that can't be copied back has been reported already.
+  // Packing a rope flattens it, so the result has to stay rooted.
+  push(result);
+  packData(&worker->result, result);
+  pop();
+  return NIL_VAL;
+}
+
+static void* runWorker(void* argument) {
+  currentWorker = (Worker*)argument;
+  initVM();
+
+  push(OBJ_VAL(copyString("puno", 4)));
+  push(OBJ_VAL(newNative(workNative)));
+  tableSet(&vm.globals, AS_STRING(vm.stack[0]), vm.stack[1]);
+  pop();
+  pop();
+
+  static const char script[] = "puno();";
+  InterpretResult result = interpret(script, (int)sizeof(script) - 1);
+  currentWorker->failed = result != INTERPRET_OK;
+
+  freeVM();
+  return NULL;
+}
+
+static int workerCount(int itemCount) {
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  if (cores < 1) cores = 1;
+  if (cores > MAX_WORKERS) cores = MAX_WORKERS;
+  return itemCount < cores ? itemCount : (int)cores;
+}
+
+// Splits [list] into a run for each worker and runs them. On success
+// each worker's result is left packed in [workers].
+static bool runWorkers(ObjList* list, Value function, bool reduce,
+                       Worker* workers, int count, Packed* code) {
+  int itemCount = list->items.count;
+  for (int i = 0; i < count; i++) {
+    Worker* worker = &workers[i];
+    memset(worker, 0, sizeof(Worker));
+    worker->code = code;
+    worker->reduce = reduce;
+  }
+
+  if (!packCode(code, function)) return false;
+  for (int i = 0; i < count; i++) {
+    int start = (int)((long long)itemCount * i / count);
+    int end = (int)((long long)itemCount * (i + 1) / count);
+    Packed* items = &workers[i].items;
+    packByte(items, PACK_LIST);
+    packInt(items, (uint32_t)(end - start));
+    for (int j = start; j < end; j++) {
+      if (!packData(items, list->items.values[j])) return false;
+    }
+  }
+
+  // Anything this VM printed goes out before what the workers print.
+  flushOutput();
+
+  int started = 0;
+  while (started < count) {
+    if (pthread_create(&workers[started].thread, NULL, runWorker,
+                       &workers[started]) != 0) {
+      break;
+    }
+    started++;
+  }
+
+  bool failed = started < count;
+  for (int i = 0; i < started; i++) {
+    pthread_join(workers[i].thread, NULL);
+    if (workers[i].failed) failed = true;
+  }
+
+  if (started < count) {
+    nativeError("Could not start a worker thread.");
+    return false;
+  }
+  if (failed) {
+    nativeError("A worker failed.");
+    return false;
+  }
+  return true;
+}
+
+static void freeWorkers(Worker* workers, int count, Packed* code) {
+  for (int i = 0; i < count; i++) {
+    free(workers[i].items.bytes);
+    free(workers[i].result.bytes);
+  }
+  free(code->bytes);
+}
+
+bool parallelMap(ObjList* list, Value function, Value* result) {
+  if (!checkFunction(function)) return false;
+
+  Worker workers[MAX_WORKERS];
+  int count = workerCount(list->items.count);
+  Packed code = {NULL, 0, 0};
+  if (!runWorkers(list, function, false, workers, count, &code)) {
+    freeWorkers(workers, count, &code);
+    return false;
+  }
+
+  ObjList* results = newList();
+  push(OBJ_VAL(results));
+  reserveList(results, list->items.count);
+  for (int i = 0; i < count; i++) {
+    Unpacker unpacker;
+    unpacker.current = workers[i].result.bytes;
+    unpacker.end = unpacker.current + workers[i].result.length;
+
+    // Skip the list's tag and count and take its items one by one.
+    unpacker.current++;
+    int itemCount = (int)unpackInt(&unpacker);
+    for (int j = 0; j < itemCount; j++) {
+      push(unpackValue(&unpacker));
+      appendToList(results, vm.stackTop[-1]);
+      pop();
+    }
+  }
+
+  freeWorkers(workers, count, &code);
+  *result = pop();
+  return true;
+}
+
+bool parallelReduce(ObjList* list, Value function, Value initial,
+                    Value* result) {
+  if (!checkFunction(function)) return false;
+
+  Worker workers[MAX_WORKERS];
+  int count = workerCount(list->items.count);
+  Packed code = {NULL, 0, 0};
+  if (!runWorkers(list, function, true, workers, count, &code)) {
+    freeWorkers(workers, count, &code);
+    return false;
+  }
+
+  ObjList* partials = newList();
+  push(OBJ_VAL(partials));
+  for (int i = 0; i < count; i++) {
+    Unpacker unpacker;
+    unpacker.current = workers[i].result.bytes;
+    unpacker.end = unpacker.current + workers[i].result.length;
+    push(unpackValue(&unpacker));
+    appendToList(partials, vm.stackTop[-1]);
+    pop();
+  }
+  freeWorkers(workers, count, &code);
+
+  Value accumulator = initial;
+  for (int i = 0; i < partials->items.count; i++) {
+    push(function);
+    push(accumulator);
+    push(partials->items.values[i]);
+    if (!callFromNative(function, 2)) return false;
+    accumulator = pop();
+  }
+
+  pop();
+  *result = accumulator;
+  return true;
+}
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef clox_parallel_h
+#define clox_parallel_h
+
+#include "object.h"
+
+// Splits a list across worker threads, each running a VM of its own.
+// Values cross between VMs as copies, so only nil, booleans, numbers,
+// strings and lists of those can go in or come back. The function must
+// be a closure that captures no variables. It is copied to each worker
+// along with every global it names that can be copied the same way.
+//
+// Both report failures through nativeError() and return false.
+
+// Calls [function] on every item and stores a list of the results in
+// [result].
+bool parallelMap(ObjList* list, Value function, Value* result);
+// Folds the items with [function], starting from [initial]. Each worker
+// folds a run of items and the runs are then folded in order, so the
+// function has to be associative.
+bool parallelReduce(ObjList* list, Value function, Value initial,
+                    Value* result);
+
+#endif
@@ -8,14 +8,17 @@
 typedef struct {
   const char* start;
   const char* current;
+  // The source may be a mapped file, so nothing past end is read.
+  const char* end;
   int line;
 } Scanner;
 
-Scanner scanner;
+THREAD_LOCAL Scanner scanner;
 //> init-scanner
-void initScanner(const char* source) {
+void initScanner(const char* source, int length) {
   scanner.start = source;
   scanner.current = source;
+  scanner.end = source + length;
   scanner.line = 1;
 }
 //< init-scanner
@@ -33,7 +36,7 @@ static bool isDigit(char c) {
 //< is-digit
 //> is-at-end
 static bool isAtEnd() {
-  return *scanner.current == '\0';
+  return scanner.current == scanner.end;
 }
 //< is-at-end
 //> advance
@@ -44,12 +47,13 @@ static char advance() {
 //< advance
 //> peek
 static char peek() {
+  if (isAtEnd()) return '\0';
   return *scanner.current;
 }
 //< peek
 //> peek-next
 static char peekNext() {
-  if (isAtEnd()) return '\0';
+  if (scanner.end - scanner.current < 2) return '\0';
   return scanner.current[1];
 }
 //< peek-next
@@ -218,6 +222,7 @@ Token scanToken() {
     case '}': return makeToken(TOKEN_RIGHT_BRACE);
     case ';': return makeToken(TOKEN_SEMICOLON);
     case ',': return makeToken(TOKEN_COMMA);
+    case ':': return makeToken(TOKEN_COLON);
     case '.': return makeToken(TOKEN_DOT);
     case '-': return makeToken(TOKEN_MINUS);
     case '+': return makeToken(TOKEN_PLUS);
@@ -23,6 +23,7 @@ typedef enum {
   TOKEN_TRUE, TOKEN_VAR, TOKEN_WHILE,
   TOKEN_ERROR, TOKEN_EOF,
   TOKEN_LEFT_BRACKET, TOKEN_RIGHT_BRACKET, 
+  TOKEN_COLON,
 } TokenType;
 //< token-type
 //> token-struct
@@ -35,7 +36,7 @@ typedef struct {
 } Token;
 //< token-struct
 
-void initScanner(const char* source);
+void initScanner(const char* source, int length);
 //> scan-token-h
 Token scanToken();
 //< scan-token-h
@@ -0,0 +1,450 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "compiler.h"
+#include "memory.h"
+#include "output.h"
+#include "file.h"
+#include "server.h"
+#include "source.h"
+#include "vm.h"
+
+#ifdef _WIN32
+
+int runServer(const char* socketPath) {
+  fprintf(stderr, "Server mode needs Unix domain sockets.\n");
+  return 64;
+}
+
+bool runOnServer(const char* socketPath, const char* path,
+                 int argc, const char* argv[], int* exitCode) {
+  return false;
+}
+
+void markServerRoots() {}
+
+#else
+
+// A request is the client's stdin, stdout and stderr as SCM_RIGHTS
+// descriptors, sent along with the payload length. The payload follows:
+// the working directory, the script path and then its arguments, each
+// NUL-terminated. The reply is one byte, the script's exit status.
+#define REQUEST_MAX (1024 * 1024)
+
+typedef struct {
+  int fds[3];
+  char* payload;
+  const char** strings;
+  const char* directory;
+  const char* path;
+  int argc;
+  const char** argv;
+} Request;
+
+typedef struct {
+  dev_t device;
+  ino_t inode;
+  off_t size;
+  time_t modified;
+  long modifiedNanos;
+  ObjFunction* function;
+} CachedScript;
+
+// Maps each script path to its index in scripts.
+static Table scriptIndex;
+static CachedScript* scripts = NULL;
+static int scriptCount = 0;
+static int scriptCapacity = 0;
+
+void markServerRoots() {
+  markTable(&scriptIndex);
+  for (int i = 0; i < scriptCount; i++) {
+    markObject((Obj*)scripts[i].function);
+  }
+}
+
+static long modifiedNanos(struct stat* info) {
+#ifdef __APPLE__
+  return info->st_mtimespec.tv_nsec;
+#else
+  return info->st_mtim.tv_nsec;
+#endif
+}
+
+static bool isUnchanged(CachedScript* script, struct stat* info) {
+  return script->device == info->st_dev &&
+         script->inode == info->st_ino &&
+         script->size == info->st_size &&
+         script->modified == info->st_mtime &&
+         script->modifiedNanos == modifiedNanos(info);
+}
+
+// Returns the compiled script, compiling it only if it is new or has
+// changed on disk. Errors go to the client's stderr.
+static ObjFunction* loadScript(Request* request, int* exitCode) {
+  fflush(stderr);
+  int savedStderr = dup(2);
+  dup2(request->fds[2], 2);
+
+  ObjFunction* function = NULL;
+  ObjString* path = copyString(request->path, (int)strlen(request->path));
+  push(OBJ_VAL(path));
+
+  struct stat info;
+  Value index;
+  bool found = tableGet(&scriptIndex, path, &index);
+  if (stat(request->path, &info) != 0) {
+    fprintf(stderr, "Could not open file \"%s\".\n", request->path);
+    *exitCode = 74;
+  } else if (found &&
+             isUnchanged(&scripts[(int)AS_NUMBER(index)], &info)) {
+    function = scripts[(int)AS_NUMBER(index)].function;
+  } else {
+    Source source;
+    if (!readSource(request->path, &source)) {
+      *exitCode = 74;
+    } else {
+      function = compile(source.chars, (int)source.length);
+      freeSource(&source);
+      if (function == NULL) *exitCode = 65;
+    }
+
+    if (function != NULL) {
+      push(OBJ_VAL(function));
+      if (!found) {
+        if (scriptCapacity < scriptCount + 1) {
+          int oldCapacity = scriptCapacity;
+          scriptCapacity = GROW_CAPACITY(oldCapacity);
+          scripts = GROW_ARRAY(CachedScript, scripts,
+                               oldCapacity, scriptCapacity);
+        }
+        index = NUMBER_VAL(scriptCount++);
+        scripts[(int)AS_NUMBER(index)].function = NULL;
+        tableSet(&scriptIndex, path, index);
+      }
+
+      CachedScript* script = &scripts[(int)AS_NUMBER(index)];
+      script->device = info.st_dev;
+      script->inode = info.st_ino;
+      script->size = info.st_size;
+      script->modified = info.st_mtime;
+      script->modifiedNanos = modifiedNanos(&info);
+      script->function = function;
+      pop();
+    }
+  }
+
+  pop();
+  fflush(stderr);
+  dup2(savedStderr, 2);
+  close(savedStderr);
+  return function;
+}
+
+static bool readFully(int fd, char* buffer, size_t length) {
+  while (length > 0) {
+    ssize_t bytesRead = read(fd, buffer, length);
+    if (bytesRead < 0 && errno == EINTR) continue;
+    if (bytesRead <= 0) return false;
+    buffer += bytesRead;
+    length -= bytesRead;
+  }
+  return true;
+}
+
+static bool writeFully(int fd, const char* buffer, size_t length) {
+  while (length > 0) {
+    ssize_t written = write(fd, buffer, length);
+    if (written < 0 && errno == EINTR) continue;
+    if (written <= 0) return false;
+    buffer += written;
+    length -= written;
+  }
+  return true;
+}
+
+static void freeRequest(Request* request) {
+  for (int i = 0; i < 3; i++) {
+    if (request->fds[i] >= 0) close(request->fds[i]);
+  }
+  free(request->payload);
+  free(request->strings);
+}
+
+static bool readRequest(int connection, Request* request) {
+  request->fds[0] = request->fds[1] = request->fds[2] = -1;
+  request->payload = NULL;
+  request->strings = NULL;
+
+  uint32_t length;
+  char control[CMSG_SPACE(sizeof(int) * 3)];
+  struct iovec piece = { &length, sizeof(length) };
+  struct msghdr message;
+  memset(&message, 0, sizeof(message));
+  message.msg_iov = &piece;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+
+  ssize_t received;
+  do {
+    received = recvmsg(connection, &message, 0);
+  } while (received < 0 && errno == EINTR);
+
+  struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+  if (header != NULL && header->cmsg_level == SOL_SOCKET &&
+      header->cmsg_type == SCM_RIGHTS &&
+      header->cmsg_len == CMSG_LEN(sizeof(int) * 3)) {
+    memcpy(request->fds, CMSG_DATA(header), sizeof(int) * 3);
+  }
+  if (request->fds[2] < 0 || received != sizeof(length) ||
+      length == 0 || length > REQUEST_MAX) {
+    return false;
+  }
+
+  request->payload = (char*)malloc(length);
+  if (request->payload == NULL ||
+      !readFully(connection, request->payload, length) ||
+      request->payload[length - 1] != '\0') {
+    return false;
+  }
+
+  // Split the payload into its strings.
+  int count = 0;
+  for (uint32_t i = 0; i < length; i++) {
+    if (request->payload[i] == '\0') count++;
+  }
+  if (count < 2) return false;
+
+  request->strings = (const char**)malloc(sizeof(const char*) * count);
+  if (request->strings == NULL) return false;
+  const char* next = request->payload;
+  for (int i = 0; i < count; i++) {
+    request->strings[i] = next;
+    next += strlen(next) + 1;
+  }
+
+  request->directory = request->strings[0];
+  request->path = request->strings[1];
+  request->argc = count - 2;
+  request->argv = request->strings + 2;
+  return true;
+}
+
+static void sendStatus(int connection, int status) {
+  unsigned char byte = (unsigned char)status;
+  writeFully(connection, (const char*)&byte, 1);
+}
+
+// Runs in the forked child and never returns.
+static void runRequest(int connection, Request* request,
+                       ObjFunction* function) {
+  signal(SIGPIPE, SIG_DFL);
+  signal(SIGCHLD, SIG_DFL);
+
+  for (int i = 0; i < 3; i++) {
+    dup2(request->fds[i], i);
+    if (request->fds[i] > 2) close(request->fds[i]);
+  }
+  if (chdir(request->directory) != 0) {
+    fprintf(stderr, "Could not change to directory \"%s\".\n",
+            request->directory);
+  }
+
+  // stdout may be a terminal now.
+  initOutput();
+  setArguments(request->argc, request->argv);
+
+  InterpretResult result = interpretFunction(function);
+  flushOutput();
+  closeAllFiles();
+
+  int status = 0;
+  if (result == INTERPRET_COMPILE_ERROR) status = 65;
+  if (result == INTERPRET_RUNTIME_ERROR) status = 70;
+  sendStatus(connection, status);
+  _exit(status);
+}
+
+static int listenOn(const char* socketPath) {
+  struct sockaddr_un address;
+  if (strlen(socketPath) >= sizeof(address.sun_path)) {
+    fprintf(stderr, "Socket path \"%s\" is too long.\n", socketPath);
+    return -1;
+  }
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, socketPath);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    perror("socket");
+    return -1;
+  }
+
+  // A socket file left behind by an earlier server is replaced.
+  unlink(socketPath);
+  if (bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+      listen(fd, SOMAXCONN) != 0) {
+    fprintf(stderr, "Could not listen on \"%s\": %s.\n", socketPath,
+            strerror(errno));
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int runServer(const char* socketPath) {
+  int listener = listenOn(socketPath);
+  if (listener < 0) return 71;
+
+  // Children are reaped automatically, and a client going away mid-reply
+  // must not take the server down.
+  signal(SIGCHLD, SIG_IGN);
+  signal(SIGPIPE, SIG_IGN);
+  initTable(&scriptIndex);
+
+  for (;;) {
+    int connection = accept(listener, NULL, NULL);
+    if (connection < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      perror("accept");
+      close(listener);
+      return 71;
+    }
+
+    Request request;
+    if (readRequest(connection, &request)) {
+      int status = 0;
+      ObjFunction* function = loadScript(&request, &status);
+      if (function == NULL) {
+        sendStatus(connection, status);
+      } else {
+        fflush(stdout);
+        fflush(stderr);
+        pid_t pid = fork();
+        if (pid == 0) {
+          close(listener);
+          runRequest(connection, &request, function);
+        }
+        if (pid < 0) {
+          perror("fork");
+          sendStatus(connection, 71);
+        }
+      }
+    }
+
+    freeRequest(&request);
+    close(connection);
+  }
+}
+
+static int connectTo(const char* socketPath) {
+  struct sockaddr_un address;
+  if (strlen(socketPath) >= sizeof(address.sun_path)) return -1;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, socketPath);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+  if (connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static bool sendRequest(int connection, const char* payload,
+                        uint32_t length) {
+  int fds[3] = { 0, 1, 2 };
+  char control[CMSG_SPACE(sizeof(fds))];
+  memset(control, 0, sizeof(control));
+  struct iovec piece = { &length, sizeof(length) };
+  struct msghdr message;
+  memset(&message, 0, sizeof(message));
+  message.msg_iov = &piece;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+
+  struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+  header->cmsg_level = SOL_SOCKET;
+  header->cmsg_type = SCM_RIGHTS;
+  header->cmsg_len = CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(header), fds, sizeof(fds));
+
+  ssize_t sent;
+  do {
+    sent = sendmsg(connection, &message, 0);
+  } while (sent < 0 && errno == EINTR);
+  if (sent != sizeof(length)) return false;
+
+  return writeFully(connection, payload, length);
+}
+
+bool runOnServer(const char* socketPath, const char* path,
+                 int argc, const char* argv[], int* exitCode) {
+  // A missing script is left for the local run to report.
+  char directory[PATH_MAX];
+  char* script = realpath(path, NULL);
+  if (script == NULL || getcwd(directory, sizeof(directory)) == NULL) {
+    free(script);
+    return false;
+  }
+
+  size_t length = strlen(directory) + 1 + strlen(script) + 1;
+  for (int i = 0; i < argc; i++) length += strlen(argv[i]) + 1;
+  if (length > REQUEST_MAX) {
+    free(script);
+    return false;
+  }
+
+  char* payload = (char*)malloc(length);
+  if (payload == NULL) {
+    free(script);
+    return false;
+  }
+  char* next = payload;
+  const char* first[2] = { directory, script };
+  for (int i = 0; i < argc + 2; i++) {
+    const char* string = i < 2 ? first[i] : argv[i - 2];
+    size_t size = strlen(string) + 1;
+    memcpy(next, string, size);
+    next += size;
+  }
+  free(script);
+
+  int connection = connectTo(socketPath);
+  if (connection < 0) {
+    free(payload);
+    return false;
+  }
+
+  signal(SIGPIPE, SIG_IGN);
+  bool sent = sendRequest(connection, payload, (uint32_t)length);
+  free(payload);
+  if (!sent) {
+    close(connection);
+    return false;
+  }
+
+  // No reply means the script's process died.
+  unsigned char status;
+  *exitCode = readFully(connection, (char*)&status, 1) ? status : 70;
+  close(connection);
+  return true;
+}
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef clox_server_h
+#define clox_server_h
+
+#include "common.h"
+
+// The server keeps one warmed-up VM and forks it for every request, so
+// each script starts from a fresh copy without paying for initVM() or
+// for compiling a script it has already seen. Scripts run with the
+// client's own stdin, stdout and stderr, passed over the socket.
+int runServer(const char* socketPath);
+// Runs the script on the server at socketPath and sets exitCode to its
+// exit status. Returns false without running anything if there is no
+// server to talk to.
+bool runOnServer(const char* socketPath, const char* path,
+                 int argc, const char* argv[], int* exitCode);
+void markServerRoots();
+
+#endif
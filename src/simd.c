@@ -0,0 +1,561 @@
+#include <math.h>
+#include <string.h>
+
+#include "simd.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define SIMD_X86
+#define TARGET(isa) __attribute__((target(isa)))
+#endif
+
+// Reductions keep this many running partial results. Each version
+// assigns a[i] to lane i % LANES and folds the lanes the same way, which
+// is what keeps their results identical.
+#define LANES 16
+
+typedef struct {
+  double (*sum)(const double* a, int count);
+  double (*min)(const double* a, int count);
+  double (*max)(const double* a, int count);
+  double (*dot)(const double* a, const double* b, int count);
+  void (*scale)(double* a, int count, double factor);
+  void (*add)(double* a, const double* b, int count);
+  int (*indexOf)(const double* a, int count, double value);
+  int (*find)(const char* haystack, int length, const char* needle,
+              int needleLength);
+  int (*countCodePoints)(const char* chars, int length);
+} Kernels;
+
+// These match MINPD and MAXPD: when either side is NaN, y is kept.
+static inline double lesser(double x, double y) {
+  return x < y ? x : y;
+}
+
+static inline double greater(double x, double y) {
+  return x > y ? x : y;
+}
+
+// Folds the lanes in halves, then adds in the items left over after
+// the last full block.
+static double finishSum(double* lanes, const double* tail, int count) {
+  for (int width = LANES / 2; width > 0; width /= 2) {
+    for (int j = 0; j < width; j++) lanes[j] += lanes[j + width];
+  }
+
+  double total = lanes[0];
+  for (int i = 0; i < count; i++) total += tail[i];
+  return total;
+}
+
+static double finishDot(double* lanes, const double* a, const double* b,
+                        int count) {
+  for (int width = LANES / 2; width > 0; width /= 2) {
+    for (int j = 0; j < width; j++) lanes[j] += lanes[j + width];
+  }
+
+  double total = lanes[0];
+  for (int i = 0; i < count; i++) total += a[i] * b[i];
+  return total;
+}
+
+static double finishMin(double* lanes, const double* tail, int count) {
+  for (int width = LANES / 2; width > 0; width /= 2) {
+    for (int j = 0; j < width; j++) {
+      lanes[j] = lesser(lanes[j + width], lanes[j]);
+    }
+  }
+
+  double result = lanes[0];
+  for (int i = 0; i < count; i++) result = lesser(tail[i], result);
+  return result;
+}
+
+static double finishMax(double* lanes, const double* tail, int count) {
+  for (int width = LANES / 2; width > 0; width /= 2) {
+    for (int j = 0; j < width; j++) {
+      lanes[j] = greater(lanes[j + width], lanes[j]);
+    }
+  }
+
+  double result = lanes[0];
+  for (int i = 0; i < count; i++) result = greater(tail[i], result);
+  return result;
+}
+
+// Scalar -------------------------------------------------------------------
+
+static double sumScalar(const double* a, int count) {
+  double lanes[LANES] = {0};
+  int i = 0;
+  for (; i + LANES <= count; i += LANES) {
+    for (int j = 0; j < LANES; j++) lanes[j] += a[i + j];
+  }
+  return finishSum(lanes, a + i, count - i);
+}
+
+static double minScalar(const double* a, int count) {
+  double lanes[LANES];
+  for (int j = 0; j < LANES; j++) lanes[j] = INFINITY;
+  int i = 0;
+  for (; i + LANES <= count; i += LANES) {
+    for (int j = 0; j < LANES; j++) lanes[j] = lesser(a[i + j], lanes[j]);
+  }
+  return finishMin(lanes, a + i, count - i);
+}
+
+static double maxScalar(const double* a, int count) {
+  double lanes[LANES];
+  for (int j = 0; j < LANES; j++) lanes[j] = -INFINITY;
+  int i = 0;
+  for (; i + LANES <= count; i += LANES) {
+    for (int j = 0; j < LANES; j++) lanes[j] = greater(a[i + j], lanes[j]);
+  }
+  return finishMax(lanes, a + i, count - i);
+}
+
+static double dotScalar(const double* a, const double* b, int count) {
+  double lanes[LANES] = {0};
+  int i = 0;
+  for (; i + LANES <= count; i += LANES) {
+    for (int j = 0; j < LANES; j++) lanes[j] += a[i + j] * b[i + j];
+  }
+  return finishDot(lanes, a + i, b + i, count - i);
+}
+
+static void scaleScalar(double* a, int count, double factor) {
+  for (int i = 0; i < count; i++) a[i] *= factor;
+}
+
+static void addScalar(double* a, const double* b, int count) {
+  for (int i = 0; i < count; i++) a[i] += b[i];
+}
+
+static int indexOfScalar(const double* a, int count, double value) {
+  for (int i = 0; i < count; i++) {
+    if (a[i] == value) return i;
+  }
+  return -1;
+}
+
+// memchr() is vectorized in most C libraries, so the portable search
+// leans on it to find candidates for the first byte.
+static int findScalar(const char* haystack, int length, const char* needle,
+                      int needleLength) {
+  const char* p = haystack;
+  const char* last = haystack + length - needleLength;
+  while (p <= last) {
+    p = memchr(p, needle[0], last - p + 1);
+    if (p == NULL) return -1;
+    if (memcmp(p, needle, needleLength) == 0) return (int)(p - haystack);
+    p++;
+  }
+  return -1;
+}
+
+// Every byte but a UTF-8 continuation byte (10xxxxxx) starts a code
+// point. As a signed char those are exactly the ones above -65.
+static int countCodePointsScalar(const char* chars, int length) {
+  int count = 0;
+  for (int i = 0; i < length; i++) count += (signed char)chars[i] > -65;
+  return count;
+}
+
+static THREAD_LOCAL Kernels kernels = {
+  sumScalar, minScalar, maxScalar, dotScalar,
+  scaleScalar, addScalar, indexOfScalar, findScalar, countCodePointsScalar,
+};
+
+#ifdef SIMD_X86
+// SSE2 ---------------------------------------------------------------------
+
+// Two lanes per register, so eight accumulators cover all sixteen.
+#define SSE2_REGS (LANES / 2)
+
+TARGET("sse2")
+static double sumSse2(const double* a, int count) {
+  __m128d acc[SSE2_REGS];
+  for (int k = 0; k < SSE2_REGS; k++) acc[k] = _mm_setzero_pd();
+
+  int i = 0;
+  for (; i + LANES <= count; i += LANES) {
+    for (int k = 0; k < SSE2_REGS; k++) {
+      acc[k] = _mm_add_pd(acc[k], _mm_loadu_pd(a + i + 2 * k));
+    }
+  }
+
+  double lanes[LANES];
+  for (int k = 0; k < SSE2_REGS; k++) _mm_storeu_pd(lanes + 2 * k, acc[k]);
+  return finishSum(lanes, a + i, count - i);
+}
+
+TARGET("sse2")
+static double minSse2(const double* a, int count) {
+  __m128d acc[SSE2_REGS];
+  for (int k = 0; k < SSE2_REGS; k++) acc[k] = _mm_set1_pd(INFINITY);
+
+  int i = 0;
+  for (; i + LANES <= count; i += LANES) {
+    for (int k = 0; k < SSE2_REGS; k++) {
+      acc[k] = _mm_min_pd(_mm_loadu_pd(a + i + 2 * k), acc[k]);
+    }
+  }
+
+  double lanes[LANES];
+  for (int k = 0; k < SSE2_REGS; k++) _mm_storeu_pd(lanes + 2 * k, acc[k]);
+  return finishMin(lanes, a + i, count - i);
+}
+
+TARGET("sse2")
+static double maxSse2(const double* a, int count) {
+  __m128d acc[SSE2_REGS];
+  for (int k = 0; k < SSE2_REGS; k++) acc[k] = _mm_set1_pd(-INFINITY);
+
+  int i = 0;
+  for (; i + LANES <= count; i += LANES) {
+    for (int k = 0; k < SSE2_REGS; k++) {
+      acc[k] = _mm_max_pd(_mm_loadu_pd(a + i + 2 * k), acc[k]);
+    }
+  }
+
+  double lanes[LANES];
+  for (int k = 0; k < SSE2_REGS; k++) _mm_storeu_pd(lanes + 2 * k, acc[k]);
+  return finishMax(lanes, a + i, count - i);
+}
+
+TARGET("sse2")
+static double dotSse2(const double* a, const double* b, int count) {
+  __m128d acc[SSE2_REGS];
+  for (int k = 0; k < SSE2_REGS; k++) acc[k] = _mm_setzero_pd();
+
+  int i = 0;
+  for (; i + LANES <= count; i += LANES) {
+    for (int k = 0; k < SSE2_REGS; k++) {
+      __m128d product = _mm_mul_pd(_mm_loadu_pd(a + i + 2 * k),
+                                   _mm_loadu_pd(b + i + 2 * k));
+      acc[k] = _mm_add_pd(acc[k], product);
+    }
+  }
+
+  double lanes[LANES];
+  for (int k = 0; k < SSE2_REGS; k++) _mm_storeu_pd(lanes + 2 * k, acc[k]);
+  return finishDot(lanes, a + i, b + i, count - i);
+}
+
+TARGET("sse2")
+static void scaleSse2(double* a, int count, double factor) {
+  __m128d by = _mm_set1_pd(factor);
+  int i = 0;
+  for (; i + 2 <= count; i += 2) {
+    _mm_storeu_pd(a + i, _mm_mul_pd(_mm_loadu_pd(a + i), by));
+  }
+  for (; i < count; i++) a[i] *= factor;
+}
+
+TARGET("sse2")
+static void addSse2(double* a, const double* b, int count) {
+  int i = 0;
+  for (; i + 2 <= count; i += 2) {
+    _mm_storeu_pd(a + i, _mm_add_pd(_mm_loadu_pd(a + i),
+                                    _mm_loadu_pd(b + i)));
+  }
+  for (; i < count; i++) a[i] += b[i];
+}
+
+TARGET("sse2")
+static int indexOfSse2(const double* a, int count, double value) {
+  __m128d needle = _mm_set1_pd(value);
+  int i = 0;
+  for (; i + 4 <= count; i += 4) {
+    int low = _mm_movemask_pd(_mm_cmpeq_pd(_mm_loadu_pd(a + i), needle));
+    int high = _mm_movemask_pd(_mm_cmpeq_pd(_mm_loadu_pd(a + i + 2),
+                                            needle));
+    int mask = low | (high << 2);
+    if (mask != 0) return i + __builtin_ctz(mask);
+  }
+  for (; i < count; i++) {
+    if (a[i] == value) return i;
+  }
+  return -1;
+}
+
+// Compares a block of positions against both the first and the last
+// byte of the needle and only runs memcmp() where both match.
+TARGET("sse2")
+static int findSse2(const char* haystack, int length, const char* needle,
+                    int needleLength) {
+  __m128i first = _mm_set1_epi8(needle[0]);
+  __m128i last = _mm_set1_epi8(needle[needleLength - 1]);
+  int i = 0;
+  for (; i + needleLength - 1 + 16 <= length; i += 16) {
+    __m128i starts = _mm_loadu_si128((const __m128i*)(haystack + i));
+    __m128i ends = _mm_loadu_si128(
+        (const __m128i*)(haystack + i + needleLength - 1));
+    unsigned mask = (unsigned)_mm_movemask_epi8(
+        _mm_and_si128(_mm_cmpeq_epi8(starts, first),
+                      _mm_cmpeq_epi8(ends, last)));
+    while (mask != 0) {
+      int candidate = i + __builtin_ctz(mask);
+      if (memcmp(haystack + candidate, needle, needleLength) == 0) {
+        return candidate;
+      }
+      mask &= mask - 1;
+    }
+  }
+
+  int rest = findScalar(haystack + i, length - i, needle, needleLength);
+  return rest < 0 ? -1 : i + rest;
+}
+
+// Each byte lane counts the code points that start in it by subtracting
+// the compare mask (-1 per match). Lanes are folded into 64-bit sums
+// with SAD before they can reach 256.
+TARGET("sse2")
+static int countCodePointsSse2(const char* chars, int length) {
+  __m128i limit = _mm_set1_epi8(-65);
+  __m128i zero = _mm_setzero_si128();
+  __m128i total = zero;
+  int i = 0;
+  while (i + 16 <= length) {
+    __m128i counts = zero;
+    for (int n = 0; n < 255 && i + 16 <= length; n++, i += 16) {
+      __m128i bytes = _mm_loadu_si128((const __m128i*)(chars + i));
+      counts = _mm_sub_epi8(counts, _mm_cmpgt_epi8(bytes, limit));
+    }
+    total = _mm_add_epi64(total, _mm_sad_epu8(counts, zero));
+  }
+
+  uint64_t sums[2];
+  _mm_storeu_si128((__m128i*)sums, total);
+  return (int)(sums[0] + sums[1]) +
+         countCodePointsScalar(chars + i, length - i);
+}
+
+static const Kernels sse2Kernels = {
+  sumSse2, minSse2, maxSse2, dotSse2, scaleSse2, addSse2, indexOfSse2,
+  findSse2, countCodePointsSse2,
+};
+
+// AVX2 ---------------------------------------------------------------------
+
+#define AVX2_REGS (LANES / 4)
+
+TARGET("avx2")
+static double sumAvx2(const double* a, int count) {
+  __m256d acc[AVX2_REGS];
+  for (int k = 0; k < AVX2_REGS; k++) acc[k] = _mm256_setzero_pd();
+
+  int i = 0;
+  for (; i + LANES <= count; i += LANES) {
+    for (int k = 0; k < AVX2_REGS; k++) {
+      acc[k] = _mm256_add_pd(acc[k], _mm256_loadu_pd(a + i + 4 * k));
+    }
+  }
+
+  double lanes[LANES];
+  for (int k = 0; k < AVX2_REGS; k++) {
+    _mm256_storeu_pd(lanes + 4 * k, acc[k]);
+  }
+  return finishSum(lanes, a + i, count - i);
+}
+
+TARGET("avx2")
+static double minAvx2(const double* a, int count) {
+  __m256d acc[AVX2_REGS];
+  for (int k = 0; k < AVX2_REGS; k++) acc[k] = _mm256_set1_pd(INFINITY);
+
+  int i = 0;
+  for (; i + LANES <= count; i += LANES) {
+    for (int k = 0; k < AVX2_REGS; k++) {
+      acc[k] = _mm256_min_pd(_mm256_loadu_pd(a + i + 4 * k), acc[k]);
+    }
+  }
+
+  double lanes[LANES];
+  for (int k = 0; k < AVX2_REGS; k++) {
+    _mm256_storeu_pd(lanes + 4 * k, acc[k]);
+  }
+  return finishMin(lanes, a + i, count - i);
+}
+
+TARGET("avx2")
+static double maxAvx2(const double* a, int count) {
+  __m256d acc[AVX2_REGS];
+  for (int k = 0; k < AVX2_REGS; k++) acc[k] = _mm256_set1_pd(-INFINITY);
+
+  int i = 0;
+  for (; i + LANES <= count; i += LANES) {
+    for (int k = 0; k < AVX2_REGS; k++) {
+      acc[k] = _mm256_max_pd(_mm256_loadu_pd(a + i + 4 * k), acc[k]);
+    }
+  }
+
+  double lanes[LANES];
+  for (int k = 0; k < AVX2_REGS; k++) {
+    _mm256_storeu_pd(lanes + 4 * k, acc[k]);
+  }
+  return finishMax(lanes, a + i, count - i);
+}
+
+// Multiplies and adds separately rather than with FMA, which would round
+// differently from the other versions.
+TARGET("avx2")
+static double dotAvx2(const double* a, const double* b, int count) {
+  __m256d acc[AVX2_REGS];
+  for (int k = 0; k < AVX2_REGS; k++) acc[k] = _mm256_setzero_pd();
+
+  int i = 0;
+  for (; i + LANES <= count; i += LANES) {
+    for (int k = 0; k < AVX2_REGS; k++) {
+      __m256d product = _mm256_mul_pd(_mm256_loadu_pd(a + i + 4 * k),
+                                      _mm256_loadu_pd(b + i + 4 * k));
+      acc[k] = _mm256_add_pd(acc[k], product);
+    }
+  }
+
+  double lanes[LANES];
+  for (int k = 0; k < AVX2_REGS; k++) {
+    _mm256_storeu_pd(lanes + 4 * k, acc[k]);
+  }
+  return finishDot(lanes, a + i, b + i, count - i);
+}
+
+TARGET("avx2")
+static void scaleAvx2(double* a, int count, double factor) {
+  __m256d by = _mm256_set1_pd(factor);
+  int i = 0;
+  for (; i + 4 <= count; i += 4) {
+    _mm256_storeu_pd(a + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), by));
+  }
+  for (; i < count; i++) a[i] *= factor;
+}
+
+TARGET("avx2")
+static void addAvx2(double* a, const double* b, int count) {
+  int i = 0;
+  for (; i + 4 <= count; i += 4) {
+    _mm256_storeu_pd(a + i, _mm256_add_pd(_mm256_loadu_pd(a + i),
+                                          _mm256_loadu_pd(b + i)));
+  }
+  for (; i < count; i++) a[i] += b[i];
+}
+
+TARGET("avx2")
+static int indexOfAvx2(const double* a, int count, double value) {
+  __m256d needle = _mm256_set1_pd(value);
+  int i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256d low = _mm256_cmp_pd(_mm256_loadu_pd(a + i), needle, _CMP_EQ_OQ);
+    __m256d high = _mm256_cmp_pd(_mm256_loadu_pd(a + i + 4), needle,
+                                 _CMP_EQ_OQ);
+    int mask = _mm256_movemask_pd(low) | (_mm256_movemask_pd(high) << 4);
+    if (mask != 0) return i + __builtin_ctz(mask);
+  }
+  for (; i < count; i++) {
+    if (a[i] == value) return i;
+  }
+  return -1;
+}
+
+TARGET("avx2")
+static int findAvx2(const char* haystack, int length, const char* needle,
+                    int needleLength) {
+  __m256i first = _mm256_set1_epi8(needle[0]);
+  __m256i last = _mm256_set1_epi8(needle[needleLength - 1]);
+  int i = 0;
+  for (; i + needleLength - 1 + 32 <= length; i += 32) {
+    __m256i starts = _mm256_loadu_si256((const __m256i*)(haystack + i));
+    __m256i ends = _mm256_loadu_si256(
+        (const __m256i*)(haystack + i + needleLength - 1));
+    unsigned mask = (unsigned)_mm256_movemask_epi8(
+        _mm256_and_si256(_mm256_cmpeq_epi8(starts, first),
+                         _mm256_cmpeq_epi8(ends, last)));
+    while (mask != 0) {
+      int candidate = i + __builtin_ctz(mask);
+      if (memcmp(haystack + candidate, needle, needleLength) == 0) {
+        return candidate;
+      }
+      mask &= mask - 1;
+    }
+  }
+
+  int rest = findScalar(haystack + i, length - i, needle, needleLength);
+  return rest < 0 ? -1 : i + rest;
+}
+
+TARGET("avx2")
+static int countCodePointsAvx2(const char* chars, int length) {
+  __m256i limit = _mm256_set1_epi8(-65);
+  __m256i zero = _mm256_setzero_si256();
+  __m256i total = zero;
+  int i = 0;
+  while (i + 32 <= length) {
+    __m256i counts = zero;
+    for (int n = 0; n < 255 && i + 32 <= length; n++, i += 32) {
+      __m256i bytes = _mm256_loadu_si256((const __m256i*)(chars + i));
+      counts = _mm256_sub_epi8(counts, _mm256_cmpgt_epi8(bytes, limit));
+    }
+    total = _mm256_add_epi64(total, _mm256_sad_epu8(counts, zero));
+  }
+
+  uint64_t sums[4];
+  _mm256_storeu_si256((__m256i*)sums, total);
+  return (int)(sums[0] + sums[1] + sums[2] + sums[3]) +
+         countCodePointsScalar(chars + i, length - i);
+}
+
+static const Kernels avx2Kernels = {
+  sumAvx2, minAvx2, maxAvx2, dotAvx2, scaleAvx2, addAvx2, indexOfAvx2,
+  findAvx2, countCodePointsAvx2,
+};
+#endif
+
+void initSimd() {
+#ifdef SIMD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    kernels = avx2Kernels;
+  } else if (__builtin_cpu_supports("sse2")) {
+    kernels = sse2Kernels;
+  }
+#endif
+}
+
+double simdSum(const double* a, int count) {
+  return kernels.sum(a, count);
+}
+
+double simdMin(const double* a, int count) {
+  return kernels.min(a, count);
+}
+
+double simdMax(const double* a, int count) {
+  return kernels.max(a, count);
+}
+
+double simdDot(const double* a, const double* b, int count) {
+  return kernels.dot(a, b, count);
+}
+
+void simdScale(double* a, int count, double factor) {
+  kernels.scale(a, count, factor);
+}
+
+void simdAdd(double* a, const double* b, int count) {
+  kernels.add(a, b, count);
+}
+
+int simdIndexOf(const double* a, int count, double value) {
+  return kernels.indexOf(a, count, value);
+}
+
+int simdFind(const char* haystack, int length, const char* needle,
+             int needleLength) {
+  if (needleLength == 0) return 0;
+  if (needleLength > length) return -1;
+  return kernels.find(haystack, length, needle, needleLength);
+}
+
+int simdCountCodePoints(const char* chars, int length) {
+  return kernels.countCodePoints(chars, length);
+}
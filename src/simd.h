@@ -0,0 +1,30 @@
+#ifndef clox_simd_h
+#define clox_simd_h
+
+#include "common.h"
+
+// Kernels over plain double arrays, plus the string scans. initSimd()
+// picks the widest version the CPU supports for the calling thread.
+// Every version adds in the same order, so switching between them
+// doesn't change any results.
+void initSimd();
+
+double simdSum(const double* a, int count);
+// NaNs are skipped. With nothing left to compare these return +/-inf.
+double simdMin(const double* a, int count);
+double simdMax(const double* a, int count);
+double simdDot(const double* a, const double* b, int count);
+void simdScale(double* a, int count, double factor);
+// a[i] += b[i].
+void simdAdd(double* a, const double* b, int count);
+// Returns the first index holding value, or -1.
+int simdIndexOf(const double* a, int count, double value);
+
+// Returns the offset of the first occurrence of needle, or -1.
+int simdFind(const char* haystack, int length, const char* needle,
+             int needleLength);
+// Counts the UTF-8 code points in chars, one per byte that isn't a
+// continuation byte.
+int simdCountCodePoints(const char* chars, int length);
+
+#endif
@@ -0,0 +1,829 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "list.h"
+#include "map.h"
+#include "memory.h"
+#include "object.h"
+#include "snapshot.h"
+#include "source.h"
+#include "table.h"
+#include "vm.h"
+
+#define SNAPSHOT_MAGIC "DOTALSNP"
+#define SNAPSHOT_VERSION 1
+
+// The file is the header, then every object as its type byte followed
+// by its fields, then the globals as a count and key and value pairs.
+// Numbers are written in the host's byte order. Objects are sorted so
+// that strings come first, then functions, then classes, which lets the
+// first pass of loading create closures, classes and instances whole.
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t nativeCount;
+  uint32_t objectCount;
+} SnapshotHeader;
+
+typedef enum {
+  SNAP_NIL,
+  SNAP_FALSE,
+  SNAP_TRUE,
+  SNAP_NUMBER,
+  SNAP_SHORT_STRING,
+  SNAP_OBJECT,
+  SNAP_NATIVE,
+  SNAP_BUILTIN_CLASS,
+} SnapshotTag;
+
+static ObjClass** builtinClass(int index) {
+  switch (index) {
+    case 0: return &vm.stringClass;
+    case 1: return &vm.listClass;
+    case 2: return &vm.mapClass;
+    case 3: return &vm.fileClass;
+    case 4: return &vm.coroutineClass;
+    default: return NULL;
+  }
+}
+
+static int builtinClassIndex(Obj* object) {
+  for (int i = 0; builtinClass(i) != NULL; i++) {
+    if ((Obj*)*builtinClass(i) == object) return i;
+  }
+  return -1;
+}
+
+typedef struct {
+  // Every object to write, in order. An object's number is its index.
+  Obj** objects;
+  int count;
+  int capacity;
+  // Open addressing from an object's address to its number.
+  Obj** keys;
+  int* numbers;
+  int keyCapacity;
+
+  uint8_t* bytes;
+  size_t length;
+  size_t byteCapacity;
+  bool failed;
+} Writer;
+
+static void fail(Writer* writer, const char* message) {
+  if (!writer->failed) fprintf(stderr, "Can't snapshot %s.\n", message);
+  writer->failed = true;
+}
+
+static uint32_t hashPointer(Obj* object) {
+  uintptr_t bits = (uintptr_t)object;
+  bits ^= bits >> 17;
+  bits *= 0x9e3779b97f4a7c15ull;
+  return (uint32_t)(bits >> 32);
+}
+
+static int* findNumber(Writer* writer, Obj* object) {
+  uint32_t index = hashPointer(object) & (writer->keyCapacity - 1);
+  for (;;) {
+    if (writer->keys[index] == NULL || writer->keys[index] == object) {
+      return &writer->numbers[index];
+    }
+    index = (index + 1) & (writer->keyCapacity - 1);
+  }
+}
+
+static int objectNumber(Writer* writer, Obj* object) {
+  uint32_t index = hashPointer(object) & (writer->keyCapacity - 1);
+  while (writer->keys[index] != object) {
+    index = (index + 1) & (writer->keyCapacity - 1);
+  }
+  return writer->numbers[index];
+}
+
+static void growKeys(Writer* writer) {
+  Obj** oldKeys = writer->keys;
+  int* oldNumbers = writer->numbers;
+  int oldCapacity = writer->keyCapacity;
+
+  writer->keyCapacity = oldCapacity < 64 ? 64 : oldCapacity * 2;
+  writer->keys = (Obj**)calloc(writer->keyCapacity, sizeof(Obj*));
+  writer->numbers = (int*)malloc(writer->keyCapacity * sizeof(int));
+  if (writer->keys == NULL || writer->numbers == NULL) {
+    fprintf(stderr, "Not enough memory for the snapshot.\n");
+    exit(74);
+  }
+
+  for (int i = 0; i < oldCapacity; i++) {
+    if (oldKeys[i] == NULL) continue;
+    int* number = findNumber(writer, oldKeys[i]);
+    writer->keys[number - writer->numbers] = oldKeys[i];
+    *number = oldNumbers[i];
+  }
+  free(oldKeys);
+  free(oldNumbers);
+}
+
+// Queues an object to be written unless it already is.
+static void addObject(Writer* writer, Obj* object) {
+  if (object == NULL || builtinClassIndex(object) != -1) return;
+  if (object->type == OBJ_NATIVE) return;
+
+  if ((writer->count + 1) * 2 > writer->keyCapacity) growKeys(writer);
+  int* number = findNumber(writer, object);
+  int slot = (int)(number - writer->numbers);
+  if (writer->keys[slot] != NULL) return;
+
+  if (object->type == OBJ_FILE) {
+    fail(writer, "a file");
+    return;
+  }
+  if (object->type == OBJ_COROUTINE) {
+    fail(writer, "a coroutine");
+    return;
+  }
+  if (object->type == OBJ_UPVALUE &&
+      ((ObjUpvalue*)object)->location != &((ObjUpvalue*)object)->closed) {
+    fail(writer, "an upvalue that is still open");
+    return;
+  }
+
+  writer->keys[slot] = object;
+  *number = writer->count;
+  if (writer->count == writer->capacity) {
+    writer->capacity = writer->capacity < 64 ? 64 : writer->capacity * 2;
+    writer->objects = (Obj**)realloc(writer->objects,
+                                     writer->capacity * sizeof(Obj*));
+    if (writer->objects == NULL) {
+      fprintf(stderr, "Not enough memory for the snapshot.\n");
+      exit(74);
+    }
+  }
+  writer->objects[writer->count++] = object;
+}
+
+static void addValue(Writer* writer, Value value) {
+  if (IS_OBJ(value)) addObject(writer, AS_OBJ(value));
+}
+
+static void addTable(Writer* writer, Table* table) {
+  for (int i = 0; i < table->capacity; i++) {
+    if (table->control[i] & 0x80) continue;
+    addObject(writer, (Obj*)table->entries[i].key);
+    addValue(writer, table->entries[i].value);
+  }
+}
+
+// Queues everything [object] refers to.
+static void addReferences(Writer* writer, Obj* object) {
+  switch (object->type) {
+    case OBJ_STRING: {
+      // Only the characters are written, so a rope is flattened first.
+      // That can collect, but everything queued is reachable from the
+      // globals.
+      ObjString* string = (ObjString*)object;
+      if (IS_ROPE(string)) flattenString(string);
+      break;
+    }
+    case OBJ_FUNCTION: {
+      ObjFunction* function = (ObjFunction*)object;
+      addObject(writer, (Obj*)function->name);
+      for (int i = 0; i < function->chunk.constants.count; i++) {
+        addValue(writer, function->chunk.constants.values[i]);
+      }
+      break;
+    }
+    case OBJ_CLOSURE: {
+      ObjClosure* closure = (ObjClosure*)object;
+      addObject(writer, (Obj*)closure->function);
+      for (int i = 0; i < closure->upvalueCount; i++) {
+        addObject(writer, (Obj*)closure->upvalues[i]);
+      }
+      break;
+    }
+    case OBJ_UPVALUE:
+      addValue(writer, ((ObjUpvalue*)object)->closed);
+      break;
+    case OBJ_CLASS: {
+      ObjClass* klass = (ObjClass*)object;
+      addObject(writer, (Obj*)klass->name);
+      addTable(writer, &klass->methods);
+      break;
+    }
+    case OBJ_INSTANCE: {
+      ObjInstance* instance = (ObjInstance*)object;
+      addObject(writer, (Obj*)instance->klass);
+      addTable(writer, &instance->fields);
+      break;
+    }
+    case OBJ_BOUND_METHOD: {
+      ObjBoundMethod* bound = (ObjBoundMethod*)object;
+      addValue(writer, bound->receiver);
+      addObject(writer, (Obj*)bound->method);
+      break;
+    }
+    case OBJ_LIST: {
+      ObjList* list = (ObjList*)object;
+      for (int i = 0; i < list->items.count; i++) {
+        addValue(writer, list->items.values[i]);
+      }
+      break;
+    }
+    case OBJ_MAP: {
+      ObjMap* map = (ObjMap*)object;
+      for (int i = 0; i < map->capacity; i++) {
+        if (IS_NIL(map->entries[i].key)) continue;
+        addValue(writer, map->entries[i].key);
+        addValue(writer, map->entries[i].value);
+      }
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+static int objectRank(Obj* object) {
+  switch (object->type) {
+    case OBJ_STRING: return 0;
+    case OBJ_FUNCTION: return 1;
+    case OBJ_CLASS: return 2;
+    default: return 3;
+  }
+}
+
+// Stable sort by rank, then renumbering.
+static void sortObjects(Writer* writer) {
+  Obj** sorted = (Obj**)malloc(writer->count * sizeof(Obj*) + 1);
+  if (sorted == NULL) {
+    fprintf(stderr, "Not enough memory for the snapshot.\n");
+    exit(74);
+  }
+
+  int count = 0;
+  for (int rank = 0; rank <= 3; rank++) {
+    for (int i = 0; i < writer->count; i++) {
+      if (objectRank(writer->objects[i]) == rank) {
+        *findNumber(writer, writer->objects[i]) = count;
+        sorted[count++] = writer->objects[i];
+      }
+    }
+  }
+
+  free(writer->objects);
+  writer->objects = sorted;
+  writer->capacity = writer->count;
+}
+
+static void writeBytes(Writer* writer, const void* bytes, size_t length) {
+  if (writer->length + length > writer->byteCapacity) {
+    size_t capacity = writer->byteCapacity < 4096
+        ? 4096 : writer->byteCapacity;
+    while (capacity < writer->length + length) capacity *= 2;
+    writer->bytes = (uint8_t*)realloc(writer->bytes, capacity);
+    if (writer->bytes == NULL) {
+      fprintf(stderr, "Not enough memory for the snapshot.\n");
+      exit(74);
+    }
+    writer->byteCapacity = capacity;
+  }
+  memcpy(writer->bytes + writer->length, bytes, length);
+  writer->length += length;
+}
+
+static void writeByte(Writer* writer, uint8_t byte) {
+  writeBytes(writer, &byte, 1);
+}
+
+static void writeInt(Writer* writer, uint32_t value) {
+  writeBytes(writer, &value, sizeof(value));
+}
+
+static void writeObjectRef(Writer* writer, Obj* object) {
+  writeInt(writer, (uint32_t)objectNumber(writer, object));
+}
+
+static void writeValue(Writer* writer, Value value) {
+  if (IS_NIL(value)) {
+    writeByte(writer, SNAP_NIL);
+  } else if (IS_BOOL(value)) {
+    writeByte(writer, AS_BOOL(value) ? SNAP_TRUE : SNAP_FALSE);
+  } else if (IS_NUMBER(value)) {
+    double number = AS_NUMBER(value);
+    writeByte(writer, SNAP_NUMBER);
+    writeBytes(writer, &number, sizeof(number));
+  } else if (IS_SHORT_STRING(value)) {
+    char chars[SHORT_STRING_MAX];
+    int length = unpackShortString(value, chars);
+    writeByte(writer, SNAP_SHORT_STRING);
+    writeByte(writer, (uint8_t)length);
+    writeBytes(writer, chars, length);
+  } else if (IS_NATIVE(value)) {
+    int index = nativeIndex(AS_NATIVE(value));
+    if (index == -1) {
+      fail(writer, "a native function made outside initVM()");
+      return;
+    }
+    writeByte(writer, SNAP_NATIVE);
+    writeInt(writer, (uint32_t)index);
+  } else if (builtinClassIndex(AS_OBJ(value)) != -1) {
+    writeByte(writer, SNAP_BUILTIN_CLASS);
+    writeByte(writer, (uint8_t)builtinClassIndex(AS_OBJ(value)));
+  } else {
+    writeByte(writer, SNAP_OBJECT);
+    writeObjectRef(writer, AS_OBJ(value));
+  }
+}
+
+static void writeTable(Writer* writer, Table* table) {
+  writeInt(writer, (uint32_t)table->count);
+  for (int i = 0; i < table->capacity; i++) {
+    if (table->control[i] & 0x80) continue;
+    writeObjectRef(writer, (Obj*)table->entries[i].key);
+    writeValue(writer, table->entries[i].value);
+  }
+}
+
+static void writeObject(Writer* writer, Obj* object) {
+  writeByte(writer, (uint8_t)object->type);
+
+  switch (object->type) {
+    case OBJ_STRING: {
+      ObjString* string = (ObjString*)object;
+      writeByte(writer, string->isInterned);
+      writeInt(writer, (uint32_t)string->length);
+      writeBytes(writer, string->chars, string->length);
+      break;
+    }
+    case OBJ_FUNCTION: {
+      ObjFunction* function = (ObjFunction*)object;
+      Chunk* chunk = &function->chunk;
+      writeInt(writer, (uint32_t)function->arity);
+      writeInt(writer, (uint32_t)function->upvalueCount);
+      writeValue(writer, function->name == NULL
+          ? NIL_VAL : OBJ_VAL(function->name));
+      writeInt(writer, (uint32_t)chunk->count);
+      writeBytes(writer, chunk->code, chunk->count);
+      writeBytes(writer, chunk->lines, chunk->count * sizeof(int));
+      writeInt(writer, (uint32_t)chunk->constants.count);
+      for (int i = 0; i < chunk->constants.count; i++) {
+        writeValue(writer, chunk->constants.values[i]);
+      }
+      break;
+    }
+    case OBJ_CLOSURE: {
+      ObjClosure* closure = (ObjClosure*)object;
+      writeObjectRef(writer, (Obj*)closure->function);
+      writeInt(writer, (uint32_t)closure->upvalueCount);
+      for (int i = 0; i < closure->upvalueCount; i++) {
+        writeObjectRef(writer, (Obj*)closure->upvalues[i]);
+      }
+      break;
+    }
+    case OBJ_UPVALUE:
+      writeValue(writer, ((ObjUpvalue*)object)->closed);
+      break;
+    case OBJ_CLASS: {
+      ObjClass* klass = (ObjClass*)object;
+      writeObjectRef(writer, (Obj*)klass->name);
+      writeTable(writer, &klass->methods);
+      break;
+    }
+    case OBJ_INSTANCE: {
+      ObjInstance* instance = (ObjInstance*)object;
+      writeObjectRef(writer, (Obj*)instance->klass);
+      writeTable(writer, &instance->fields);
+      break;
+    }
+    case OBJ_BOUND_METHOD: {
+      ObjBoundMethod* bound = (ObjBoundMethod*)object;
+      writeValue(writer, bound->receiver);
+      writeObjectRef(writer, (Obj*)bound->method);
+      break;
+    }
+    case OBJ_LIST: {
+      ObjList* list = (ObjList*)object;
+      writeInt(writer, (uint32_t)list->items.count);
+      for (int i = 0; i < list->items.count; i++) {
+        writeValue(writer, list->items.values[i]);
+      }
+      break;
+    }
+    case OBJ_MAP: {
+      ObjMap* map = (ObjMap*)object;
+      writeInt(writer, (uint32_t)map->count);
+      for (int i = 0; i < map->capacity; i++) {
+        if (IS_NIL(map->entries[i].key)) continue;
+        writeValue(writer, map->entries[i].key);
+        writeValue(writer, map->entries[i].value);
+      }
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+bool writeSnapshot(const char* path) {
+  Writer writer;
+  memset(&writer, 0, sizeof(writer));
+
+  addTable(&writer, &vm.globals);
+  // Objects are added while the queue is walked, breadth first.
+  for (int i = 0; i < writer.count && !writer.failed; i++) {
+    addReferences(&writer, writer.objects[i]);
+  }
+
+  if (!writer.failed) {
+    sortObjects(&writer);
+
+    SnapshotHeader header;
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.nativeCount = 0;
+    while (nativeAt(header.nativeCount) != NULL) header.nativeCount++;
+    header.objectCount = (uint32_t)writer.count;
+    writeBytes(&writer, &header, sizeof(header));
+
+    for (int i = 0; i < writer.count; i++) {
+      writeObject(&writer, writer.objects[i]);
+    }
+    writeTable(&writer, &vm.globals);
+  }
+
+  if (!writer.failed) {
+    FILE* file = fopen(path, "wb");
+    if (file == NULL ||
+        fwrite(writer.bytes, 1, writer.length, file) != writer.length ||
+        fclose(file) != 0) {
+      fprintf(stderr, "Could not write snapshot \"%s\".\n", path);
+      writer.failed = true;
+    }
+  }
+
+  free(writer.objects);
+  free(writer.keys);
+  free(writer.numbers);
+  free(writer.bytes);
+  return !writer.failed;
+}
+
+typedef struct {
+  const uint8_t* current;
+  const uint8_t* end;
+  uint32_t objectCount;
+  // Every object made so far, in order. It also keeps them from being
+  // collected.
+  ObjList* objects;
+  // The first pass makes the objects. References between them are only
+  // filled in by the second.
+  bool linking;
+  bool failed;
+} Reader;
+
+static const uint8_t* readBytes(Reader* reader, size_t length) {
+  if (reader->failed || (size_t)(reader->end - reader->current) < length) {
+    reader->failed = true;
+    return NULL;
+  }
+  const uint8_t* bytes = reader->current;
+  reader->current += length;
+  return bytes;
+}
+
+static uint8_t readByte(Reader* reader) {
+  const uint8_t* byte = readBytes(reader, 1);
+  return byte == NULL ? 0 : *byte;
+}
+
+static uint32_t readInt(Reader* reader) {
+  uint32_t value = 0;
+  const uint8_t* bytes = readBytes(reader, sizeof(value));
+  if (bytes != NULL) memcpy(&value, bytes, sizeof(value));
+  return value;
+}
+
+// Returns the object numbered by the next int, or NULL if it isn't one
+// of the given type or hasn't been made yet.
+static Obj* readObjectRef(Reader* reader, ObjType type) {
+  uint32_t number = readInt(reader);
+  if (reader->failed) return NULL;
+  if (number >= (uint32_t)reader->objects->items.count ||
+      AS_OBJ(reader->objects->items.values[number])->type != type) {
+    reader->failed = true;
+    return NULL;
+  }
+  return AS_OBJ(reader->objects->items.values[number]);
+}
+
+// Like readObjectRef() but only checks the number before linking.
+static Obj* readLinkedRef(Reader* reader, ObjType type) {
+  if (reader->linking) return readObjectRef(reader, type);
+  if (readInt(reader) >= reader->objectCount) reader->failed = true;
+  return NULL;
+}
+
+// Before linking, objects and natives read as nil. A native is a new
+// object, so the caller must keep it reachable.
+static Value readValue(Reader* reader) {
+  switch (readByte(reader)) {
+    case SNAP_NIL: return NIL_VAL;
+    case SNAP_FALSE: return BOOL_VAL(false);
+    case SNAP_TRUE: return BOOL_VAL(true);
+    case SNAP_NUMBER: {
+      double number = 0;
+      const uint8_t* bytes = readBytes(reader, sizeof(number));
+      if (bytes != NULL) memcpy(&number, bytes, sizeof(number));
+      return NUMBER_VAL(number);
+    }
+    case SNAP_SHORT_STRING: {
+      int length = readByte(reader);
+      const uint8_t* chars = readBytes(reader, length);
+      if (chars == NULL || !fitsShortString((const char*)chars, length)) {
+        reader->failed = true;
+        return NIL_VAL;
+      }
+      return makeShortString((const char*)chars, length);
+    }
+    case SNAP_OBJECT: {
+      uint32_t number = readInt(reader);
+      if (number >= reader->objectCount) break;
+      if (!reader->linking) return NIL_VAL;
+      return reader->objects->items.values[number];
+    }
+    case SNAP_NATIVE: {
+      NativeFn function = nativeAt((int)readInt(reader));
+      if (function == NULL) break;
+      if (!reader->linking) return NIL_VAL;
+      return OBJ_VAL(newNative(function));
+    }
+    case SNAP_BUILTIN_CLASS: {
+      ObjClass** klass = builtinClass(readByte(reader));
+      if (klass == NULL) break;
+      return OBJ_VAL(*klass);
+    }
+    default:
+      break;
+  }
+
+  reader->failed = true;
+  return NIL_VAL;
+}
+
+static void readTable(Reader* reader, Table* table) {
+  uint32_t count = readInt(reader);
+  for (uint32_t i = 0; i < count && !reader->failed; i++) {
+    ObjString* key = (ObjString*)readLinkedRef(reader, OBJ_STRING);
+    Value value = readValue(reader);
+    if (!reader->linking || reader->failed) continue;
+
+    push(value);
+    tableSet(table, key, value);
+    pop();
+  }
+}
+
+static void readValueArray(Reader* reader, ValueArray* array) {
+  uint32_t count = readInt(reader);
+  for (uint32_t i = 0; i < count && !reader->failed; i++) {
+    Value value = readValue(reader);
+    if (!reader->linking) continue;
+
+    push(value);
+    writeValueArray(array, value);
+    pop();
+  }
+}
+
+// Makes the object on the first pass and fills it in on the second.
+static void readObject(Reader* reader, int number) {
+  ObjType type = (ObjType)readByte(reader);
+  Obj* object = NULL;
+  if (reader->linking) {
+    object = AS_OBJ(reader->objects->items.values[number]);
+    if (object->type != type) reader->failed = true;
+  }
+  if (reader->failed) return;
+
+  switch (type) {
+    case OBJ_STRING: {
+      bool isInterned = readByte(reader) != 0;
+      uint32_t length = readInt(reader);
+      const char* chars = (const char*)readBytes(reader, length);
+      if (reader->linking || reader->failed) break;
+
+      if (length > INT32_MAX) {
+        reader->failed = true;
+        break;
+      }
+      object = (Obj*)(isInterned ? copyString(chars, (int)length)
+                                 : copyTransientString(chars, (int)length));
+      break;
+    }
+    case OBJ_FUNCTION: {
+      ObjFunction* function = (ObjFunction*)object;
+      int arity = (int)readInt(reader);
+      int upvalueCount = (int)readInt(reader);
+      Value name = readValue(reader);
+      uint32_t count = readInt(reader);
+      const uint8_t* code = readBytes(reader, count);
+      const uint8_t* lines = readBytes(reader, (size_t)count * sizeof(int));
+      if (reader->failed) break;
+
+      if (reader->linking) {
+        if (!IS_NIL(name) && !IS_STRING(name)) {
+          reader->failed = true;
+          break;
+        }
+        function->name = IS_NIL(name) ? NULL : AS_STRING(name);
+        readValueArray(reader, &function->chunk.constants);
+        break;
+      }
+
+      if (count > INT32_MAX || arity < 0 || upvalueCount < 0) {
+        reader->failed = true;
+        break;
+      }
+      function = newFunction();
+      appendToList(reader->objects, OBJ_VAL(function));
+      function->arity = arity;
+      function->upvalueCount = upvalueCount;
+      function->chunk.code = ALLOCATE(uint8_t, count);
+      function->chunk.lines = ALLOCATE(int, count);
+      function->chunk.count = (int)count;
+      function->chunk.capacity = (int)count;
+      memcpy(function->chunk.code, code, count);
+      memcpy(function->chunk.lines, lines, (size_t)count * sizeof(int));
+      readValueArray(reader, &function->chunk.constants);
+      return;
+    }
+    case OBJ_CLOSURE: {
+      ObjFunction* function =
+          (ObjFunction*)readObjectRef(reader, OBJ_FUNCTION);
+      uint32_t upvalueCount = readInt(reader);
+      if (reader->failed ||
+          upvalueCount != (uint32_t)function->upvalueCount) {
+        reader->failed = true;
+        break;
+      }
+
+      ObjClosure* closure = (ObjClosure*)object;
+      if (!reader->linking) {
+        closure = newClosure(function);
+        object = (Obj*)closure;
+      }
+      for (uint32_t i = 0; i < upvalueCount; i++) {
+        ObjUpvalue* upvalue =
+            (ObjUpvalue*)readLinkedRef(reader, OBJ_UPVALUE);
+        if (reader->linking) closure->upvalues[i] = upvalue;
+      }
+      break;
+    }
+    case OBJ_UPVALUE: {
+      Value closed = readValue(reader);
+      if (reader->linking) {
+        ((ObjUpvalue*)object)->closed = closed;
+        break;
+      }
+      ObjUpvalue* upvalue = newUpvalue(NULL);
+      upvalue->location = &upvalue->closed;
+      object = (Obj*)upvalue;
+      break;
+    }
+    case OBJ_CLASS: {
+      ObjString* name = (ObjString*)readObjectRef(reader, OBJ_STRING);
+      if (reader->failed) break;
+      if (reader->linking) {
+        readTable(reader, &((ObjClass*)object)->methods);
+        break;
+      }
+      object = (Obj*)newClass(name);
+      appendToList(reader->objects, OBJ_VAL(object));
+      readTable(reader, &((ObjClass*)object)->methods);
+      return;
+    }
+    case OBJ_INSTANCE: {
+      ObjClass* klass = (ObjClass*)readObjectRef(reader, OBJ_CLASS);
+      if (reader->failed) break;
+      if (reader->linking) {
+        readTable(reader, &((ObjInstance*)object)->fields);
+        break;
+      }
+      object = (Obj*)newInstance(klass);
+      appendToList(reader->objects, OBJ_VAL(object));
+      readTable(reader, &((ObjInstance*)object)->fields);
+      return;
+    }
+    case OBJ_BOUND_METHOD: {
+      Value receiver = readValue(reader);
+      ObjClosure* method = (ObjClosure*)readLinkedRef(reader, OBJ_CLOSURE);
+      if (reader->linking) {
+        ((ObjBoundMethod*)object)->receiver = receiver;
+        ((ObjBoundMethod*)object)->method = method;
+        break;
+      }
+      object = (Obj*)newBoundMethod(NIL_VAL, NULL);
+      break;
+    }
+    case OBJ_LIST: {
+      // Appending keeps isNumeric right.
+      ObjList* list = (ObjList*)object;
+      uint32_t count = readInt(reader);
+      for (uint32_t i = 0; i < count && !reader->failed; i++) {
+        Value value = readValue(reader);
+        if (!reader->linking) continue;
+
+        push(value);
+        appendToList(list, value);
+        pop();
+      }
+      if (!reader->linking) object = (Obj*)newList();
+      break;
+    }
+    case OBJ_MAP: {
+      ObjMap* map = (ObjMap*)object;
+      uint32_t count = readInt(reader);
+      for (uint32_t i = 0; i < count && !reader->failed; i++) {
+        Value key = readValue(reader);
+        push(key);
+        Value value = readValue(reader);
+        push(value);
+        if (reader->linking && !reader->failed) {
+          if (isValidMapKey(key)) {
+            mapSet(map, key, value);
+          } else {
+            reader->failed = true;
+          }
+        }
+        pop();
+        pop();
+      }
+      if (!reader->linking) {
+        object = (Obj*)newMap();
+      }
+      break;
+    }
+    default:
+      reader->failed = true;
+      break;
+  }
+
+  if (!reader->linking && !reader->failed) {
+    appendToList(reader->objects, OBJ_VAL(object));
+  }
+}
+
+bool loadSnapshot(const char* path) {
+  Source source;
+  if (!readSource(path, &source)) return false;
+
+  Reader reader;
+  reader.current = (const uint8_t*)source.chars;
+  reader.end = reader.current + source.length;
+  reader.linking = false;
+  reader.failed = false;
+
+  SnapshotHeader header;
+  const uint8_t* bytes = readBytes(&reader, sizeof(header));
+  if (bytes != NULL) memcpy(&header, bytes, sizeof(header));
+  int nativeCount = 0;
+  while (nativeAt(nativeCount) != NULL) nativeCount++;
+
+  // Every object takes at least a byte, which bounds the count.
+  if (reader.failed ||
+      memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != SNAPSHOT_VERSION ||
+      header.nativeCount != (uint32_t)nativeCount ||
+      header.objectCount > (uint32_t)(reader.end - reader.current) ||
+      header.objectCount > INT32_MAX) {
+    fprintf(stderr, "\"%s\" is not a snapshot made by this build.\n", path);
+    freeSource(&source);
+    return false;
+  }
+  reader.objectCount = header.objectCount;
+
+  reader.objects = newList();
+  push(OBJ_VAL(reader.objects));
+  reserveList(reader.objects, (int)header.objectCount);
+
+  const uint8_t* start = reader.current;
+  for (uint32_t i = 0; i < header.objectCount && !reader.failed; i++) {
+    readObject(&reader, (int)i);
+  }
+
+  reader.current = start;
+  reader.linking = true;
+  for (uint32_t i = 0; i < header.objectCount && !reader.failed; i++) {
+    readObject(&reader, (int)i);
+  }
+  readTable(&reader, &vm.globals);
+  if (reader.current != reader.end) reader.failed = true;
+
+  pop();
+  freeSource(&source);
+  if (reader.failed) {
+    fprintf(stderr, "Snapshot \"%s\" is corrupt.\n", path);
+    return false;
+  }
+  return true;
+}
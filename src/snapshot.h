@@ -0,0 +1,17 @@
+#ifndef clox_snapshot_h
+#define clox_snapshot_h
+
+#include "common.h"
+
+// A snapshot is everything reachable from the globals, written after a
+// prelude has run so later runs can start from it instead of running
+// the prelude again. Objects are numbered and refer to each other by
+// number. Natives and the builtin classes are written as references to
+// the ones initVM() makes, so a snapshot only loads into the same build.
+//
+// Both report the problem on stderr and return false on failure.
+bool writeSnapshot(const char* path);
+// Loads into an initialized VM, setting the snapshot's globals.
+bool loadSnapshot(const char* path);
+
+#endif
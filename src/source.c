@@ -0,0 +1,90 @@
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "source.h"
+
+static bool mapSource(const char* path, Source* source) {
+#ifdef _WIN32
+  return false;
+#else
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return false;
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) ||
+      info.st_size == 0 || info.st_size > INT_MAX) {
+    close(fd);
+    return false;
+  }
+
+  size_t length = (size_t)info.st_size;
+  void* chars = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (chars == MAP_FAILED) return false;
+
+  madvise(chars, length, MADV_SEQUENTIAL);
+  source->chars = (char*)chars;
+  source->length = length;
+  source->isMapped = true;
+  return true;
+#endif
+}
+
+bool readSource(const char* path, Source* source) {
+  if (mapSource(path, source)) return true;
+
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) {
+    fprintf(stderr, "Could not open file \"%s\".\n", path);
+    return false;
+  }
+
+  fseek(file, 0L, SEEK_END);
+  size_t fileSize = ftell(file);
+  rewind(file);
+
+  char* buffer = (char*)malloc(fileSize + 1);
+  if (buffer == NULL) {
+    fprintf(stderr, "Not enough memory to read \"%s\".\n", path);
+    fclose(file);
+    return false;
+  }
+
+  size_t bytesRead = fread(buffer, sizeof(char), fileSize, file);
+  if (bytesRead < fileSize) {
+    fprintf(stderr, "Could not read file \"%s\".\n", path);
+    free(buffer);
+    fclose(file);
+    return false;
+  }
+  if (bytesRead > INT_MAX) {
+    fprintf(stderr, "File \"%s\" is too large.\n", path);
+    free(buffer);
+    fclose(file);
+    return false;
+  }
+
+  fclose(file);
+  source->chars = buffer;
+  source->length = bytesRead;
+  source->isMapped = false;
+  return true;
+}
+
+void freeSource(Source* source) {
+#ifndef _WIN32
+  if (source->isMapped) {
+    munmap(source->chars, source->length);
+    return;
+  }
+#endif
+  free(source->chars);
+}
@@ -0,0 +1,19 @@
+#ifndef clox_source_h
+#define clox_source_h
+
+#include "common.h"
+
+// A script's text. It is mapped when possible, and the scanner stops at
+// the given length, so there is no NUL terminator and no heap copy.
+typedef struct {
+  char* chars;
+  size_t length;
+  bool isMapped;
+} Source;
+
+// Reports the problem on stderr and returns false if the file can't be
+// read.
+bool readSource(const char* path, Source* source);
+void freeSource(Source* source);
+
+#endif
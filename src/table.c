@@ -7,66 +7,185 @@
 #include "table.h"
 #include "value.h"
 
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define TABLE_USE_SSE2
+#endif
+
 //> max-load
-#define TABLE_MAX_LOAD 0.75
+// Group probing stays short even when the table is nearly full.
+#define TABLE_MAX_LOAD 0.875
 
 //< max-load
+// Slots are probed in aligned groups of this many control bytes.
+#define GROUP_WIDTH 16
+
+// Control bytes with the high bit set are not full. Full slots hold a
+// hash fragment in 0..127.
+#define CTRL_EMPTY   0x80
+#define CTRL_DELETED 0xfe
+
+// A bitmask with one bit per slot in a group.
+typedef uint32_t GroupMask;
+
+static inline uint8_t hashFragment(uint32_t hash) {
+  return hash & 0x7f;
+}
+
+static inline uint32_t groupCount(int capacity) {
+  return (uint32_t)capacity / GROUP_WIDTH;
+}
+
+// Each key has a home slot in its first group. Inserts use it when it
+// is free, so most hits cost a single pointer compare, as in a plain
+// open-addressed table.
+static inline uint32_t homeSlot(uint32_t hash, int capacity) {
+  return (hash >> 7) & ((uint32_t)capacity - 1);
+}
+
+static inline uint32_t firstGroup(uint32_t hash, int capacity) {
+  return homeSlot(hash, capacity) / GROUP_WIDTH;
+}
+
+#ifdef TABLE_USE_SSE2
+typedef __m128i Group;
+
+static inline Group loadGroup(const uint8_t* control) {
+  return _mm_loadu_si128((const __m128i*)control);
+}
+
+static inline GroupMask matchByte(Group group, uint8_t byte) {
+  __m128i match = _mm_cmpeq_epi8(group, _mm_set1_epi8((char)byte));
+  return (GroupMask)_mm_movemask_epi8(match);
+}
+
+// Matches both empty and deleted slots.
+static inline GroupMask matchFree(Group group) {
+  return (GroupMask)_mm_movemask_epi8(group);
+}
+
+// Matches slots that have never been used. Probes stop at these.
+static inline GroupMask matchEmpty(Group group) {
+  return matchByte(group, CTRL_EMPTY);
+}
+#else
+// Without SSE2 a group is two 64-bit words tested a byte lane at a
+// time with the usual SWAR bit tricks.
+typedef struct {
+  uint64_t low;
+  uint64_t high;
+} Group;
+
+#define LANE_LSBS 0x0101010101010101ull
+#define LANE_MSBS 0x8080808080808080ull
+
+static inline uint64_t loadWord(const uint8_t* bytes) {
+  uint64_t word;
+  memcpy(&word, bytes, sizeof(word));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  word = __builtin_bswap64(word);
+#endif
+  return word;
+}
+
+static inline Group loadGroup(const uint8_t* control) {
+  Group group = { loadWord(control), loadWord(control + 8) };
+  return group;
+}
+
+// Gathers the high bit of each byte lane into one bit per lane.
+static inline GroupMask packLanes(uint64_t lanes) {
+  return (GroupMask)(((lanes >> 7) * 0x0102040810204080ull) >> 56);
+}
+
+static inline GroupMask packGroup(uint64_t low, uint64_t high) {
+  return packLanes(low) | (packLanes(high) << 8);
+}
+
+// May report a lane next to a real match, so callers must check the
+// key. That is fine for hash fragments but not for the markers below.
+static inline GroupMask matchByte(Group group, uint8_t byte) {
+  uint64_t pattern = LANE_LSBS * byte;
+  uint64_t low = group.low ^ pattern;
+  uint64_t high = group.high ^ pattern;
+  return packGroup((low - LANE_LSBS) & ~low & LANE_MSBS,
+                   (high - LANE_LSBS) & ~high & LANE_MSBS);
+}
+
+// Matches both empty and deleted slots.
+static inline GroupMask matchFree(Group group) {
+  return packGroup(group.low & LANE_MSBS, group.high & LANE_MSBS);
+}
+
+// Matches slots that have never been used. Probes stop at these. Only
+// empty slots have the high bit set and bit 1 clear.
+static inline GroupMask matchEmpty(Group group) {
+  return packGroup(group.low & ~(group.low << 6) & LANE_MSBS,
+                   group.high & ~(group.high << 6) & LANE_MSBS);
+}
+#endif
+
+static inline int lowestBit(GroupMask mask) {
+  return __builtin_ctz(mask);
+}
+
 void initTable(Table* table) {
   table->count = 0;
   table->capacity = 0;
+  table->control = NULL;
   table->entries = NULL;
 }
 //> free-table
 void freeTable(Table* table) {
+  FREE_ARRAY(uint8_t, table->control, table->capacity);
   FREE_ARRAY(Entry, table->entries, table->capacity);
   initTable(table);
 }
 //< free-table
 //> find-entry
-//> omit
-// NOTE: The "Optimization" chapter has a manual copy of this function.
-// If you change it here, make sure to update that copy.
-//< omit
-static Entry* findEntry(Entry* entries, int capacity,
-                        ObjString* key) {
-/* Hash Tables find-entry < Optimization initial-index
-  uint32_t index = key->hash % capacity;
-*/
-//> Optimization initial-index
-  uint32_t index = key->hash & (capacity - 1);
-//< Optimization initial-index
-//> find-entry-tombstone
-  Entry* tombstone = NULL;
-  
-//< find-entry-tombstone
-  for (;;) {
-    Entry* entry = &entries[index];
-/* Hash Tables find-entry < Hash Tables find-tombstone
-    if (entry->key == key || entry->key == NULL) {
-      return entry;
-    }
-*/
-//> find-tombstone
-    if (entry->key == NULL) {
-      if (IS_NIL(entry->value)) {
-        // Empty entry.
-        return tombstone != NULL ? tombstone : entry;
-      } else {
-        // We found a tombstone.
-        if (tombstone == NULL) tombstone = entry;
-      }
-    } else if (entry->key == key) {
-      // We found the key.
-      return entry;
+// Returns [key]'s entry, or NULL if it is not in the table. Groups are
+// visited in triangular order, which reaches every group when the group
+// count is a power of two.
+static inline Entry* findEntry(Table* table, ObjString* key) {
+  uint32_t hash = key->hash;
+  Entry* home = &table->entries[homeSlot(hash, table->capacity)];
+  if (home->key == key) return home;
+
+  uint32_t groupMask = groupCount(table->capacity) - 1;
+  uint32_t group = firstGroup(hash, table->capacity);
+  uint8_t fragment = hashFragment(hash);
+
+  for (uint32_t stride = 1; ; stride++) {
+    Group control = loadGroup(table->control + group * GROUP_WIDTH);
+    GroupMask matches = matchByte(control, fragment);
+    while (matches != 0) {
+      Entry* entry =
+          &table->entries[group * GROUP_WIDTH + lowestBit(matches)];
+      if (entry->key == key) return entry;
+      matches &= matches - 1;
     }
-//< find-tombstone
-
-/* Hash Tables find-entry < Optimization next-index
-    index = (index + 1) % capacity;
-*/
-//> Optimization next-index
-    index = (index + 1) & (capacity - 1);
-//< Optimization next-index
+
+    // An empty slot ends the probe sequence.
+    if (matchEmpty(control) != 0) return NULL;
+    if (stride > groupMask) return NULL;
+    group = (group + stride) & groupMask;
+  }
+}
+
+// Returns the first empty or deleted slot in [hash]'s probe sequence.
+// The table must have at least one free slot.
+static int findFreeSlot(uint8_t* control, int capacity, uint32_t hash) {
+  uint32_t home = homeSlot(hash, capacity);
+  if (control[home] & 0x80) return home;
+
+  uint32_t groupMask = groupCount(capacity) - 1;
+  uint32_t group = firstGroup(hash, capacity);
+
+  for (uint32_t stride = 1; ; stride++) {
+    GroupMask available =
+        matchFree(loadGroup(control + group * GROUP_WIDTH));
+    if (available != 0) return group * GROUP_WIDTH + lowestBit(available);
+    group = (group + stride) & groupMask;
   }
 }
 //< find-entry
@@ -74,8 +193,8 @@ static Entry* findEntry(Entry* entries, int capacity,
 bool tableGet(Table* table, ObjString* key, Value* value) {
   if (table->count == 0) return false;
 
-  Entry* entry = findEntry(table->entries, table->capacity, key);
-  if (entry->key == NULL) return false;
+  Entry* entry = findEntry(table, key);
+  if (entry == NULL) return false;
 
   *value = entry->value;
   return true;
@@ -83,131 +202,88 @@ bool tableGet(Table* table, ObjString* key, Value* value) {
 //< table-get
 //> table-adjust-capacity
 static void adjustCapacity(Table* table, int capacity) {
+  uint8_t* control = ALLOCATE(uint8_t, capacity);
   Entry* entries = ALLOCATE(Entry, capacity);
-  for (int i = 0; i < capacity; i++) {
-    entries[i].key = NULL;
-    entries[i].value = NIL_VAL;
-  }
-//> re-hash
+  memset(control, CTRL_EMPTY, capacity);
 
-//> resize-init-count
+  // Rehashing drops the tombstones.
   table->count = 0;
-//< resize-init-count
   for (int i = 0; i < table->capacity; i++) {
-    Entry* entry = &table->entries[i];
-    if (entry->key == NULL) continue;
+    if (table->control[i] & 0x80) continue;
 
-    Entry* dest = findEntry(entries, capacity, entry->key);
-    dest->key = entry->key;
-    dest->value = entry->value;
-//> resize-increment-count
+    Entry* entry = &table->entries[i];
+    int slot = findFreeSlot(control, capacity, entry->key->hash);
+    control[slot] = table->control[i];
+    entries[slot] = *entry;
     table->count++;
-//< resize-increment-count
   }
-//< re-hash
 
-//> Hash Tables free-old-array
+  FREE_ARRAY(uint8_t, table->control, table->capacity);
   FREE_ARRAY(Entry, table->entries, table->capacity);
-//< Hash Tables free-old-array
+  table->control = control;
   table->entries = entries;
   table->capacity = capacity;
 }
 //< table-adjust-capacity
 //> table-set
 bool tableSet(Table* table, ObjString* key, Value value) {
-//> table-set-grow
+  if (table->count != 0) {
+    Entry* entry = findEntry(table, key);
+    if (entry != NULL) {
+      entry->value = value;
+      return false;
+    }
+  }
+
+  // Like the entries, the count includes tombstones so that the table
+  // is rebuilt before deleted slots can fill it up.
   if (table->count + 1 > table->capacity * TABLE_MAX_LOAD) {
-    int capacity = GROW_CAPACITY(table->capacity);
+    int capacity = table->capacity < GROUP_WIDTH
+        ? GROUP_WIDTH : table->capacity * 2;
     adjustCapacity(table, capacity);
   }
 
-//< table-set-grow
-  Entry* entry = findEntry(table->entries, table->capacity, key);
-  bool isNewKey = entry->key == NULL;
-/* Hash Tables table-set < Hash Tables set-increment-count
-  if (isNewKey) table->count++;
-*/
-//> set-increment-count
-  if (isNewKey && IS_NIL(entry->value)) table->count++;
-//< set-increment-count
+  int slot = findFreeSlot(table->control, table->capacity, key->hash);
+  if (table->control[slot] == CTRL_EMPTY) table->count++;
 
-  entry->key = key;
-  entry->value = value;
-  return isNewKey;
+  table->control[slot] = hashFragment(key->hash);
+  table->entries[slot].key = key;
+  table->entries[slot].value = value;
+  return true;
 }
 //< table-set
 //> table-delete
 bool tableDelete(Table* table, ObjString* key) {
   if (table->count == 0) return false;
 
-  // Find the entry.
-  Entry* entry = findEntry(table->entries, table->capacity, key);
-  if (entry->key == NULL) return false;
+  Entry* entry = findEntry(table, key);
+  if (entry == NULL) return false;
 
-  // Place a tombstone in the entry.
+  // Leave a tombstone so probes for keys after this one keep going.
+  table->control[entry - table->entries] = CTRL_DELETED;
   entry->key = NULL;
-  entry->value = BOOL_VAL(true);
+  entry->value = NIL_VAL;
   return true;
 }
 //< table-delete
 //> table-add-all
 void tableAddAll(Table* from, Table* to) {
   for (int i = 0; i < from->capacity; i++) {
+    if (from->control[i] & 0x80) continue;
+
     Entry* entry = &from->entries[i];
-    if (entry->key != NULL) {
-      tableSet(to, entry->key, entry->value);
-    }
+    tableSet(to, entry->key, entry->value);
   }
 }
 //< table-add-all
-//> table-find-string
-ObjString* tableFindString(Table* table, const char* chars,
-                           int length, uint32_t hash) {
-  if (table->count == 0) return NULL;
-
-/* Hash Tables table-find-string < Optimization find-string-index
-  uint32_t index = hash % table->capacity;
-*/
-//> Optimization find-string-index
-  uint32_t index = hash & (table->capacity - 1);
-//< Optimization find-string-index
-  for (;;) {
-    Entry* entry = &table->entries[index];
-    if (entry->key == NULL) {
-      // Stop if we find an empty non-tombstone entry.
-      if (IS_NIL(entry->value)) return NULL;
-    } else if (entry->key->length == length &&
-        entry->key->hash == hash &&
-        memcmp(entry->key->chars, chars, length) == 0) {
-      // We found it.
-      return entry->key;
-    }
-
-/* Hash Tables table-find-string < Optimization find-string-next
-    index = (index + 1) % table->capacity;
-*/
-//> Optimization find-string-next
-    index = (index + 1) & (table->capacity - 1);
-//< Optimization find-string-next
-  }
-}
-//< table-find-string
-//> Garbage Collection table-remove-white
-void tableRemoveWhite(Table* table) {
-  for (int i = 0; i < table->capacity; i++) {
-    Entry* entry = &table->entries[i];
-    if (entry->key != NULL && !entry->key->obj.isMarked) {
-      tableDelete(table, entry->key);
-    }
-  }
-}
-//< Garbage Collection table-remove-white
 //> Garbage Collection mark-table
 void markTable(Table* table) {
   for (int i = 0; i < table->capacity; i++) {
+    if (table->control[i] & 0x80) continue;
+
     Entry* entry = &table->entries[i];
     markObject((Obj*)entry->key);
     markValue(entry->value);
   }
 }
-//< Garbage Collection mark-table
\ No newline at end of file
+//< Garbage Collection mark-table
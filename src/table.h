@@ -12,9 +12,13 @@ typedef struct {
 } Entry;
 //< entry
 
+// Each slot has a control byte alongside its entry. A full slot stores
+// the low seven bits of its key's hash there, so a probe can compare a
+// whole group of slots at once and only touch the entries that match.
 typedef struct {
   int count;
   int capacity;
+  uint8_t* control;
   Entry* entries;
 } Table;
 
@@ -35,14 +39,6 @@ bool tableDelete(Table* table, ObjString* key);
 //> table-add-all-h
 void tableAddAll(Table* from, Table* to);
 //< table-add-all-h
-//> table-find-string-h
-ObjString* tableFindString(Table* table, const char* chars,
-                           int length, uint32_t hash);
-//< table-find-string-h
-//> Garbage Collection table-remove-white-h
-
-void tableRemoveWhite(Table* table);
-//< Garbage Collection table-remove-white-h
 //> Garbage Collection mark-table-h
 void markTable(Table* table);
 //< Garbage Collection mark-table-h
@@ -0,0 +1,211 @@
+#include <string.h>
+
+#include "memory.h"
+#include "simd.h"
+#include "text.h"
+#include "vm.h"
+
+// Strings shorter than this are walked from the start rather than
+// given a character index.
+#define CHAR_INDEX_MIN 256
+
+static bool isContinuation(char c) {
+  return (c & 0xc0) == 0x80;
+}
+
+// Moves count characters forward from the character at offset.
+static int skipChars(const char* chars, int length, int offset,
+                     int count) {
+  for (; count > 0; count--) {
+    offset++;
+    while (offset < length && isContinuation(chars[offset])) offset++;
+  }
+  return offset;
+}
+
+static int heapStringLength(ObjString* string) {
+  if (string->charCount < 0) {
+    flattenString(string);
+    string->charCount = simdCountCodePoints(string->chars,
+                                            string->length);
+  }
+  return string->charCount;
+}
+
+int stringLength(Value string) {
+  if (IS_SHORT_STRING(string)) {
+    char chars[SHORT_STRING_MAX];
+    int length = unpackShortString(string, chars);
+    return simdCountCodePoints(chars, length);
+  }
+  return heapStringLength(AS_STRING(string));
+}
+
+static void buildCharIndex(ObjString* string) {
+  int entries = string->charCount / CHAR_INDEX_STRIDE + 1;
+  int* index = ALLOCATE(int, entries);
+
+  int offset = 0;
+  for (int i = 0; i < entries; i++) {
+    index[i] = offset;
+    offset = skipChars(string->chars, string->length, offset,
+                       CHAR_INDEX_STRIDE);
+  }
+  string->charIndex = index;
+}
+
+int charToByteOffset(Value string, int index) {
+  if (IS_SHORT_STRING(string)) {
+    char chars[SHORT_STRING_MAX];
+    int length = unpackShortString(string, chars);
+    return skipChars(chars, length, 0, index);
+  }
+
+  ObjString* heap = AS_STRING(string);
+  if (heapStringLength(heap) == heap->length) return index;
+  if (heap->length < CHAR_INDEX_MIN) {
+    return skipChars(heap->chars, heap->length, 0, index);
+  }
+
+  if (heap->charIndex == NULL) buildCharIndex(heap);
+  int start = heap->charIndex[index / CHAR_INDEX_STRIDE];
+  return skipChars(heap->chars, heap->length, start,
+                   index % CHAR_INDEX_STRIDE);
+}
+
+int byteToCharIndex(Value string, int offset) {
+  char buffer[SHORT_STRING_MAX];
+  int length;
+  const char* chars = stringValueChars(string, buffer, &length);
+  if (IS_STRING(string) && heapStringLength(AS_STRING(string)) == length) {
+    return offset;
+  }
+  return simdCountCodePoints(chars, offset);
+}
+
+Value stringCharAt(Value string, int index) {
+  int start = charToByteOffset(string, index);
+  char buffer[SHORT_STRING_MAX];
+  int length;
+  const char* chars = stringValueChars(string, buffer, &length);
+  int end = skipChars(chars, length, start, 1);
+  return copyStringValue(chars + start, end - start);
+}
+
+int findInString(Value string, Value needle, int start) {
+  char stringBuffer[SHORT_STRING_MAX];
+  char needleBuffer[SHORT_STRING_MAX];
+  int length;
+  int needleLength;
+  const char* chars = stringValueChars(string, stringBuffer, &length);
+  const char* needleChars = stringValueChars(needle, needleBuffer,
+                                             &needleLength);
+
+  int found = simdFind(chars + start, length - start,
+                       needleChars, needleLength);
+  return found < 0 ? -1 : start + found;
+}
+
+bool stringStartsWith(Value string, Value prefix) {
+  char stringBuffer[SHORT_STRING_MAX];
+  char prefixBuffer[SHORT_STRING_MAX];
+  int length;
+  int prefixLength;
+  const char* chars = stringValueChars(string, stringBuffer, &length);
+  const char* prefixChars = stringValueChars(prefix, prefixBuffer,
+                                             &prefixLength);
+
+  return prefixLength <= length &&
+         memcmp(chars, prefixChars, prefixLength) == 0;
+}
+
+bool stringEndsWith(Value string, Value suffix) {
+  char stringBuffer[SHORT_STRING_MAX];
+  char suffixBuffer[SHORT_STRING_MAX];
+  int length;
+  int suffixLength;
+  const char* chars = stringValueChars(string, stringBuffer, &length);
+  const char* suffixChars = stringValueChars(suffix, suffixBuffer,
+                                             &suffixLength);
+
+  return suffixLength <= length &&
+         memcmp(chars + length - suffixLength, suffixChars,
+                suffixLength) == 0;
+}
+
+ObjList* splitString(Value string, Value separator) {
+  ObjList* parts = newList();
+  push(OBJ_VAL(parts));
+
+  int length = stringValueLength(string);
+  int separatorLength = stringValueLength(separator);
+  int start = 0;
+  for (;;) {
+    int end = findInString(string, separator, start);
+    if (end < 0) end = length;
+
+    Value part = sliceString(string, start, end);
+    push(part);
+    appendToList(parts, part);
+    pop();
+
+    if (end == length) break;
+    start = end + separatorLength;
+  }
+
+  pop();
+  return parts;
+}
+
+static bool isSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+Value trimString(Value string) {
+  char buffer[SHORT_STRING_MAX];
+  int length;
+  const char* chars = stringValueChars(string, buffer, &length);
+
+  int start = 0;
+  int end = length;
+  while (start < end && isSpace(chars[start])) start++;
+  while (end > start && isSpace(chars[end - 1])) end--;
+  return sliceString(string, start, end);
+}
+
+Value replaceInString(Value string, Value from, Value to) {
+  int length = stringValueLength(string);
+  int fromLength = stringValueLength(from);
+  int toLength = stringValueLength(to);
+
+  int count = 0;
+  for (int at = findInString(string, from, 0); at >= 0;
+       at = findInString(string, from, at + fromLength)) {
+    count++;
+  }
+  if (count == 0) return string;
+
+  int resultLength = length + count * (toLength - fromLength);
+  char* result = ALLOCATE(char, resultLength + 1);
+
+  // The counting pass already flattened any ropes, so nothing below
+  // allocates and these pointers stay valid.
+  char stringBuffer[SHORT_STRING_MAX];
+  char toBuffer[SHORT_STRING_MAX];
+  const char* chars = stringValueChars(string, stringBuffer, &length);
+  const char* toChars = stringValueChars(to, toBuffer, &toLength);
+
+  char* dest = result;
+  int start = 0;
+  for (int at = findInString(string, from, 0); at >= 0;
+       at = findInString(string, from, at + fromLength)) {
+    memcpy(dest, chars + start, at - start);
+    dest += at - start;
+    memcpy(dest, toChars, toLength);
+    dest += toLength;
+    start = at + fromLength;
+  }
+  memcpy(dest, chars + start, length - start);
+  result[resultLength] = '\0';
+  return takeStringValue(result, resultLength);
+}
@@ -0,0 +1,32 @@
+#ifndef clox_text_h
+#define clox_text_h
+
+#include "common.h"
+#include "object.h"
+#include "value.h"
+
+// The operations behind the Varg natives. They take any string value,
+// short, heap or rope, which must be reachable by the GC. Positions are
+// byte offsets unless they say otherwise, and must be in bounds.
+
+// Characters are UTF-8 code points. Counts are cached on the string, so
+// after the first call these are constant time, or close to it.
+int stringLength(Value string);
+// Converts between character indexes and byte offsets. An index equal
+// to the length maps to the end of the string.
+int charToByteOffset(Value string, int index);
+int byteToCharIndex(Value string, int offset);
+Value stringCharAt(Value string, int index);
+
+// Returns where needle first occurs at or after start, or -1.
+int findInString(Value string, Value needle, int start);
+bool stringStartsWith(Value string, Value prefix);
+bool stringEndsWith(Value string, Value suffix);
+// The parts are slices of the string. separator must not be empty.
+ObjList* splitString(Value string, Value separator);
+// Drops spaces, tabs and line breaks from both ends.
+Value trimString(Value string);
+// Replaces every occurrence of from, which must not be empty.
+Value replaceInString(Value string, Value from, Value to);
+
+#endif
@@ -8,6 +8,7 @@
 #include "object.h"
 //< Strings value-include-object
 #include "memory.h"
+#include "output.h"
 #include "value.h"
 
 void initValueArray(ValueArray* array) {
@@ -39,11 +40,15 @@ void printValue(Value value) {
 //> Optimization print-value
 #ifdef NAN_BOXING
   if (IS_BOOL(value)) {
-    printf(AS_BOOL(value) ? "true" : "false");
+    writeOutputString(AS_BOOL(value) ? "true" : "false");
   } else if (IS_NIL(value)) {
-    printf("nil");
+    writeOutput("nil", 3);
   } else if (IS_NUMBER(value)) {
-    printf("%g", AS_NUMBER(value));
+    writeOutputNumber(AS_NUMBER(value));
+  } else if (IS_SHORT_STRING(value)) {
+    char chars[SHORT_STRING_MAX];
+    int length = unpackShortString(value, chars);
+    writeOutput(chars, length);
   } else if (IS_OBJ(value)) {
     printObject(value);
   }
@@ -58,13 +63,19 @@ void printValue(Value value) {
 //> Types of Values print-value
   switch (value.type) {
     case VAL_BOOL:
-      printf(AS_BOOL(value) ? "true" : "false");
+      writeOutputString(AS_BOOL(value) ? "true" : "false");
       break;
-    case VAL_NIL: printf("nil"); break;
-    case VAL_NUMBER: printf("%g", AS_NUMBER(value)); break;
+    case VAL_NIL: writeOutput("nil", 3); break;
+    case VAL_NUMBER: writeOutputNumber(AS_NUMBER(value)); break;
 //> Strings call-print-object
     case VAL_OBJ: printObject(value); break;
 //< Strings call-print-object
+    case VAL_SHORT_STRING: {
+      char chars[SHORT_STRING_MAX];
+      int length = unpackShortString(value, chars);
+      writeOutput(chars, length);
+      break;
+    }
   }
 //< Types of Values print-value
 //> Optimization end-print-value
@@ -81,9 +92,16 @@ bool valuesEqual(Value a, Value b) {
     return AS_NUMBER(a) == AS_NUMBER(b);
   }
 //< nan-equality
-  return a == b;
+  if (a == b) return true;
+  if (IS_ANY_STRING(a) && IS_ANY_STRING(b)) {
+    return stringValuesEqual(a, b);
+  }
+  return false;
 #else
 //< Optimization values-equal
+  if (IS_ANY_STRING(a) && IS_ANY_STRING(b)) {
+    return stringValuesEqual(a, b);
+  }
   if (a.type != b.type) return false;
   switch (a.type) {
     case VAL_BOOL:   return AS_BOOL(a) == AS_BOOL(b);
@@ -31,6 +31,12 @@ typedef struct ObjString ObjString;
 #define TAG_TRUE  3 // 11.
 //< tags
 
+// Strings of up to SHORT_STRING_MAX bytes with no NUL byte are packed
+// into the low 48 bits of the payload, first character lowest. Bit 49
+// tells them apart from the singleton tags above.
+#define TAG_SHORT_STRING ((uint64_t)1 << 49)
+#define SHORT_STRING_MASK ((uint64_t)0x0000ffffffffffff)
+
 typedef uint64_t Value;
 //> is-number
 
@@ -46,6 +52,9 @@ typedef uint64_t Value;
 #define IS_OBJ(value) \
     (((value) & (QNAN | SIGN_BIT)) == (QNAN | SIGN_BIT))
 //< is-obj
+#define IS_SHORT_STRING(value) \
+    (((value) & (SIGN_BIT | QNAN | TAG_SHORT_STRING)) == \
+        (QNAN | TAG_SHORT_STRING))
 //> as-number
 
 //> as-bool
@@ -57,6 +66,7 @@ typedef uint64_t Value;
 #define AS_OBJ(value) \
     ((Obj*)(uintptr_t)((value) & ~(SIGN_BIT | QNAN)))
 //< as-obj
+#define AS_SHORT_STRING(value) ((value) & SHORT_STRING_MASK)
 //> number-val
 
 //> bool-val
@@ -75,6 +85,8 @@ typedef uint64_t Value;
 #define OBJ_VAL(obj) \
     (Value)(SIGN_BIT | QNAN | (uint64_t)(uintptr_t)(obj))
 //< obj-val
+#define SHORT_STRING_VAL(bits) \
+    ((Value)(QNAN | TAG_SHORT_STRING | (uint64_t)(bits)))
 //> value-to-num
 
 static inline double valueToNum(Value value) {
@@ -101,8 +113,9 @@ typedef enum {
   VAL_NIL, // [user-types]
   VAL_NUMBER,
 //> Strings val-obj
-  VAL_OBJ
+  VAL_OBJ,
 //< Strings val-obj
+  VAL_SHORT_STRING
 } ValueType;
 
 //< Types of Values value-type
@@ -118,6 +131,7 @@ typedef struct {
 //> Strings union-object
     Obj* obj;
 //< Strings union-object
+    uint64_t shortString;
   } as; // [as]
 } Value;
 //< Types of Values value
@@ -129,12 +143,14 @@ typedef struct {
 //> Strings is-obj
 #define IS_OBJ(value)     ((value).type == VAL_OBJ)
 //< Strings is-obj
+#define IS_SHORT_STRING(value) ((value).type == VAL_SHORT_STRING)
 //< Types of Values is-macros
 //> Types of Values as-macros
 
 //> Strings as-obj
 #define AS_OBJ(value)     ((value).as.obj)
 //< Strings as-obj
+#define AS_SHORT_STRING(value) ((value).as.shortString)
 #define AS_BOOL(value)    ((value).as.boolean)
 #define AS_NUMBER(value)  ((value).as.number)
 //< Types of Values as-macros
@@ -146,11 +162,54 @@ typedef struct {
 //> Strings obj-val
 #define OBJ_VAL(object)   ((Value){VAL_OBJ, {.obj = (Obj*)object}})
 //< Strings obj-val
+#define SHORT_STRING_VAL(bits) \
+    ((Value){VAL_SHORT_STRING, {.shortString = (bits)}})
 //< Types of Values value-macros
 //> Optimization end-if-nan-boxing
 
 #endif
 //< Optimization end-if-nan-boxing
+
+#define SHORT_STRING_MAX 6
+
+static inline bool fitsShortString(const char* chars, int length) {
+  if (length > SHORT_STRING_MAX) return false;
+  return memchr(chars, '\0', length) == NULL;
+}
+
+static inline Value makeShortString(const char* chars, int length) {
+  uint64_t bits = 0;
+  for (int i = length - 1; i >= 0; i--) {
+    bits = (bits << 8) | (uint8_t)chars[i];
+  }
+  return SHORT_STRING_VAL(bits);
+}
+
+static inline int shortStringLength(Value value) {
+  uint64_t bits = AS_SHORT_STRING(value);
+  if (bits == 0) return 0;
+#ifdef __GNUC__
+  return (64 - __builtin_clzll(bits) + 7) / 8;
+#else
+  int length = 0;
+  while (bits != 0) {
+    bits >>= 8;
+    length++;
+  }
+  return length;
+#endif
+}
+
+// Writes the characters into [chars] and returns how many there were.
+static inline int unpackShortString(Value value, char* chars) {
+  uint64_t bits = AS_SHORT_STRING(value);
+  int length = 0;
+  while (bits != 0) {
+    chars[length++] = (char)(bits & 0xff);
+    bits >>= 8;
+  }
+  return length;
+}
 //> value-array
 
 typedef struct {
@@ -18,19 +18,35 @@
 //< Scanning on Demand vm-include-compiler
 //> vm-include-debug
 #include "debug.h"
+#include "dtoa.h"
+#include "file.h"
+#include "list.h"
+#include "map.h"
+#include "parallel.h"
 //< vm-include-debug
 //> Strings vm-include-object-memory
 #include "object.h"
 #include "memory.h"
+#include "simd.h"
+#include "text.h"
 //< Strings vm-include-object-memory
 #include "vm.h"
 
-VM vm; // [one]
+THREAD_LOCAL VM vm; // [one]
 //> Calls and Functions clock-native
 static Value clockNative(int argCount, Value* args) {
   return NUMBER_VAL((double)clock() / CLOCKS_PER_SEC);
 }
 static void defineMethodNative(ObjClass* klass, const char* name, NativeFn fn);
+static bool call(ObjClosure* closure, int argCount);
+static Value argumentetNative(int argCount, Value* args) {
+  if (vm.arguments == NULL) return OBJ_VAL(newList());
+  return OBJ_VAL(copyList(vm.arguments));
+}
+static Value zbrazNative(int argCount, Value* args) {
+  flushOutput();
+  return NIL_VAL;
+}
 static Value lexoNative(int argCount, Value* args) {
   // We can't easily trigger a runtime error from a native function,
   // so we'll just return an empty string if the arguments are wrong.
@@ -38,41 +54,35 @@ static Value lexoNative(int argCount, Value* args) {
   if (argCount != 0) {
     // We could print a warning to stderr if we wanted.
     // fprintf(stderr, "Warning: lexo() takes no arguments.\n");
-    return OBJ_VAL(copyString("", 0));
+    return copyStringValue("", 0);
   }
-  
-  size_t bufferSize = 128;
-  char* line = (char*)malloc(bufferSize);
-  // Check for malloc failure
-  if (line == NULL) return OBJ_VAL(copyString("", 0));
-
-  int c;
-  size_t i = 0;
-  while ((c = getchar()) != '\n' && c != EOF) {
-    line[i++] = (char)c;
-    if (i >= bufferSize) {
-      bufferSize *= 2;
-      char* newLine = (char*)realloc(line, bufferSize);
-      if (newLine == NULL) {
-        // Realloc failed, clean up and return empty
-        free(line);
-        return OBJ_VAL(copyString("", 0));
-      }
-      line = newLine;
-    }
+
+  Value line;
+  if (!readInputLine(&vm.input, &line)) return copyStringValue("", 0);
+  return line;
+}
+
+// Like lexo(), but returns nil at the end of the input so a loop can
+// tell it apart from an empty line.
+static Value rreshtiNative(int argCount, Value* args) {
+  Value line;
+  if (!readInputLine(&vm.input, &line)) return NIL_VAL;
+  return line;
+}
+
+static Value lexoTeGjithaNative(int argCount, Value* args) {
+  Value text;
+  if (!readAllInput(&vm.input, &text)) {
+    return nativeError("Input is too large.");
   }
-  line[i] = '\0';
-  
-  // takeString is GC-safe and will manage the 'line' buffer's memory.
-  return OBJ_VAL(takeString(line, i));
+  return text;
 }
 // REPLACE these two functions in src/vm.c
 
 static Value stringGjatesiaNative(int argCount, Value* args) {
     // The receiver (the string object) is one slot BELOW the arguments pointer.
     Value receiver = args[-1];
-    ObjString* string = AS_STRING(receiver);
-    return NUMBER_VAL(string->length);
+    return NUMBER_VAL(stringLength(receiver));
 }
 
 static Value listGjatesiaNative(int argCount, Value* args) {
@@ -81,11 +91,791 @@ static Value listGjatesiaNative(int argCount, Value* args) {
     ObjList* list = AS_LIST(receiver);
     return NUMBER_VAL(list->items.count);
 }
+
+// Reads args[arg] as a position in [0, limit]. kind names the receiver
+// in error messages.
+static bool indexArg(Value* args, int arg, int limit, const char* kind,
+                     int* index) {
+  if (!IS_NUMBER(args[arg])) {
+    nativeError("%s index must be a number.", kind);
+    return false;
+  }
+
+  double number = AS_NUMBER(args[arg]);
+  if (number < 0 || number > limit || number != (int)number) {
+    nativeError("%s index out of bounds.", kind);
+    return false;
+  }
+
+  *index = (int)number;
+  return true;
+}
+
+static bool listIndexArg(Value* args, int arg, int limit, int* index) {
+  return indexArg(args, arg, limit, "List", index);
+}
+
+static bool stringIndexArg(Value* args, int arg, int limit, int* index) {
+  return indexArg(args, arg, limit, "String", index);
+}
+
+static bool stringArg(Value* args, int arg) {
+  if (!IS_ANY_STRING(args[arg])) {
+    nativeError("Argument must be a string.");
+    return false;
+  }
+  return true;
+}
+
+// pjese(fillimi, fundi) returns the characters from fillimi up to but
+// not including fundi, sharing the receiver's bytes.
+static Value stringPjeseNative(int argCount, Value* args) {
+  if (argCount != 1 && argCount != 2) {
+    return nativeError("Expected 1 or 2 arguments but got %d.", argCount);
+  }
+
+  int length = stringLength(args[-1]);
+  int start;
+  int end = length;
+  if (!stringIndexArg(args, 0, length, &start)) return NIL_VAL;
+  if (argCount == 2 && !stringIndexArg(args, 1, length, &end)) {
+    return NIL_VAL;
+  }
+  if (end < start) end = start;
+
+  return sliceString(args[-1], charToByteOffset(args[-1], start),
+                     charToByteOffset(args[-1], end));
+}
+
+// indeksi(nenvargu, fillimi) returns where nenvargu first occurs at or
+// after fillimi, or -1.
+static Value stringIndeksiNative(int argCount, Value* args) {
+  if (argCount != 1 && argCount != 2) {
+    return nativeError("Expected 1 or 2 arguments but got %d.", argCount);
+  }
+  if (!stringArg(args, 0)) return NIL_VAL;
+
+  int start = 0;
+  if (argCount == 2) {
+    if (!stringIndexArg(args, 1, stringLength(args[-1]), &start)) {
+      return NIL_VAL;
+    }
+    start = charToByteOffset(args[-1], start);
+  }
+
+  int found = findInString(args[-1], args[0], start);
+  if (found < 0) return NUMBER_VAL(-1);
+  return NUMBER_VAL(byteToCharIndex(args[-1], found));
+}
+
+static Value stringPermbanNative(int argCount, Value* args) {
+  if (argCount != 1) {
+    return nativeError("Expected 1 arguments but got %d.", argCount);
+  }
+  if (!stringArg(args, 0)) return NIL_VAL;
+
+  return BOOL_VAL(findInString(args[-1], args[0], 0) >= 0);
+}
+
+static Value stringFillonMeNative(int argCount, Value* args) {
+  if (argCount != 1) {
+    return nativeError("Expected 1 arguments but got %d.", argCount);
+  }
+  if (!stringArg(args, 0)) return NIL_VAL;
+
+  return BOOL_VAL(stringStartsWith(args[-1], args[0]));
+}
+
+static Value stringMbaronMeNative(int argCount, Value* args) {
+  if (argCount != 1) {
+    return nativeError("Expected 1 arguments but got %d.", argCount);
+  }
+  if (!stringArg(args, 0)) return NIL_VAL;
+
+  return BOOL_VAL(stringEndsWith(args[-1], args[0]));
+}
+
+static Value stringNdajNative(int argCount, Value* args) {
+  if (argCount != 1) {
+    return nativeError("Expected 1 arguments but got %d.", argCount);
+  }
+  if (!stringArg(args, 0)) return NIL_VAL;
+  if (stringValueLength(args[0]) == 0) {
+    return nativeError("Separator can't be empty.");
+  }
+
+  return OBJ_VAL(splitString(args[-1], args[0]));
+}
+
+static Value stringPastroNative(int argCount, Value* args) {
+  if (argCount != 0) {
+    return nativeError("Expected 0 arguments but got %d.", argCount);
+  }
+
+  return trimString(args[-1]);
+}
+
+static Value stringZevendesoNative(int argCount, Value* args) {
+  if (argCount != 2) {
+    return nativeError("Expected 2 arguments but got %d.", argCount);
+  }
+  if (!stringArg(args, 0) || !stringArg(args, 1)) return NIL_VAL;
+  if (stringValueLength(args[0]) == 0) {
+    return nativeError("Can't replace an empty string.");
+  }
+
+  return replaceInString(args[-1], args[0], args[1]);
+}
+
+static Value listShtoNative(int argCount, Value* args) {
+  if (argCount != 1) {
+    return nativeError("Expected 1 arguments but got %d.", argCount);
+  }
+
+  appendToList(AS_LIST(args[-1]), args[0]);
+  return NIL_VAL;
+}
+
+static Value listHiqNative(int argCount, Value* args) {
+  if (argCount != 0) {
+    return nativeError("Expected 0 arguments but got %d.", argCount);
+  }
+
+  ObjList* list = AS_LIST(args[-1]);
+  if (list->items.count == 0) {
+    return nativeError("Can't remove from an empty list.");
+  }
+  return removeFromList(list, list->items.count - 1);
+}
+
+static Value listFutNative(int argCount, Value* args) {
+  if (argCount != 2) {
+    return nativeError("Expected 2 arguments but got %d.", argCount);
+  }
+
+  ObjList* list = AS_LIST(args[-1]);
+  int index;
+  if (!listIndexArg(args, 0, list->items.count, &index)) return NIL_VAL;
+
+  insertInList(list, index, args[1]);
+  return NIL_VAL;
+}
+
+static Value listFshiNative(int argCount, Value* args) {
+  if (argCount != 1) {
+    return nativeError("Expected 1 arguments but got %d.", argCount);
+  }
+
+  ObjList* list = AS_LIST(args[-1]);
+  int index;
+  if (!listIndexArg(args, 0, list->items.count - 1, &index)) {
+    return NIL_VAL;
+  }
+  return removeFromList(list, index);
+}
+
+static Value listRezervoNative(int argCount, Value* args) {
+  if (argCount != 1) {
+    return nativeError("Expected 1 arguments but got %d.", argCount);
+  }
+
+  int capacity;
+  if (!listIndexArg(args, 0, INT32_MAX / (int)sizeof(Value), &capacity)) {
+    return NIL_VAL;
+  }
+  reserveList(AS_LIST(args[-1]), capacity);
+  return NIL_VAL;
+}
+
+// pjese(fillimi, fundi) returns the items from fillimi up to but not
+// including fundi. fundi defaults to the end of the list.
+static Value listPjeseNative(int argCount, Value* args) {
+  if (argCount != 1 && argCount != 2) {
+    return nativeError("Expected 1 or 2 arguments but got %d.", argCount);
+  }
+
+  ObjList* list = AS_LIST(args[-1]);
+  int start;
+  int end = list->items.count;
+  if (!listIndexArg(args, 0, list->items.count, &start)) return NIL_VAL;
+  if (argCount == 2 && !listIndexArg(args, 1, list->items.count, &end)) {
+    return NIL_VAL;
+  }
+  if (end < start) end = start;
+
+  return OBJ_VAL(sliceList(list, start, end));
+}
+
+static Value listRenditNative(int argCount, Value* args) {
+  if (argCount > 1) {
+    return nativeError("Expected 0 or 1 arguments but got %d.", argCount);
+  }
+
+  Value comparator = argCount == 1 ? args[0] : NIL_VAL;
+  sortList(AS_LIST(args[-1]), comparator);
+  return NIL_VAL;
+}
+
+static bool numericList(Value value, ObjList** list) {
+  if (!IS_LIST(value) || !listIsNumeric(AS_LIST(value))) {
+    nativeError("List must contain only numbers.");
+    return false;
+  }
+
+  *list = AS_LIST(value);
+  return true;
+}
+
+// Checks the receiver and the argument of prodhimi() and mbledh().
+static bool numericListPair(int argCount, Value* args, ObjList** list,
+                            ObjList** other) {
+  if (argCount != 1) {
+    nativeError("Expected 1 arguments but got %d.", argCount);
+    return false;
+  }
+  if (!numericList(args[-1], list) || !numericList(args[0], other)) {
+    return false;
+  }
+  if ((*list)->items.count != (*other)->items.count) {
+    nativeError("Lists must have the same length.");
+    return false;
+  }
+  return true;
+}
+
+static Value listShumaNative(int argCount, Value* args) {
+  if (argCount != 0) {
+    return nativeError("Expected 0 arguments but got %d.", argCount);
+  }
+
+  ObjList* list;
+  if (!numericList(args[-1], &list)) return NIL_VAL;
+  return NUMBER_VAL(listSum(list));
+}
+
+// min() and maks() skip NaNs and return nil for an empty list.
+static Value listMinNative(int argCount, Value* args) {
+  if (argCount != 0) {
+    return nativeError("Expected 0 arguments but got %d.", argCount);
+  }
+
+  ObjList* list;
+  if (!numericList(args[-1], &list)) return NIL_VAL;
+  if (list->items.count == 0) return NIL_VAL;
+  return NUMBER_VAL(listMin(list));
+}
+
+static Value listMaksNative(int argCount, Value* args) {
+  if (argCount != 0) {
+    return nativeError("Expected 0 arguments but got %d.", argCount);
+  }
+
+  ObjList* list;
+  if (!numericList(args[-1], &list)) return NIL_VAL;
+  if (list->items.count == 0) return NIL_VAL;
+  return NUMBER_VAL(listMax(list));
+}
+
+static Value listProdhimiNative(int argCount, Value* args) {
+  ObjList* list;
+  ObjList* other;
+  if (!numericListPair(argCount, args, &list, &other)) return NIL_VAL;
+  return NUMBER_VAL(listDot(list, other));
+}
+
+static Value listShkallezoNative(int argCount, Value* args) {
+  if (argCount != 1) {
+    return nativeError("Expected 1 arguments but got %d.", argCount);
+  }
+
+  ObjList* list;
+  if (!numericList(args[-1], &list)) return NIL_VAL;
+  if (!IS_NUMBER(args[0])) return nativeError("Factor must be a number.");
+  scaleList(list, AS_NUMBER(args[0]));
+  return NIL_VAL;
+}
+
+static Value listMbledhNative(int argCount, Value* args) {
+  ObjList* list;
+  ObjList* other;
+  if (!numericListPair(argCount, args, &list, &other)) return NIL_VAL;
+  addElementwise(list, other);
+  return NIL_VAL;
+}
+
+// mbush(vlera, sasia) sets every item to vlera. sasia, if given, sets
+// the length first.
+static Value listMbushNative(int argCount, Value* args) {
+  if (argCount != 1 && argCount != 2) {
+    return nativeError("Expected 1 or 2 arguments but got %d.", argCount);
+  }
+
+  ObjList* list = AS_LIST(args[-1]);
+  int count = list->items.count;
+  if (argCount == 2 &&
+      !listIndexArg(args, 1, INT32_MAX / (int)sizeof(Value), &count)) {
+    return NIL_VAL;
+  }
+  fillList(list, args[0], count);
+  return NIL_VAL;
+}
+
+static Value listIndeksiNative(int argCount, Value* args) {
+  if (argCount != 1) {
+    return nativeError("Expected 1 arguments but got %d.", argCount);
+  }
+
+  return NUMBER_VAL(listIndexOf(AS_LIST(args[-1]), args[0]));
+}
+
+static Value listHartoParalelNative(int argCount, Value* args) {
+  if (argCount != 1) {
+    return nativeError("Expected 1 arguments but got %d.", argCount);
+  }
+
+  Value result;
+  if (!parallelMap(AS_LIST(args[-1]), args[0], &result)) return NIL_VAL;
+  return result;
+}
+
+static Value listPalosParalelNative(int argCount, Value* args) {
+  if (argCount != 2) {
+    return nativeError("Expected 2 arguments but got %d.", argCount);
+  }
+
+  Value result;
+  if (!parallelReduce(AS_LIST(args[-1]), args[0], args[1], &result)) {
+    return NIL_VAL;
+  }
+  return result;
+}
+
+static Value mapGjatesiaNative(int argCount, Value* args) {
+  if (argCount != 0) {
+    return nativeError("Expected 0 arguments but got %d.", argCount);
+  }
+
+  return NUMBER_VAL(AS_MAP(args[-1])->count);
+}
+
+// Returns the map's keys as a new list, in no particular order.
+static Value mapCelesatNative(int argCount, Value* args) {
+  if (argCount != 0) {
+    return nativeError("Expected 0 arguments but got %d.", argCount);
+  }
+
+  ObjMap* map = AS_MAP(args[-1]);
+  ObjList* keys = newList();
+  push(OBJ_VAL(keys));
+  for (int i = 0; i < map->capacity; i++) {
+    MapEntry* entry = &map->entries[i];
+    if (!IS_NIL(entry->key)) appendToList(keys, entry->key);
+  }
+  pop();
+  return OBJ_VAL(keys);
+}
+
+static Value mapPermbanNative(int argCount, Value* args) {
+  if (argCount != 1) {
+    return nativeError("Expected 1 arguments but got %d.", argCount);
+  }
+
+  Value value;
+  return BOOL_VAL(mapGet(AS_MAP(args[-1]), args[0], &value));
+}
+
+static Value mapFshiNative(int argCount, Value* args) {
+  if (argCount != 1) {
+    return nativeError("Expected 1 arguments but got %d.", argCount);
+  }
+
+  return BOOL_VAL(mapDelete(AS_MAP(args[-1]), args[0]));
+}
+
+// hap(shtegu[, menyra]) opens a file for reading, or with "w" or "a" for
+// writing or appending. Returns nil if the file can't be opened.
+static Value hapNative(int argCount, Value* args) {
+  if (argCount != 1 && argCount != 2) {
+    return nativeError("Expected 1 or 2 arguments but got %d.", argCount);
+  }
+  if (!stringArg(args, 0)) return NIL_VAL;
+
+  FileMode mode = FILE_READ;
+  if (argCount == 2) {
+    if (!stringArg(args, 1)) return NIL_VAL;
+    char buffer[SHORT_STRING_MAX];
+    int length;
+    const char* chars = stringValueChars(args[1], buffer, &length);
+    if (length == 1 && chars[0] == 'w') {
+      mode = FILE_WRITE;
+    } else if (length == 1 && chars[0] == 'a') {
+      mode = FILE_APPEND;
+    } else if (!(length == 1 && chars[0] == 'r')) {
+      return nativeError("File mode must be \"r\", \"w\" or \"a\".");
+    }
+  }
+
+  ObjFile* file = openFile(args[0], mode);
+  return file == NULL ? NIL_VAL : OBJ_VAL(file);
+}
+
+static ObjFile* openFileArg(Value* args, bool writing) {
+  ObjFile* file = AS_FILE(args[-1]);
+  if (!file->isOpen) {
+    nativeError("File is closed.");
+    return NULL;
+  }
+  if (writing ? !file->isWritable : !file->isReadable) {
+    nativeError(writing ? "File is not open for writing."
+                        : "File is not open for reading.");
+    return NULL;
+  }
+  return file;
+}
+
+static Value fileLexoNative(int argCount, Value* args) {
+  if (argCount != 0) {
+    return nativeError("Expected 0 arguments but got %d.", argCount);
+  }
+  ObjFile* file = openFileArg(args, false);
+  if (file == NULL) return NIL_VAL;
+
+  Value text;
+  if (!readAllInput(&file->input, &text)) {
+    return nativeError("File is too large.");
+  }
+  return text;
+}
+
+static Value fileRreshtiNative(int argCount, Value* args) {
+  if (argCount != 0) {
+    return nativeError("Expected 0 arguments but got %d.", argCount);
+  }
+  ObjFile* file = openFileArg(args, false);
+  if (file == NULL) return NIL_VAL;
+
+  Value line;
+  if (!readInputLine(&file->input, &line)) return NIL_VAL;
+  return line;
+}
+
+// shkruaj(...) writes each argument, which must be strings or numbers.
+static Value fileShkruajNative(int argCount, Value* args) {
+  ObjFile* file = openFileArg(args, true);
+  if (file == NULL) return NIL_VAL;
+
+  for (int i = 0; i < argCount; i++) {
+    if (!IS_NUMBER(args[i]) && !IS_ANY_STRING(args[i])) {
+      return nativeError("Can only write strings and numbers.");
+    }
+    if (!writeFile(file, args[i])) {
+      return nativeError("Could not write to file.");
+    }
+  }
+  return NIL_VAL;
+}
+
+static Value fileZbrazNative(int argCount, Value* args) {
+  if (argCount != 0) {
+    return nativeError("Expected 0 arguments but got %d.", argCount);
+  }
+  ObjFile* file = openFileArg(args, true);
+  if (file == NULL) return NIL_VAL;
+
+  if (!flushFile(file)) return nativeError("Could not write to file.");
+  return NIL_VAL;
+}
+
+static Value fileMbyllNative(int argCount, Value* args) {
+  if (argCount != 0) {
+    return nativeError("Expected 0 arguments but got %d.", argCount);
+  }
+  ObjFile* file = AS_FILE(args[-1]);
+  if (!file->isOpen) return NIL_VAL;
+
+  if (!closeFile(file)) return nativeError("Could not write to file.");
+  return NIL_VAL;
+}
+
+static CallStack* runningStack() {
+  return vm.coroutine == NULL ? &vm.mainStack : &vm.coroutine->stack;
+}
+
+// Moves the VM onto [coroutine]'s stack, or the main stack for NULL.
+// The running stack's state is only current in the VM, so it is saved
+// first.
+static void switchStack(ObjCoroutine* coroutine) {
+  CallStack* stack = runningStack();
+  stack->stackTop = vm.stackTop;
+  stack->frameCount = vm.frameCount;
+  stack->baseFrameCount = vm.baseFrameCount;
+  stack->openUpvalues = vm.openUpvalues;
+
+  vm.coroutine = coroutine;
+  stack = runningStack();
+  vm.stack = stack->stack;
+  vm.stackTop = stack->stackTop;
+  vm.frames = stack->frames;
+  vm.frameCount = stack->frameCount;
+  vm.baseFrameCount = stack->baseFrameCount;
+  vm.openUpvalues = stack->openUpvalues;
+}
+
+// Called once the coroutine is off the VM.
+static void finishCoroutine(ObjCoroutine* coroutine) {
+  coroutine->state = COROUTINE_DONE;
+  coroutine->resumer = NULL;
+  coroutine->stack.stackTop = coroutine->stack.stack;
+  coroutine->stack.frameCount = 0;
+  coroutine->stack.baseFrameCount = 0;
+  coroutine->stack.openUpvalues = NULL;
+}
+
+// Switches to [context], the main stack if NULL, and hands it value as
+// the result of the call it stopped in. A coroutine that hasn't started
+// gets it as its function's argument, if it takes one.
+static void enterContext(ObjCoroutine* context, Value value) {
+  bool starting = context != NULL && context->stack.frameCount == 0;
+  if (context != NULL) context->state = COROUTINE_RUNNING;
+  switchStack(context);
+  if (!starting) {
+    push(value);
+    return;
+  }
+
+  ObjClosure* closure = context->closure;
+  push(OBJ_VAL(closure));
+  if (closure->function->arity == 1) push(value);
+  call(closure, closure->function->arity);
+}
+
+static ObjClosure* coroutineFunctionArg(Value* args) {
+  if (!IS_CLOSURE(args[0])) {
+    nativeError("Expected a function.");
+    return NULL;
+  }
+  ObjClosure* closure = AS_CLOSURE(args[0]);
+  if (closure->function->arity > 1) {
+    nativeError("A coroutine's function takes at most 1 argument.");
+    return NULL;
+  }
+  return closure;
+}
+
+static Value korutineNative(int argCount, Value* args) {
+  if (argCount != 1) {
+    return nativeError("Expected 1 arguments but got %d.", argCount);
+  }
+  ObjClosure* closure = coroutineFunctionArg(args);
+  if (closure == NULL) return NIL_VAL;
+  return OBJ_VAL(newCoroutine(closure));
+}
+
+// Resuming and yielding switch stacks. Each pops its own call from the
+// stack it was made on, and the value it passes becomes the result of
+// the call waiting on the other stack. callNative() sees the switch and
+// leaves both stacks alone.
+static Value coroutineVazhdoNative(int argCount, Value* args) {
+  if (argCount > 1) {
+    return nativeError("Expected 0 or 1 arguments but got %d.", argCount);
+  }
+  ObjCoroutine* coroutine = AS_COROUTINE(args[-1]);
+  if (coroutine->state == COROUTINE_DONE) {
+    return nativeError("Can't resume a coroutine that has finished.");
+  }
+  if (coroutine->state == COROUTINE_RUNNING) {
+    return nativeError("Can't resume a coroutine that is running.");
+  }
+  if (coroutine->isTask) return nativeError("Can't resume a task.");
+  if (vm.inNativeCall) {
+    return nativeError("Can't resume a coroutine from inside a native.");
+  }
+
+  Value value = argCount == 1 ? args[0] : NIL_VAL;
+  vm.stackTop -= argCount + 1;
+  coroutine->resumer = vm.coroutine;
+  enterContext(coroutine, value);
+  return NIL_VAL;
+}
+
+static Value coroutinePerfundoiNative(int argCount, Value* args) {
+  if (argCount != 0) {
+    return nativeError("Expected 0 arguments but got %d.", argCount);
+  }
+  return BOOL_VAL(AS_COROUTINE(args[-1])->state == COROUTINE_DONE);
+}
+
+static Value jepNative(int argCount, Value* args) {
+  if (argCount > 1) {
+    return nativeError("Expected 0 or 1 arguments but got %d.", argCount);
+  }
+  ObjCoroutine* coroutine = vm.coroutine;
+  if (coroutine == NULL) {
+    return nativeError("Can only yield inside a coroutine.");
+  }
+  if (coroutine->isTask) {
+    return nativeError("A task can't yield. It can wait instead.");
+  }
+  // A native further down this stack is waiting for a nested run() to
+  // return, so the stack can't be left.
+  if (vm.inNativeCall || vm.baseFrameCount != 0) {
+    return nativeError("Can't yield from inside a native.");
+  }
+
+  Value value = argCount == 1 ? args[0] : NIL_VAL;
+  vm.stackTop -= argCount + 1;
+  coroutine->state = COROUTINE_SUSPENDED;
+  switchStack(coroutine->resumer);
+  coroutine->resumer = NULL;
+  push(value);
+  return NIL_VAL;
+}
+
+// Whether the running context can wait in the event loop. The loop may
+// run any other context before this one wakes, so no native anywhere
+// down its chain of resumers can be waiting on a nested run().
+static bool canWait() {
+  if (vm.inNativeCall || vm.baseFrameCount != 0) return false;
+  for (ObjCoroutine* coroutine = vm.coroutine;
+       coroutine != NULL && !coroutine->isTask;
+       coroutine = coroutine->resumer) {
+    CallStack* resumer = coroutine->resumer == NULL
+        ? &vm.mainStack : &coroutine->resumer->stack;
+    if (resumer->baseFrameCount != 0) return false;
+  }
+  return true;
+}
+
+// Parks the running context and hands the VM to the next one the loop
+// has ready, like jep() does. The next one may be this context again,
+// in which case the value is simply returned.
+static Value waitInLoop(int argCount) {
+  Wakeup wakeup;
+  if (!nextWakeup(&wakeup)) return NIL_VAL;
+  if (wakeup.context == vm.coroutine) return wakeup.value;
+
+  vm.stackTop -= argCount + 1;
+  enterContext(wakeup.context, wakeup.value);
+  return NIL_VAL;
+}
+
+// detyre(funksioni, [argumenti]) starts a task the next time the running
+// context waits.
+static Value detyreNative(int argCount, Value* args) {
+  if (argCount != 1 && argCount != 2) {
+    return nativeError("Expected 1 or 2 arguments but got %d.", argCount);
+  }
+  ObjClosure* closure = coroutineFunctionArg(args);
+  if (closure == NULL) return NIL_VAL;
+
+  ObjCoroutine* task = newCoroutine(closure);
+  task->isTask = true;
+  push(OBJ_VAL(task));
+  addTask(task, argCount == 2 ? args[1] : NIL_VAL);
+  return pop();
+}
+
+// fli(sekondat) lets the other contexts run for a while.
+static Value fliNative(int argCount, Value* args) {
+  if (argCount != 1) {
+    return nativeError("Expected 1 arguments but got %d.", argCount);
+  }
+  if (!IS_NUMBER(args[0]) || !(AS_NUMBER(args[0]) >= 0)) {
+    return nativeError("Expected a number of seconds.");
+  }
+  if (!canWait()) return nativeError("Can't wait from inside a native.");
+
+  waitForTime(vm.coroutine, AS_NUMBER(args[0]));
+  return waitInLoop(argCount);
+}
+
+// prisDetyrat() waits until every task has finished.
+static Value prisDetyratNative(int argCount, Value* args) {
+  if (argCount != 0) {
+    return nativeError("Expected 0 arguments but got %d.", argCount);
+  }
+  if (taskCount() == 0) return NIL_VAL;
+
+  for (ObjCoroutine* coroutine = vm.coroutine; coroutine != NULL;
+       coroutine = coroutine->resumer) {
+    if (coroutine->isTask) {
+      return nativeError("A task can't wait for the tasks.");
+    }
+  }
+  if (!canWait()) return nativeError("Can't wait from inside a native.");
+  if (!waitForTasks(vm.coroutine)) {
+    return nativeError("Something is already waiting for the tasks.");
+  }
+  return waitInLoop(argCount);
+}
+
+static Value waitForFileArg(int argCount, ObjFile* file, WaitKind kind) {
+  if (!canWait()) return nativeError("Can't wait from inside a native.");
+  if (!waitForFile(vm.coroutine, file, kind)) {
+    return nativeError("Something is already waiting on this file.");
+  }
+  return waitInLoop(argCount);
+}
+
+// prit() is rreshti() that lets the other contexts run until the line
+// is there.
+static Value filePritNative(int argCount, Value* args) {
+  if (argCount != 0) {
+    return nativeError("Expected 0 arguments but got %d.", argCount);
+  }
+  ObjFile* file = openFileArg(args, false);
+  if (file == NULL) return NIL_VAL;
+  return waitForFileArg(argCount, file, WAIT_LINE);
+}
+
+// prano() waits for a connection on a socket from degjo().
+static Value filePranoNative(int argCount, Value* args) {
+  if (argCount != 0) {
+    return nativeError("Expected 0 arguments but got %d.", argCount);
+  }
+  ObjFile* file = AS_FILE(args[-1]);
+  if (!file->isOpen) return nativeError("File is closed.");
+  if (!file->isListening) {
+    return nativeError("File is not a listening socket.");
+  }
+  return waitForFileArg(argCount, file, WAIT_CONNECTION);
+}
+
+static Value lidhuNative(int argCount, Value* args) {
+  if (argCount != 1) {
+    return nativeError("Expected 1 arguments but got %d.", argCount);
+  }
+  if (!stringArg(args, 0)) return NIL_VAL;
+
+  ObjFile* file = connectSocket(args[0]);
+  return file == NULL ? NIL_VAL : OBJ_VAL(file);
+}
+
+static Value degjoNative(int argCount, Value* args) {
+  if (argCount != 1) {
+    return nativeError("Expected 1 arguments but got %d.", argCount);
+  }
+  if (!stringArg(args, 0)) return NIL_VAL;
+
+  ObjFile* file = listenSocket(args[0]);
+  return file == NULL ? NIL_VAL : OBJ_VAL(file);
+}
 //> reset-stack
 static void resetStack() {
+  // An error unwinds every running coroutine back to the main stack, and
+  // the contexts waiting in the loop are dropped.
+  while (vm.coroutine != NULL) {
+    ObjCoroutine* coroutine = vm.coroutine;
+    vm.coroutine = coroutine->resumer;
+    finishCoroutine(coroutine);
+  }
+  resetLoop();
+  vm.stack = vm.mainValues;
+  vm.frames = vm.mainFrames;
   vm.stackTop = vm.stack;
 //> Calls and Functions reset-frame-count
   vm.frameCount = 0;
+  vm.baseFrameCount = 0;
 //< Calls and Functions reset-frame-count
 //> Closures init-open-upvalues
   vm.openUpvalues = NULL;
@@ -94,11 +884,10 @@ static void resetStack() {
 
 //< reset-stack
 //> Types of Values runtime-error
-static void runtimeError(const char* format, ...) {
-  va_list args;
-  va_start(args, format);
+static void reportRuntimeError(const char* format, va_list args) {
+  // Anything printed before the error should show up before it.
+  flushOutput();
   vfprintf(stderr, format, args);
-  va_end(args);
   fputs("\n", stderr);
 
 /* Types of Values runtime-error < Calls and Functions runtime-error-temp
@@ -114,30 +903,88 @@ static void runtimeError(const char* format, ...) {
   fprintf(stderr, "[line %d] in script\n", line);
 */
 //> Calls and Functions runtime-error-stack
-  for (int i = vm.frameCount - 1; i >= 0; i--) {
-    CallFrame* frame = &vm.frames[i];
+  // The trace goes on through each coroutine's resumer.
+  CallFrame* frames = vm.frames;
+  int frameCount = vm.frameCount;
+  for (ObjCoroutine* coroutine = vm.coroutine; ;
+       coroutine = coroutine->resumer) {
+    for (int i = frameCount - 1; i >= 0; i--) {
+      CallFrame* frame = &frames[i];
 /* Calls and Functions runtime-error-stack < Closures runtime-error-function
-    ObjFunction* function = frame->function;
+      ObjFunction* function = frame->function;
 */
 //> Closures runtime-error-function
-    ObjFunction* function = frame->closure->function;
+      ObjFunction* function = frame->closure->function;
 //< Closures runtime-error-function
-    size_t instruction = frame->ip - function->chunk.code - 1;
-    fprintf(stderr, "[line %d] in ", // [minus]
-            function->chunk.lines[instruction]);
-    if (function->name == NULL) {
-      fprintf(stderr, "script\n");
-    } else {
-      fprintf(stderr, "%s()\n", function->name->chars);
+      size_t instruction = frame->ip - function->chunk.code - 1;
+      fprintf(stderr, "[line %d] in ", // [minus]
+              function->chunk.lines[instruction]);
+      if (function->name == NULL) {
+        fprintf(stderr, "script\n");
+      } else {
+        fprintf(stderr, "%s()\n", function->name->chars);
+      }
     }
+    // A task's trace ends with the task.
+    if (coroutine == NULL || coroutine->isTask) break;
+
+    CallStack* resumer = coroutine->resumer == NULL
+        ? &vm.mainStack : &coroutine->resumer->stack;
+    frames = resumer->frames;
+    frameCount = resumer->frameCount;
   }
 
 //< Calls and Functions runtime-error-stack
   resetStack();
 }
+
+static void runtimeError(const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  reportRuntimeError(format, args);
+  va_end(args);
+}
+
+// Reports a runtime error from inside a native. The native should
+// return the result right away without touching the stack again.
+Value nativeError(const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  reportRuntimeError(format, args);
+  va_end(args);
+  vm.nativeFailed = true;
+  return NIL_VAL;
+}
 //< Types of Values runtime-error
+// Every native function in the order initVM() defines them. Snapshots
+// refer to natives by their index here.
+#define NATIVES_MAX 256
+static THREAD_LOCAL NativeFn natives[NATIVES_MAX];
+static THREAD_LOCAL int nativeCount = 0;
+
+static void registerNative(NativeFn function) {
+  if (nativeIndex(function) != -1) return;
+  if (nativeCount == NATIVES_MAX) {
+    fprintf(stderr, "Too many native functions.\n");
+    exit(70);
+  }
+  natives[nativeCount++] = function;
+}
+
+int nativeIndex(NativeFn function) {
+  for (int i = 0; i < nativeCount; i++) {
+    if (natives[i] == function) return i;
+  }
+  return -1;
+}
+
+NativeFn nativeAt(int index) {
+  if (index < 0 || index >= nativeCount) return NULL;
+  return natives[index];
+}
 //> Calls and Functions define-native
 static void defineNative(const char* name, NativeFn function) {
+  registerNative(function);
   push(OBJ_VAL(copyString(name, (int)strlen(name))));
   push(OBJ_VAL(newNative(function)));
   tableSet(&vm.globals, AS_STRING(vm.stack[0]), vm.stack[1]);
@@ -145,8 +992,19 @@ static void defineNative(const char* name, NativeFn function) {
   pop();
 }
 //< Calls and Functions define-native
+static ObjClass* defineBuiltinClass(const char* name) {
+  push(OBJ_VAL(copyString(name, (int)strlen(name))));
+  ObjClass* klass = newClass(AS_STRING(vm.stack[0]));
+  pop();
+  return klass;
+}
 
 void initVM() {
+  vm.coroutine = NULL;
+  vm.mainStack.stack = vm.mainValues;
+  vm.mainStack.frames = vm.mainFrames;
+  vm.inNativeCall = false;
+  initLoop();
 //> call-reset-stack
   resetStack();
 //< call-reset-stack
@@ -168,25 +1026,89 @@ void initVM() {
   initTable(&vm.globals);
 //< Global Variables init-globals
 //> Hash Tables init-strings
-  initTable(&vm.strings);
+  initInternSet(&vm.strings);
 //< Hash Tables init-strings
+  initSimd();
+  initInput(&vm.input, 0);
+  initOutput();
 //> Methods and Initializers init-init-string
 
 //> null-init-string
   vm.initString = NULL;
+  vm.stringClass = NULL;
+  vm.listClass = NULL;
+  vm.mapClass = NULL;
+  vm.fileClass = NULL;
+  vm.openFiles = NULL;
+  vm.arguments = NULL;
+  vm.nativeFailed = false;
 //< null-init-string
   vm.initString = copyString("init", 4);
 //< Methods and Initializers init-init-string
 //> Calls and Functions define-native-clock
   defineNative("lexo", lexoNative);
+  defineNative("rreshti", rreshtiNative);
+  defineNative("lexoTeGjitha", lexoTeGjithaNative);
   defineNative("koha", clockNative);
+  defineNative("hap", hapNative);
+  defineNative("argumentet", argumentetNative);
+  defineNative("zbraz", zbrazNative);
+  defineNative("korutine", korutineNative);
+  defineNative("jep", jepNative);
+  defineNative("detyre", detyreNative);
+  defineNative("fli", fliNative);
+  defineNative("prisDetyrat", prisDetyratNative);
+  defineNative("lidhu", lidhuNative);
+  defineNative("degjo", degjoNative);
   
-  vm.stringClass = newClass(copyString("Varg", 4)); // "Varg" = String
-  vm.listClass = newClass(copyString("Liste", 5)); // "Liste"
+  vm.stringClass = defineBuiltinClass("Varg"); // "Varg" = String
+  vm.listClass = defineBuiltinClass("Liste"); // "Liste"
+  vm.mapClass = defineBuiltinClass("Fjalor"); // "Fjalor" = Map
+  vm.fileClass = defineBuiltinClass("Skedar");
+  vm.coroutineClass = defineBuiltinClass("Korutine");
 
   // --- ADD METHODS TO CLASSES ---
   defineMethodNative(vm.stringClass, "gjatesia", stringGjatesiaNative);
+  defineMethodNative(vm.stringClass, "pjese", stringPjeseNative);
+  defineMethodNative(vm.stringClass, "indeksi", stringIndeksiNative);
+  defineMethodNative(vm.stringClass, "permban", stringPermbanNative);
+  defineMethodNative(vm.stringClass, "fillonMe", stringFillonMeNative);
+  defineMethodNative(vm.stringClass, "mbaronMe", stringMbaronMeNative);
+  defineMethodNative(vm.stringClass, "ndaj", stringNdajNative);
+  defineMethodNative(vm.stringClass, "pastro", stringPastroNative);
+  defineMethodNative(vm.stringClass, "zevendeso", stringZevendesoNative);
   defineMethodNative(vm.listClass, "gjatesia", listGjatesiaNative);
+  defineMethodNative(vm.listClass, "shto", listShtoNative);
+  defineMethodNative(vm.listClass, "hiq", listHiqNative);
+  defineMethodNative(vm.listClass, "fut", listFutNative);
+  defineMethodNative(vm.listClass, "fshi", listFshiNative);
+  defineMethodNative(vm.listClass, "rezervo", listRezervoNative);
+  defineMethodNative(vm.listClass, "pjese", listPjeseNative);
+  defineMethodNative(vm.listClass, "rendit", listRenditNative);
+  defineMethodNative(vm.listClass, "shuma", listShumaNative);
+  defineMethodNative(vm.listClass, "min", listMinNative);
+  defineMethodNative(vm.listClass, "maks", listMaksNative);
+  defineMethodNative(vm.listClass, "prodhimi", listProdhimiNative);
+  defineMethodNative(vm.listClass, "shkallezo", listShkallezoNative);
+  defineMethodNative(vm.listClass, "mbledh", listMbledhNative);
+  defineMethodNative(vm.listClass, "mbush", listMbushNative);
+  defineMethodNative(vm.listClass, "indeksi", listIndeksiNative);
+  defineMethodNative(vm.listClass, "hartoParalel", listHartoParalelNative);
+  defineMethodNative(vm.listClass, "palosParalel", listPalosParalelNative);
+  defineMethodNative(vm.mapClass, "gjatesia", mapGjatesiaNative);
+  defineMethodNative(vm.mapClass, "celesat", mapCelesatNative);
+  defineMethodNative(vm.mapClass, "permban", mapPermbanNative);
+  defineMethodNative(vm.mapClass, "fshi", mapFshiNative);
+  defineMethodNative(vm.fileClass, "lexo", fileLexoNative);
+  defineMethodNative(vm.fileClass, "rreshti", fileRreshtiNative);
+  defineMethodNative(vm.fileClass, "shkruaj", fileShkruajNative);
+  defineMethodNative(vm.fileClass, "zbraz", fileZbrazNative);
+  defineMethodNative(vm.fileClass, "mbyll", fileMbyllNative);
+  defineMethodNative(vm.fileClass, "prit", filePritNative);
+  defineMethodNative(vm.fileClass, "prano", filePranoNative);
+  defineMethodNative(vm.coroutineClass, "vazhdo", coroutineVazhdoNative);
+  defineMethodNative(vm.coroutineClass, "perfundoi",
+                     coroutinePerfundoiNative);
 //< Calls and Functions define-native-clock
 }
 // REPLACE this entire function in src/vm.c
@@ -196,6 +1118,7 @@ void initVM() {
 
 // To this:
 static void defineMethodNative(ObjClass* klass, const char* name, NativeFn fn) {
+    registerNative(fn);
     push(OBJ_VAL(copyString(name, (int)strlen(name))));
     push(OBJ_VAL(newNative(fn)));
     tableSet(&klass->methods, AS_STRING(vm.stack[0]), vm.stack[1]);
@@ -203,11 +1126,14 @@ static void defineMethodNative(ObjClass* klass, const char* name, NativeFn fn) {
     pop();
 }
 void freeVM() {
+  flushOutput();
+  freeLoop();
+  closeAllFiles();
 //> Global Variables free-globals
   freeTable(&vm.globals);
 //< Global Variables free-globals
 //> Hash Tables free-strings
-  freeTable(&vm.strings);
+  freeInternSet(&vm.strings);
 //< Hash Tables free-strings
 //> Methods and Initializers clear-init-string
   vm.initString = NULL;
@@ -276,6 +1202,21 @@ static bool call(ObjClosure* closure, int argCount) {
 }
 //< Calls and Functions call
 //> Calls and Functions call-value
+static bool callNative(NativeFn native, int argCount) {
+  Value* stack = vm.stack;
+  Value result = native(argCount, vm.stackTop - argCount);
+  if (vm.nativeFailed) {
+    vm.nativeFailed = false;
+    return false;
+  }
+  // A native that switched coroutines has set up both stacks itself.
+  if (vm.stack != stack) return true;
+
+  vm.stackTop -= argCount + 1;
+  push(result);
+  return true;
+}
+
 static bool callValue(Value callee, int argCount) {
   if (IS_OBJ(callee)) {
     switch (OBJ_TYPE(callee)) {
@@ -317,13 +1258,8 @@ static bool callValue(Value callee, int argCount) {
         return call(AS_FUNCTION(callee), argCount);
 */
 //> call-native
-      case OBJ_NATIVE: {
-        NativeFn native = AS_NATIVE(callee);
-        Value result = native(argCount, vm.stackTop - argCount);
-        vm.stackTop -= argCount + 1;
-        push(result);
-        return true;
-      }
+      case OBJ_NATIVE:
+        return callNative(AS_NATIVE(callee), argCount);
 //< call-native
       default:
         break; // Non-callable object type.
@@ -344,13 +1280,9 @@ static bool invokeFromClass(ObjClass* klass, ObjString* name, int argCount) {
 
     // --- NEW LOGIC ---
     if (IS_NATIVE(method)) {
-        NativeFn native = AS_NATIVE(method);
-    // The arguments start at stackTop - argCount.
-    // The receiver is at stackTop - argCount - 1.
-    Value result = native(argCount, vm.stackTop - argCount);
-    vm.stackTop -= argCount + 1; // Pop args and the callee
-    push(result);
-    return true;
+        // The arguments start at stackTop - argCount.
+        // The receiver is at stackTop - argCount - 1.
+        return callNative(AS_NATIVE(method), argCount);
     }
     // --- END NEW LOGIC ---
 
@@ -366,9 +1298,18 @@ static bool invoke(ObjString* name, int argCount) {
     if (IS_LIST(receiver)) {
         return invokeFromClass(vm.listClass, name, argCount);
     }
-    if (IS_STRING(receiver)) {
+    if (IS_ANY_STRING(receiver)) {
         return invokeFromClass(vm.stringClass, name, argCount);
     }
+    if (IS_MAP(receiver)) {
+        return invokeFromClass(vm.mapClass, name, argCount);
+    }
+    if (IS_FILE(receiver)) {
+        return invokeFromClass(vm.fileClass, name, argCount);
+    }
+    if (IS_COROUTINE(receiver)) {
+        return invokeFromClass(vm.coroutineClass, name, argCount);
+    }
 
     if (!IS_INSTANCE(receiver)) {
         runtimeError("Only instances have methods.");
@@ -416,6 +1357,9 @@ static ObjUpvalue* captureUpvalue(Value* local) {
 
 //< look-for-existing-upvalue
   ObjUpvalue* createdUpvalue = newUpvalue(local);
+  // Until it is closed, closed holds the coroutine whose stack the slot
+  // is on, so the stack lives as long as the upvalue.
+  if (vm.coroutine != NULL) createdUpvalue->closed = OBJ_VAL(vm.coroutine);
 //> insert-upvalue-in-list
   createdUpvalue->next = upvalue;
 
@@ -454,28 +1398,29 @@ static bool isFalsey(Value value) {
 }
 //< Types of Values is-falsey
 //> Strings concatenate
+// Formats a number for concatenation the same way printo shows it.
+static Value numberToString(double number) {
+  char buffer[NUMBER_BUFFER_SIZE];
+  int length = formatNumber(number, buffer);
+  return copyStringValue(buffer, length);
+}
+
 static void concatenate() {
 /* Strings concatenate < Garbage Collection concatenate-peek
   ObjString* b = AS_STRING(pop());
   ObjString* a = AS_STRING(pop());
 */
 //> Garbage Collection concatenate-peek
-  ObjString* b = AS_STRING(peek(0));
-  ObjString* a = AS_STRING(peek(1));
+  Value b = peek(0);
+  Value a = peek(1);
 //< Garbage Collection concatenate-peek
 
-  int length = a->length + b->length;
-  char* chars = ALLOCATE(char, length + 1);
-  memcpy(chars, a->chars, a->length);
-  memcpy(chars + a->length, b->chars, b->length);
-  chars[length] = '\0';
-
-  ObjString* result = takeString(chars, length);
+  Value result = concatenateStrings(a, b);
 //> Garbage Collection concatenate-pop
   pop();
   pop();
 //< Garbage Collection concatenate-pop
-  push(OBJ_VAL(result));
+  push(result);
 }
 //< Strings concatenate
 //> run
@@ -611,25 +1556,87 @@ static InterpretResult run() {
             case OP_BUILD_LIST: {
     uint8_t itemCount = READ_BYTE();
     ObjList* list = newList();
-    
-    // The items are on top of the stack.
-    // The first item is at stackTop - itemCount.
+    // Keep the list reachable while growing its array can collect.
+    push(OBJ_VAL(list));
+    reserveList(list, itemCount);
+
+    // The items are below the list on the stack.
+    // The first item is at stackTop - itemCount - 1.
     for (int i = 0; i < itemCount; i++) {
-        writeValueArray(&list->items, vm.stackTop[-itemCount + i]);
+        appendToList(list, vm.stackTop[-itemCount - 1 + i]);
     }
     
-    // Pop all the items.
-    vm.stackTop -= itemCount;
+    // Pop the list and all the items.
+    vm.stackTop -= itemCount + 1;
 
     // Push the new list.
     push(OBJ_VAL(list));
     break;
+}
+            case OP_CONSTANT_LIST: {
+    ObjList* list = copyList(AS_LIST(READ_CONSTANT()));
+    push(OBJ_VAL(list));
+    break;
+}
+            case OP_BUILD_MAP: {
+    uint8_t entryCount = READ_BYTE();
+    ObjMap* map = newMap();
+    // Keep the map reachable while growing it can collect.
+    push(OBJ_VAL(map));
+
+    // The keys and values alternate below the map on the stack.
+    Value* entries = vm.stackTop - entryCount * 2 - 1;
+    for (int i = 0; i < entryCount; i++) {
+        Value key = entries[i * 2];
+        if (!isValidMapKey(key)) {
+            runtimeError("Map key can't be nil or NaN.");
+            return INTERPRET_RUNTIME_ERROR;
+        }
+        mapSet(map, key, entries[i * 2 + 1]);
+    }
+
+    // Pop the map and all the entries.
+    vm.stackTop -= entryCount * 2 + 1;
+
+    // Push the new map.
+    push(OBJ_VAL(map));
+    break;
 }
             case OP_GET_INDEX: {
+                if (IS_MAP(peek(1))) {
+                    // A missing key reads as nil. Hashing a rope key
+                    // flattens it, so both stay on the stack until then.
+                    Value value;
+                    if (!mapGet(AS_MAP(peek(1)), peek(0), &value)) {
+                        value = NIL_VAL;
+                    }
+                    vm.stackTop -= 2;
+                    push(value);
+                    break;
+                }
+
+                if (IS_ANY_STRING(peek(1))) {
+                    if (!IS_NUMBER(peek(0))) {
+                        runtimeError("String index must be a number.");
+                        return INTERPRET_RUNTIME_ERROR;
+                    }
+                    double number = AS_NUMBER(peek(0));
+                    if (number < 0 || number >= stringLength(peek(1)) ||
+                        number != (int)number) {
+                        runtimeError("String index out of bounds.");
+                        return INTERPRET_RUNTIME_ERROR;
+                    }
+                    Value character = stringCharAt(peek(1), (int)number);
+                    vm.stackTop -= 2;
+                    push(character);
+                    break;
+                }
+
                 Value indexValue = pop();
                 Value listValue = pop();
                 if (!IS_LIST(listValue)) {
-                    runtimeError("Can only index into lists.");
+                    runtimeError(
+                        "Can only index into lists, maps and strings.");
                     return INTERPRET_RUNTIME_ERROR;
                 }
                 ObjList* list = AS_LIST(listValue);
@@ -647,12 +1654,26 @@ static InterpretResult run() {
             }
 
             case OP_SET_INDEX: {
+                if (IS_MAP(peek(2))) {
+                    if (!isValidMapKey(peek(1))) {
+                        runtimeError("Map key can't be nil or NaN.");
+                        return INTERPRET_RUNTIME_ERROR;
+                    }
+                    // Leave everything on the stack since inserting can
+                    // collect.
+                    mapSet(AS_MAP(peek(2)), peek(1), peek(0));
+                    Value value = pop();
+                    vm.stackTop -= 2;
+                    push(value); // Assignment is an expression
+                    break;
+                }
+
                 Value value = pop();
                 Value indexValue = pop();
                 Value listValue = pop();
                 // ... (same validation as OP_GET_INDEX) ...
                 if (!IS_LIST(listValue)) {
-                    runtimeError("Can only index into lists.");
+                    runtimeError("Can only index into lists and maps.");
                     return INTERPRET_RUNTIME_ERROR;
                 }
                 ObjList* list = AS_LIST(listValue);
@@ -665,7 +1686,7 @@ static InterpretResult run() {
                     runtimeError("List index out of bounds.");
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                list->items.values[index] = value;
+                storeInList(list, index, value);
                 push(value); // Assignment is an expression
                 break;
             }
@@ -776,9 +1797,12 @@ static InterpretResult run() {
 //< Superclasses interpret-get-super
 //> Types of Values interpret-equal
       case OP_EQUAL: {
-        Value b = pop();
-        Value a = pop();
-        push(BOOL_VAL(valuesEqual(a, b)));
+        // Comparing a rope flattens it, which can trigger a collection,
+        // so the operands stay on the stack until we are done.
+        bool equal = valuesEqual(peek(1), peek(0));
+        pop();
+        pop();
+        push(BOOL_VAL(equal));
         break;
       }
 //< Types of Values interpret-equal
@@ -800,7 +1824,13 @@ static InterpretResult run() {
 */
 //> Strings add-strings
       case OP_ADD: {
-        if (IS_STRING(peek(0)) && IS_STRING(peek(1))) {
+        if (IS_ANY_STRING(peek(0)) && IS_ANY_STRING(peek(1))) {
+          concatenate();
+        } else if (IS_ANY_STRING(peek(1)) && IS_NUMBER(peek(0))) {
+          vm.stackTop[-1] = numberToString(AS_NUMBER(peek(0)));
+          concatenate();
+        } else if (IS_NUMBER(peek(1)) && IS_ANY_STRING(peek(0))) {
+          vm.stackTop[-2] = numberToString(AS_NUMBER(peek(1)));
           concatenate();
         } else if (IS_NUMBER(peek(0)) && IS_NUMBER(peek(1))) {
           double b = AS_NUMBER(pop());
@@ -808,7 +1838,7 @@ static InterpretResult run() {
           push(NUMBER_VAL(a + b));
         } else {
           runtimeError(
-              "Operands must be two numbers or two strings.");
+              "Operands must be numbers or strings.");
           return INTERPRET_RUNTIME_ERROR;
         }
         break;
@@ -836,7 +1866,7 @@ static InterpretResult run() {
 //> Global Variables interpret-print
       case OP_PRINT: {
         printValue(pop());
-        printf("\n");
+        writeOutput("\n", 1);
         break;
       }
 //< Global Variables interpret-print
@@ -865,6 +1895,29 @@ static InterpretResult run() {
       }
 //< Jumping Back and Forth op-jump-if-false
 //> Jumping Back and Forth op-loop
+      case OP_LIST_ITERATOR: {
+        if (!IS_LIST(peek(0))) {
+          runtimeError("Can only loop over lists.");
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        push(NUMBER_VAL(0));
+        break;
+      }
+      // The slot holds the list, checked by OP_LIST_ITERATOR, and the
+      // next one holds the index of the next item.
+      case OP_FOR_EACH: {
+        uint8_t slot = READ_BYTE();
+        uint16_t offset = READ_SHORT();
+        ObjList* list = AS_LIST(frame->slots[slot]);
+        int index = (int)AS_NUMBER(frame->slots[slot + 1]);
+        if (index >= list->items.count) {
+          frame->ip += offset;
+          break;
+        }
+        frame->slots[slot + 1] = NUMBER_VAL(index + 1);
+        push(list->items.values[index]);
+        break;
+      }
       case OP_LOOP: {
         uint16_t offset = READ_SHORT();
 /* Jumping Back and Forth op-loop < Calls and Functions loop
@@ -954,6 +2007,29 @@ static InterpretResult run() {
         closeUpvalues(frame->slots);
 //< Closures return-close-upvalues
         vm.frameCount--;
+        if (vm.frameCount == 0 && vm.coroutine != NULL) {
+          // The coroutine is done. Its result goes to whoever resumed it,
+          // or is dropped for a task, which hands the VM to the loop.
+          ObjCoroutine* coroutine = vm.coroutine;
+          vm.stackTop = vm.stack;
+          if (coroutine->isTask) {
+            finishTask();
+            Wakeup wakeup;
+            if (!nextWakeup(&wakeup)) {
+              vm.nativeFailed = false;
+              return INTERPRET_RUNTIME_ERROR;
+            }
+            enterContext(wakeup.context, wakeup.value);
+            finishCoroutine(coroutine);
+            frame = &vm.frames[vm.frameCount - 1];
+            break;
+          }
+          switchStack(coroutine->resumer);
+          finishCoroutine(coroutine);
+          push(result);
+          frame = &vm.frames[vm.frameCount - 1];
+          break;
+        }
         if (vm.frameCount == 0) {
           pop();
           return INTERPRET_OK;
@@ -961,6 +2037,9 @@ static InterpretResult run() {
 
         vm.stackTop = frame->slots;
         push(result);
+        // Hand the result back to the native that made the call.
+        if (vm.frameCount == vm.baseFrameCount) return INTERPRET_OK;
+
         frame = &vm.frames[vm.frameCount - 1];
         break;
 //< Calls and Functions interpret-return
@@ -1018,6 +2097,29 @@ void hack(bool b) {
   if (b) hack(false);
 }
 //< omit
+
+// Calls [callee] from inside a native. The callee and its [argCount]
+// arguments must be on top of the stack, and are replaced by the result
+// like a call from script code. A closure runs in a nested run() that
+// stops when it returns.
+//
+// Returns false if a runtime error was reported. nativeFailed is set
+// then, so the native should return right away.
+bool callFromNative(Value callee, int argCount) {
+  int frameCount = vm.frameCount;
+  vm.inNativeCall = true;
+  bool success = callValue(callee, argCount);
+  vm.inNativeCall = false;
+  if (success && vm.frameCount != frameCount) {
+    int baseFrameCount = vm.baseFrameCount;
+    vm.baseFrameCount = frameCount;
+    success = run() == INTERPRET_OK;
+    vm.baseFrameCount = baseFrameCount;
+  }
+
+  if (!success) vm.nativeFailed = true;
+  return success;
+}
 //> interpret
 /* A Virtual Machine interpret < Scanning on Demand vm-interpret-c
 InterpretResult interpret(Chunk* chunk) {
@@ -1026,7 +2128,7 @@ InterpretResult interpret(Chunk* chunk) {
   return run();
 */
 //> Scanning on Demand vm-interpret-c
-InterpretResult interpret(const char* source) {
+InterpretResult interpret(const char* source, int length) {
 /* Scanning on Demand vm-interpret-c < Compiling Expressions interpret-chunk
   compile(source);
   return INTERPRET_OK;
@@ -1044,7 +2146,7 @@ InterpretResult interpret(const char* source) {
   vm.ip = vm.chunk->code;
 */
 //> Calls and Functions interpret-stub
-  ObjFunction* function = compile(source);
+  ObjFunction* function = compile(source, length);
   if (function == NULL) return INTERPRET_COMPILE_ERROR;
 
   push(OBJ_VAL(function));
@@ -1078,4 +2180,24 @@ InterpretResult interpret(const char* source) {
 //< Calls and Functions end-interpret
 //< Compiling Expressions interpret-chunk
 }
-//< interpret
\ No newline at end of file
+//< interpret
+
+// Runs a script that was compiled earlier, like the server's cached ones.
+InterpretResult interpretFunction(ObjFunction* function) {
+  push(OBJ_VAL(function));
+  ObjClosure* closure = newClosure(function);
+  pop();
+  push(OBJ_VAL(closure));
+  call(closure, 0);
+  return run();
+}
+
+void setArguments(int argc, const char* argv[]) {
+  vm.arguments = newList();
+  for (int i = 0; i < argc; i++) {
+    Value argument = copyStringValue(argv[i], (int)strlen(argv[i]));
+    push(argument);
+    appendToList(vm.arguments, argument);
+    pop();
+  }
+}
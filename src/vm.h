@@ -9,6 +9,10 @@
 #include "object.h"
 //< Calls and Functions vm-include-object
 //> Hash Tables vm-include-table
+#include "input.h"
+#include "intern.h"
+#include "loop.h"
+#include "output.h"
 #include "table.h"
 //< Hash Tables vm-include-table
 //> vm-include-value
@@ -26,7 +30,7 @@
 //< Calls and Functions frame-max
 //> Calls and Functions call-frame
 
-typedef struct {
+typedef struct CallFrame {
 /* Calls and Functions call-frame < Closures call-frame-closure
   ObjFunction* function;
 */
@@ -46,19 +50,29 @@ typedef struct {
   uint8_t* ip;
 */
 //> Calls and Functions frame-array
-  CallFrame frames[FRAMES_MAX];
+  // The running stack's frames and values. They are the main stack's
+  // unless a coroutine is running.
+  CallFrame* frames;
   int frameCount;
+  // run() returns when a frame returns and leaves this many behind. It
+  // is nonzero while a native is calling back into script code.
+  int baseFrameCount;
+  // Set when a native fails. The error has already been reported.
+  bool nativeFailed;
+  // Set while callFromNative() calls its callee. Natives can't switch
+  // coroutines then, since the native that called them is waiting.
+  bool inNativeCall;
   
 //< Calls and Functions frame-array
 //> vm-stack
-  Value stack[STACK_MAX];
+  Value* stack;
   Value* stackTop;
 //< vm-stack
 //> Global Variables vm-globals
   Table globals;
 //< Global Variables vm-globals
 //> Hash Tables vm-strings
-  Table strings;
+  InternSet strings;
 //< Hash Tables vm-strings
 //> Methods and Initializers vm-init-string
   ObjString* initString;
@@ -79,9 +93,26 @@ typedef struct {
   int grayCapacity;
   Obj** grayStack;
   ObjClass* listClass;
+  ObjClass* mapClass;
     ObjClass* stringClass;
+  ObjClass* fileClass;
+  ObjClass* coroutineClass;
+  // Every file that is still open, so they can be flushed at exit.
+  ObjFile* openFiles;
+  // The command-line arguments after the script path.
+  ObjList* arguments;
 
 //< Garbage Collection vm-gray-stack
+  InputBuffer input;
+  OutputBuffer output;
+  EventLoop loop;
+
+  // The running coroutine, or NULL on the main stack. While one runs,
+  // mainStack keeps where the main stack stopped.
+  ObjCoroutine* coroutine;
+  CallStack mainStack;
+  CallFrame mainFrames[FRAMES_MAX];
+  Value mainValues[STACK_MAX];
 } VM;
 
 //> interpret-result
@@ -93,7 +124,7 @@ typedef enum {
 
 //< interpret-result
 //> Strings extern-vm
-extern VM vm;
+extern THREAD_LOCAL VM vm;
 
 //< Strings extern-vm
 void initVM();
@@ -102,11 +133,19 @@ void freeVM();
 InterpretResult interpret(Chunk* chunk);
 */
 //> Scanning on Demand vm-interpret-h
-InterpretResult interpret(const char* source);
+InterpretResult interpret(const char* source, int length);
 //< Scanning on Demand vm-interpret-h
+InterpretResult interpretFunction(ObjFunction* function);
+void setArguments(int argc, const char* argv[]);
 //> push-pop
 void push(Value value);
 Value pop();
 //< push-pop
+Value nativeError(const char* format, ...);
+// The index of a native defined by initVM(), or -1. nativeAt() returns
+// NULL for an index out of range.
+int nativeIndex(NativeFn function);
+NativeFn nativeAt(int index);
+bool callFromNative(Value callee, int argCount);
 
 #endif
\ No newline at end of file
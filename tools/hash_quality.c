@@ -0,0 +1,174 @@
+// Checks the quality of hashBytes() and compares its speed with the
+// byte-at-a-time FNV-1a it replaced. Build and run from the repo root:
+//
+//   cc -O2 -Isrc -o hash_quality tools/hash_quality.c src/hash.c -lm
+//   ./hash_quality
+//
+// Exits with 1 if the avalanche or distribution checks fail.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "hash.h"
+
+#define AVALANCHE_KEYS 20000
+#define BUCKET_BITS 16
+#define BUCKETS (1 << BUCKET_BITS)
+#define DISTRIBUTION_KEYS (BUCKETS * 16)
+
+static uint64_t state = 0x9e3779b97f4a7c15ull;
+
+static uint64_t randomWord() {
+  // xorshift64*.
+  state ^= state >> 12;
+  state ^= state << 25;
+  state ^= state >> 27;
+  return state * 0x2545f4914f6cdd1dull;
+}
+
+static void randomBytes(char* bytes, int length) {
+  for (int i = 0; i < length; i++) bytes[i] = (char)randomWord();
+}
+
+static int popCount(uint32_t bits) {
+  int count = 0;
+  for (; bits != 0; bits &= bits - 1) count++;
+  return count;
+}
+
+// Flipping any one input bit should flip each output bit with
+// probability 1/2, so 16 of the 32 on average and no bit further from
+// half than sampling noise explains. One-byte keys are tried
+// exhaustively.
+static bool checkAvalanche(int length) {
+  static long flips[32];
+  memset(flips, 0, sizeof(flips));
+  long total = 0;
+  long trials = 0;
+
+  char key[256];
+  int keys = length == 1 ? 256 : AVALANCHE_KEYS / length + 1;
+  for (int k = 0; k < keys; k++) {
+    if (length == 1) {
+      key[0] = (char)k;
+    } else {
+      randomBytes(key, length);
+    }
+    uint32_t hash = hashBytes(key, length);
+    for (int bit = 0; bit < length * 8; bit++) {
+      key[bit / 8] ^= (char)(1 << (bit % 8));
+      uint32_t changed = hash ^ hashBytes(key, length);
+      key[bit / 8] ^= (char)(1 << (bit % 8));
+
+      total += popCount(changed);
+      for (int out = 0; out < 32; out++) {
+        if (changed & (1u << out)) flips[out]++;
+      }
+      trials++;
+    }
+  }
+
+  double mean = (double)total / trials;
+  double worst = 0.0;
+  for (int out = 0; out < 32; out++) {
+    double bias = (double)flips[out] / trials - 0.5;
+    if (bias < 0) bias = -bias;
+    if (bias > worst) worst = bias;
+  }
+
+  // Five standard errors of a fair coin over this many trials.
+  double limit = 5 * 0.5 / sqrt((double)trials);
+  bool passed = mean > 15.8 && mean < 16.2 && worst < limit;
+  printf("avalanche %3d bytes: %.3f bits flipped, worst bit bias %.4f%s\n",
+         length, mean, worst, passed ? "" : "  FAILED");
+  return passed;
+}
+
+// Chi-squared over the low bits, as a power-of-two table would use them.
+// chi2/df should be close to 1 for a uniform hash.
+static bool checkDistribution(const char* name, bool sequential,
+                              int length) {
+  static int counts[BUCKETS];
+  memset(counts, 0, sizeof(counts));
+
+  char key[256];
+  for (int i = 0; i < DISTRIBUTION_KEYS; i++) {
+    int keyLength = length;
+    if (sequential) {
+      keyLength = snprintf(key, sizeof(key), "key%d", i);
+    } else {
+      randomBytes(key, length);
+    }
+    counts[hashBytes(key, keyLength) & (BUCKETS - 1)]++;
+  }
+
+  double expected = (double)DISTRIBUTION_KEYS / BUCKETS;
+  double chi2 = 0.0;
+  for (int i = 0; i < BUCKETS; i++) {
+    double difference = counts[i] - expected;
+    chi2 += difference * difference / expected;
+  }
+
+  double ratio = chi2 / (BUCKETS - 1);
+  bool passed = ratio > 0.95 && ratio < 1.05;
+  printf("distribution %-20s chi2/df %.3f%s\n", name, ratio,
+         passed ? "" : "  FAILED");
+  return passed;
+}
+
+static uint32_t fnv1a(const char* key, int length) {
+  uint32_t hash = 2166136261u;
+  for (int i = 0; i < length; i++) {
+    hash ^= (uint8_t)key[i];
+    hash *= 16777619;
+  }
+  return hash;
+}
+
+static double seconds() {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+static double throughput(uint32_t (*hash)(const char*, int),
+                         const char* bytes, int length) {
+  long rounds = (64L * 1024 * 1024) / length;
+  uint32_t sink = 0;
+  double start = seconds();
+  for (long i = 0; i < rounds; i++) {
+    // Vary the start so the loop can't be hoisted.
+    sink += hash(bytes + (i & 7), length);
+  }
+  double elapsed = seconds() - start;
+  if (sink == 1) printf(" ");
+  return rounds * (double)length / elapsed / 1e9;
+}
+
+int main() {
+  bool passed = true;
+  int lengths[] = {1, 3, 4, 8, 15, 16, 17, 32, 48, 100, 255};
+  for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+    passed = checkAvalanche(lengths[i]) && passed;
+  }
+
+  passed = checkDistribution("'key%d'", true, 0) && passed;
+  passed = checkDistribution("random 8 bytes", false, 8) && passed;
+  passed = checkDistribution("random 64 bytes", false, 64) && passed;
+
+  int sizes[] = {8, 32, 256, 4096};
+  char* bytes = (char*)malloc(4096 + 8);
+  randomBytes(bytes, 4096 + 8);
+  printf("\n%8s %12s %12s\n", "bytes", "hashBytes", "FNV-1a");
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    printf("%8d %9.2f GB/s %7.2f GB/s\n", sizes[i],
+           throughput(hashBytes, bytes, sizes[i]),
+           throughput(fnv1a, bytes, sizes[i]));
+  }
+  free(bytes);
+
+  return passed ? 0 : 1;
+}